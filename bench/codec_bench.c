@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <platformchannel.h>
+
+#define JSMN_STATIC
+#include <jsmn.h>
+
+/*
+ * Benchmark of the platform channel codecs.
+ * Encodes & decodes one message per value type of the standard & JSON codecs, and some
+ * realistic composite messages, the way flutter-pi does it on the platform task thread:
+ * encoded into the thread buffer, decoded into the thread arena. Some standard codec messages
+ * are also decoded with string views. (see platch_decode_string_views)
+ * The decode timings include copying the message, since the JSON decoder decodes in place.
+ *
+ * JSON messages are also decoded with the jsmn based decoder flutter-pi used before
+ * (128 tokens on the stack, calloc for every array & object, no unescaping of strings), for comparison.
+ *
+ * The benchmark is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc to count allocations.
+ * Once the thread buffer & arena grew big enough for a message (after the first iteration),
+ * encoding & decoding it again must not allocate at all. The benchmark fails if it does.
+ *
+ * usage: codec_bench [number of iterations]
+ */
+
+struct bench_case {
+	const char *name;
+	struct platch_obj object;
+	bool string_views;
+};
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static size_t n_allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+	n_allocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+	n_allocations++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	n_allocations++;
+	return __real_realloc(ptr, size);
+}
+
+static uint64_t get_time_ns(void) {
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+/// The old JSON decoder: tokenize using jsmn, then build the values from the tokens.
+/// Messages with more than JSMN_TOKENLIST_SIZE tokens fail.
+#define JSMN_TOKENLIST_SIZE 128
+
+static int jsmn_decode_value(char *message, jsmntok_t **pptoken, struct json_value *value_out) {
+	struct json_value key;
+	jsmntok_t *ptoken;
+	char old;
+	int ok;
+
+	ptoken = *pptoken;
+	(*pptoken)++;
+
+	switch (ptoken->type) {
+		case JSMN_PRIMITIVE:
+			if (message[ptoken->start] == 'n') {
+				value_out->type = kJsonNull;
+			} else if (message[ptoken->start] == 't') {
+				value_out->type = kJsonTrue;
+			} else if (message[ptoken->start] == 'f') {
+				value_out->type = kJsonFalse;
+			} else {
+				value_out->type = kJsonNumber;
+
+				old = message[ptoken->end];
+				message[ptoken->end] = '\0';
+				value_out->number_value = strtod(message + ptoken->start, NULL);
+				message[ptoken->end] = old;
+			}
+			break;
+		case JSMN_STRING:
+			message[ptoken->end] = '\0';
+			value_out->type = kJsonString;
+			value_out->string_value = message + ptoken->start;
+			break;
+		case JSMN_ARRAY:
+			value_out->type = kJsonArray;
+			value_out->size = ptoken->size;
+			value_out->array = calloc(ptoken->size, sizeof(struct json_value));
+			if (value_out->array == NULL) return ENOMEM;
+
+			for (int i = 0; i < ptoken->size; i++) {
+				ok = jsmn_decode_value(message, pptoken, value_out->array + i);
+				if (ok != 0) return ok;
+			}
+			break;
+		case JSMN_OBJECT:
+			value_out->type = kJsonObject;
+			value_out->size = ptoken->size;
+			value_out->keys = calloc(ptoken->size, sizeof(char *));
+			value_out->values = calloc(ptoken->size, sizeof(struct json_value));
+			if ((value_out->keys == NULL) || (value_out->values == NULL)) return ENOMEM;
+
+			for (int i = 0; i < ptoken->size; i++) {
+				ok = jsmn_decode_value(message, pptoken, &key);
+				if (ok != 0) return ok;
+				if (key.type != kJsonString) return EBADMSG;
+
+				value_out->keys[i] = key.string_value;
+
+				ok = jsmn_decode_value(message, pptoken, value_out->values + i);
+				if (ok != 0) return ok;
+			}
+			break;
+		default:
+			return EBADMSG;
+	}
+
+	return 0;
+}
+
+static int jsmn_decode(uint8_t *scratch, const uint8_t *message, size_t size) {
+	struct json_value value;
+	jsmntok_t tokens[JSMN_TOKENLIST_SIZE], *ptoken;
+	jsmn_parser parser;
+	int ok;
+
+	memcpy(scratch, message, size);
+	scratch[size] = '\0';
+
+	jsmn_init(&parser);
+	ok = jsmn_parse(&parser, (const char *) scratch, size, tokens, JSMN_TOKENLIST_SIZE);
+	if (ok < 0) return EBADMSG;
+
+	ptoken = tokens;
+	memset(&value, 0, sizeof(value));
+	ok = jsmn_decode_value((char *) scratch, &ptoken, &value);
+	platch_free_json_value(&value, false);
+
+	return ok;
+}
+
+static int decode(const struct bench_case *bench_case, uint8_t *scratch, const uint8_t *message, size_t size) {
+	struct platch_obj decoded;
+	struct platch_arena *arena;
+	int ok;
+
+	memcpy(scratch, message, size);
+
+	arena = platch_acquire_thread_arena();
+	if (bench_case->string_views) {
+		ok = platch_decode_string_views(scratch, size, bench_case->object.codec, &decoded, arena);
+	} else {
+		ok = platch_decode_arena(scratch, size, bench_case->object.codec, &decoded, arena);
+	}
+	platch_release_thread_arena();
+
+	return ok;
+}
+
+/// Runs the benchmark case. Returns false if encoding or decoding failed, or allocated after the warm-up.
+static bool run_case(const struct bench_case *bench_case, int n_iterations) {
+	struct platch_obj object;
+	const uint8_t *encoded;
+	uint64_t start_ns, encode_ns, decode_ns, jsmn_decode_ns;
+	uint8_t *message, *scratch;
+	size_t size, n_encode_allocations, n_decode_allocations;
+	bool is_json;
+	int ok, jsmn_ok;
+
+	object = bench_case->object;
+	is_json = (object.codec == kJSONMessageCodec) || (object.codec == kJSONMethodCall) || (object.codec == kJSONMethodCallResponse);
+
+	// warm-up, so the thread buffer is big enough for the message.
+	ok = platch_encode_to_thread_buffer(&object, &encoded, &size);
+	if (ok != 0) {
+		fprintf(stderr, "%s: couldn't encode. platch_encode_to_thread_buffer: %s\n", bench_case->name, strerror(ok));
+		return false;
+	}
+
+	n_encode_allocations = n_allocations;
+	start_ns = get_time_ns();
+	for (int i = 0; i < n_iterations; i++) {
+		ok = platch_encode_to_thread_buffer(&object, &encoded, &size);
+		if (ok != 0) {
+			fprintf(stderr, "%s: couldn't encode. platch_encode_to_thread_buffer: %s\n", bench_case->name, strerror(ok));
+			return false;
+		}
+	}
+	encode_ns = get_time_ns() - start_ns;
+	n_encode_allocations = n_allocations - n_encode_allocations;
+
+	message = malloc(size + 1);
+	scratch = malloc(size + 1);
+	if ((message == NULL) || (scratch == NULL)) {
+		free(message);
+		free(scratch);
+		return false;
+	}
+
+	memcpy(message, encoded, size);
+	platch_release_thread_buffer();
+
+	// warm-up, so the thread arena is big enough for the decoded message.
+	ok = decode(bench_case, scratch, message, size);
+
+	n_decode_allocations = n_allocations;
+	start_ns = get_time_ns();
+	for (int i = 0; (ok == 0) && (i < n_iterations); i++) {
+		ok = decode(bench_case, scratch, message, size);
+	}
+	decode_ns = get_time_ns() - start_ns;
+	n_decode_allocations = n_allocations - n_decode_allocations;
+
+	jsmn_ok = 0;
+	jsmn_decode_ns = 0;
+	if (is_json) {
+		start_ns = get_time_ns();
+		for (int i = 0; (jsmn_ok == 0) && (i < n_iterations); i++) {
+			jsmn_ok = jsmn_decode(scratch, message, size);
+		}
+		jsmn_decode_ns = get_time_ns() - start_ns;
+	}
+
+	free(scratch);
+	free(message);
+
+	if (ok != 0) {
+		fprintf(stderr, "%s: couldn't decode. %s: %s\n", bench_case->name, bench_case->string_views ? "platch_decode_string_views" : "platch_decode_arena", strerror(ok));
+		return false;
+	}
+
+	printf(
+		"%-36s %7zu bytes   encode %9.1f ns (%7.1f MB/s)   decode %9.1f ns (%7.1f MB/s)",
+		bench_case->name, size,
+		(double) encode_ns / n_iterations, size * (double) n_iterations / encode_ns * 1e3,
+		(double) decode_ns / n_iterations, size * (double) n_iterations / decode_ns * 1e3
+	);
+
+	if (is_json && (jsmn_ok == 0)) {
+		printf(
+			"   jsmn decode %9.1f ns (%7.1f MB/s)\n",
+			(double) jsmn_decode_ns / n_iterations, size * (double) n_iterations / jsmn_decode_ns * 1e3
+		);
+	} else if (is_json) {
+		printf("   jsmn decode fails (%s)\n", strerror(jsmn_ok));
+	} else {
+		printf("\n");
+	}
+
+	if ((n_encode_allocations != 0) || (n_decode_allocations != 0)) {
+		printf(
+			"%-36s FAIL: %zu allocations while encoding, %zu while decoding after the warm-up (expected none)\n",
+			bench_case->name, n_encode_allocations, n_decode_allocations
+		);
+		return false;
+	}
+
+	return true;
+}
+
+#define STD_CASE(_name, value) {.name = _name, .object = {.codec = kStandardMessageCodec, .std_value = value}}
+#define STD_STRING_VIEWS_CASE(_name, value) {.name = _name, .object = {.codec = kStandardMessageCodec, .std_value = value}, .string_views = true}
+#define JSON_CASE(_name, value) {.name = _name, .object = {.codec = kJSONMessageCodec, .json_value = value}}
+
+int main(int argc, char **argv) {
+	static uint8_t bytes[1024];
+	static int32_t int32s[256];
+	static int64_t int64s[128];
+	static double doubles[128];
+	static char long_string[1025], escaped_string[257];
+	static struct std_value std_list[16], std_keys[16], std_values[16];
+	static struct json_value json_numbers[16], json_values[16];
+	static char *json_keys[16], key_storage[16][8];
+	static char large_text[27 * 1024 + 1];
+	static struct std_value large_std_keys[2000], large_std_values[2000];
+	static struct json_value large_json_values[2000];
+	static char *large_json_keys[2000], large_key_storage[2000][16];
+	int n_iterations, n_failed = 0;
+
+	n_iterations = argc > 1 ? atoi(argv[1]) : 100000;
+
+	for (int i = 0; i < 1024; i++) bytes[i] = i;
+	for (int i = 0; i < 256; i++) int32s[i] = i * 7919;
+	for (int i = 0; i < 128; i++) int64s[i] = i * 1000000007ll;
+	for (int i = 0; i < 128; i++) doubles[i] = i / 3.0;
+
+	for (int i = 0; i < 1024; i++) long_string[i] = 'a' + i % 26;
+	for (int i = 0; i < 256; i++) escaped_string[i] = "ab\"c\\d\n"[i % 7];
+	for (int i = 0; i < 27 * 1024; i++) large_text[i] = "The quick brown fox jumps over the lazy dog.\n"[i % 45];
+
+	for (int i = 0; i < 16; i++) {
+		snprintf(key_storage[i], sizeof(key_storage[i]), "key%d", i);
+
+		std_list[i] = STDINT32(i);
+		std_keys[i] = STDSTRING(key_storage[i]);
+		std_values[i] = STDFLOAT64(i * 0.1);
+
+		json_numbers[i] = (struct json_value) {.type = kJsonNumber, .number_value = i * 0.1};
+		json_keys[i] = key_storage[i];
+		json_values[i] = (struct json_value) {.type = kJsonNumber, .number_value = i};
+	}
+
+	// a large map, like the settings or the state of a whole screen.
+	for (int i = 0; i < 2000; i++) {
+		snprintf(large_key_storage[i], sizeof(large_key_storage[i]), "setting%d", i);
+
+		large_std_keys[i] = STDSTRING(large_key_storage[i]);
+		large_std_values[i] = i % 2 ? STDINT32(i) : STDSTRING(large_key_storage[i]);
+
+		large_json_keys[i] = large_key_storage[i];
+		large_json_values[i] = i % 2 ?
+			(struct json_value) {.type = kJsonNumber, .number_value = i} :
+			(struct json_value) {.type = kJsonString, .string_value = large_key_storage[i]};
+	}
+
+	// the arguments of the composite messages.
+	static char *editing_state_keys[] = {
+		"text", "selectionBase", "selectionExtent", "selectionAffinity",
+		"selectionIsDirectional", "composingBase", "composingExtent"
+	};
+	static struct json_value editing_state_values[] = {
+		{.type = kJsonString, .string_value = "The quick brown fox jumps over the lazy dog."},
+		{.type = kJsonNumber, .number_value = 44},
+		{.type = kJsonNumber, .number_value = 44},
+		{.type = kJsonString, .string_value = "TextAffinity.downstream"},
+		{.type = kJsonFalse},
+		{.type = kJsonNumber, .number_value = -1},
+		{.type = kJsonNumber, .number_value = -1}
+	};
+	static struct json_value update_editing_state_args[] = {
+		{.type = kJsonNumber, .number_value = 1},
+		{.type = kJsonObject, .size = 7, .keys = editing_state_keys, .values = editing_state_values}
+	};
+
+	// TextInput.setEditingState with a 27 KiB text, a text field with a long document in it.
+	static struct json_value large_editing_state_values[7];
+
+	memcpy(large_editing_state_values, editing_state_values, sizeof(editing_state_values));
+	large_editing_state_values[0].string_value = large_text;
+	large_editing_state_values[1].number_value = large_editing_state_values[2].number_value = 27 * 1024;
+
+	static char *input_type_keys[] = {"name", "signed", "decimal"};
+	static struct json_value input_type_values[] = {
+		{.type = kJsonString, .string_value = "TextInputType.multiline"},
+		{.type = kJsonNull},
+		{.type = kJsonNull}
+	};
+	static char *client_config_keys[] = {
+		"inputType", "obscureText", "autocorrect", "smartDashesType", "smartQuotesType", "enableSuggestions",
+		"actionLabel", "inputAction", "textCapitalization", "keyboardAppearance"
+	};
+	static struct json_value client_config_values[] = {
+		{.type = kJsonObject, .size = 3, .keys = input_type_keys, .values = input_type_values},
+		{.type = kJsonFalse},
+		{.type = kJsonTrue},
+		{.type = kJsonString, .string_value = "1"},
+		{.type = kJsonString, .string_value = "1"},
+		{.type = kJsonTrue},
+		{.type = kJsonNull},
+		{.type = kJsonString, .string_value = "TextInputAction.newline"},
+		{.type = kJsonString, .string_value = "TextCapitalization.none"},
+		{.type = kJsonString, .string_value = "Brightness.light"}
+	};
+	static struct json_value set_client_args[] = {
+		{.type = kJsonNumber, .number_value = 1},
+		{.type = kJsonObject, .size = 10, .keys = client_config_keys, .values = client_config_values}
+	};
+
+	// a JSON event with 100 elements, each of them a small object.
+	static char *event_element_keys[] = {"id", "x", "y"};
+	static struct json_value event_element_values[100][3], event_elements[100];
+
+	for (int i = 0; i < 100; i++) {
+		event_element_values[i][0] = (struct json_value) {.type = kJsonNumber, .number_value = i};
+		event_element_values[i][1] = (struct json_value) {.type = kJsonNumber, .number_value = i * 1.5};
+		event_element_values[i][2] = (struct json_value) {.type = kJsonNumber, .number_value = 1080 - i * 2.25};
+		event_elements[i] = (struct json_value) {.type = kJsonObject, .size = 3, .keys = event_element_keys, .values = event_element_values[i]};
+	}
+
+	static char *key_event_keys[] = {
+		"keymap", "toolkit", "keyCode", "scanCode", "modifiers", "unicodeScalarValues", "type"
+	};
+	static struct json_value key_event_values[] = {
+		{.type = kJsonString, .string_value = "linux"},
+		{.type = kJsonString, .string_value = "glfw"},
+		{.type = kJsonNumber, .number_value = 65},
+		{.type = kJsonNumber, .number_value = 30},
+		{.type = kJsonNumber, .number_value = 0},
+		{.type = kJsonNumber, .number_value = 97},
+		{.type = kJsonString, .string_value = "keydown"}
+	};
+
+	static struct std_value platform_view_keys[] = {
+		STDSTRING("id"), STDSTRING("viewType"), STDSTRING("width"), STDSTRING("height"), STDSTRING("params")
+	};
+	static struct std_value platform_view_values[] = {
+		STDINT32(3), STDSTRING("plugins.flutter.io/video_player"), STDFLOAT64(1920), STDFLOAT64(1080),
+		{.type = kStdUInt8Array, .size = 64, .uint8array = bytes}
+	};
+
+	// a gpiod line event, as sent to the event channel by platch_send_success_event_std.
+	static int64_t gpiod_timestamp[] = {1602331800, 123456789};
+	static struct std_value gpiod_event[] = {
+		STDINT32(4),
+		STDSTRING("SignalEdge.falling"),
+		{.type = kStdInt64Array, .size = 2, .int64array = gpiod_timestamp}
+	};
+
+	struct bench_case cases[] = {
+		STD_CASE("std null", STDNULL),
+		STD_CASE("std true", STDBOOL(true)),
+		STD_CASE("std false", STDBOOL(false)),
+		STD_CASE("std int32", STDINT32(123456)),
+		STD_CASE("std int64", STDINT64(1234567890123ll)),
+		STD_CASE("std large int", ((struct std_value) {.type = kStdLargeInt, .string_value = "1fffffffffffffffffffffffffffff"})),
+		STD_CASE("std float64", STDFLOAT64(3.14159)),
+		STD_CASE("std string (16 bytes)", STDSTRING("0123456789abcdef")),
+		STD_CASE("std string (1 KiB)", STDSTRING(long_string)),
+		STD_CASE("std string view (1 KiB)", STDSTRINGVIEW(long_string, 1024)),
+		STD_CASE("std uint8 array (1 KiB)", ((struct std_value) {.type = kStdUInt8Array, .size = 1024, .uint8array = bytes})),
+		STD_CASE("std int32 array (256)", ((struct std_value) {.type = kStdInt32Array, .size = 256, .int32array = int32s})),
+		STD_CASE("std int64 array (128)", ((struct std_value) {.type = kStdInt64Array, .size = 128, .int64array = int64s})),
+		STD_CASE("std float64 array (128)", ((struct std_value) {.type = kStdFloat64Array, .size = 128, .float64array = doubles})),
+		STD_CASE("std list (16 int32)", ((struct std_value) {.type = kStdList, .size = 16, .list = std_list})),
+		STD_CASE("std map (16 string: float)", ((struct std_value) {.type = kStdMap, .size = 16, .keys = std_keys, .values = std_values})),
+		STD_CASE("std map (2000 entries)", ((struct std_value) {.type = kStdMap, .size = 2000, .keys = large_std_keys, .values = large_std_values})),
+		STD_STRING_VIEWS_CASE("std string (1 KiB), views", STDSTRING(long_string)),
+		STD_STRING_VIEWS_CASE("std map (16 string: float), views", ((struct std_value) {.type = kStdMap, .size = 16, .keys = std_keys, .values = std_values})),
+		STD_STRING_VIEWS_CASE("std map (2000 entries), views", ((struct std_value) {.type = kStdMap, .size = 2000, .keys = large_std_keys, .values = large_std_values})),
+		JSON_CASE("json null", ((struct json_value) {.type = kJsonNull})),
+		JSON_CASE("json true", ((struct json_value) {.type = kJsonTrue})),
+		JSON_CASE("json false", ((struct json_value) {.type = kJsonFalse})),
+		JSON_CASE("json integer", ((struct json_value) {.type = kJsonNumber, .number_value = 123456})),
+		JSON_CASE("json fraction", ((struct json_value) {.type = kJsonNumber, .number_value = 0.1 + 0.2})),
+		JSON_CASE("json string (1 KiB)", ((struct json_value) {.type = kJsonString, .string_value = long_string})),
+		JSON_CASE("json string (escapes)", ((struct json_value) {.type = kJsonString, .string_value = escaped_string})),
+		JSON_CASE("json array (16 numbers)", ((struct json_value) {.type = kJsonArray, .size = 16, .array = json_numbers})),
+		JSON_CASE("json object (16 keys)", ((struct json_value) {.type = kJsonObject, .size = 16, .keys = json_keys, .values = json_values})),
+		JSON_CASE("json object (2000 keys)", ((struct json_value) {.type = kJsonObject, .size = 2000, .keys = large_json_keys, .values = large_json_values})),
+		JSON_CASE("raw keyboard key event", ((struct json_value) {.type = kJsonObject, .size = 7, .keys = key_event_keys, .values = key_event_values})),
+		{
+			.name = "TextInput.setEditingState",
+			.object = {
+				.codec = kJSONMethodCall,
+				.method = "TextInput.setEditingState",
+				.json_arg = {.type = kJsonObject, .size = 7, .keys = editing_state_keys, .values = editing_state_values}
+			}
+		},
+		{
+			.name = "TextInputClient.updateEditingState",
+			.object = {
+				.codec = kJSONMethodCall,
+				.method = "TextInputClient.updateEditingState",
+				.json_arg = {.type = kJsonArray, .size = 2, .array = update_editing_state_args}
+			}
+		},
+		{
+			.name = "TextInput.setEditingState (27 KiB)",
+			.object = {
+				.codec = kJSONMethodCall,
+				.method = "TextInput.setEditingState",
+				.json_arg = {.type = kJsonObject, .size = 7, .keys = editing_state_keys, .values = large_editing_state_values}
+			}
+		},
+		{
+			.name = "TextInput.setClient",
+			.object = {
+				.codec = kJSONMethodCall,
+				.method = "TextInput.setClient",
+				.json_arg = {.type = kJsonArray, .size = 2, .array = set_client_args}
+			}
+		},
+		JSON_CASE("json event (100 elements)", ((struct json_value) {.type = kJsonArray, .size = 100, .array = event_elements})),
+		{
+			.name = "gpiod line event",
+			.object = {
+				.codec = kStandardMethodCallResponse,
+				.success = true,
+				.std_result = {.type = kStdList, .size = 3, .list = gpiod_event}
+			}
+		},
+		{
+			.name = "platform view create",
+			.object = {
+				.codec = kStandardMethodCall,
+				.method = "create",
+				.std_arg = {.type = kStdMap, .size = 5, .keys = platform_view_keys, .values = platform_view_values}
+			}
+		},
+		{
+			.name = "platform view create, views",
+			.object = {
+				.codec = kStandardMethodCall,
+				.method = "create",
+				.std_arg = {.type = kStdMap, .size = 5, .keys = platform_view_keys, .values = platform_view_values}
+			},
+			.string_views = true
+		}
+	};
+
+	printf("%d iterations each.\n", n_iterations);
+
+	for (int i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+		if (!run_case(cases + i, n_iterations)) n_failed++;
+
+	if (n_failed > 0) {
+		printf("%d of %zu cases failed.\n", n_failed, sizeof(cases) / sizeof(*cases));
+		return EXIT_FAILURE;
+	}
+
+	printf("no allocations after the warm-up in any case.\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <console_keyboard.h>
+
+/*
+ * Benchmark of console_parse_input.
+ * Parses 1 MB of pasted text (ASCII, multi-byte UTF-8 & some cursor keys in between)
+ * in 4 KiB reads, like on_console_input in flutter-pi.c reads stdin (if the platform thread keeps up,
+ * process_console_input gets one read at a time): the unparsed rest of a read
+ * (a split escape sequence or UTF-8 character) is parsed again with the next one.
+ *
+ * usage: console_input_bench [number of runs]
+ */
+
+#define INPUT_SIZE (1024 * 1024)
+#define READ_SIZE 4096
+
+struct counts {
+	size_t n_text_calls, n_text_bytes, n_keys;
+};
+
+static void on_text(const char *utf8, size_t n_bytes, void *userdata) {
+	struct counts *counts = userdata;
+
+	counts->n_text_calls++;
+	counts->n_text_bytes += n_bytes;
+}
+
+static void on_key(glfw_key key, void *userdata) {
+	struct counts *counts = userdata;
+
+	counts->n_keys++;
+}
+
+static uint64_t get_time_ns(void) {
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+/// Fills input with lines of text, mixing in UTF-8 characters and arrow keys.
+static void generate_input(char *input, size_t size) {
+	static const char *pieces[] = {
+		"The quick brown fox jumps over the lazy dog. ",
+		"Gr\xc3\xbc\xc3\x9f""e aus M\xc3\xbcnchen! ",
+		"\xe2\x82\xac 42,00 ",
+		"\xf0\x9f\x98\x80 ",
+		"\e[D", "\e[C", "\x7f", "\n"
+	};
+	size_t i = 0, length;
+	unsigned int seed = 1;
+
+	while (i < size) {
+		seed = seed * 1103515245 + 12345;
+		const char *piece = pieces[(seed >> 16) % (sizeof(pieces) / sizeof(*pieces))];
+
+		length = strlen(piece);
+		if (i + length > size) break;
+
+		memcpy(input + i, piece, length);
+		i += length;
+	}
+
+	// pad with spaces, so the input is exactly size bytes.
+	memset(input + i, ' ', size - i);
+}
+
+static void parse_in_reads(const char *input, size_t size, struct counts *counts) {
+	char buffer[READ_SIZE + 16];
+	size_t n_buffered = 0, n_read, n_parsed, offset = 0;
+
+	while (offset < size) {
+		n_read = size - offset < READ_SIZE ? size - offset : READ_SIZE;
+		memcpy(buffer + n_buffered, input + offset, n_read);
+		offset += n_read;
+		n_buffered += n_read;
+
+		n_parsed = console_parse_input(buffer, n_buffered, on_text, on_key, counts);
+
+		memmove(buffer, buffer + n_parsed, n_buffered - n_parsed);
+		n_buffered -= n_parsed;
+	}
+}
+
+int main(int argc, char **argv) {
+	struct counts counts;
+	uint64_t start_ns, elapsed_ns, best_ns = UINT64_MAX;
+	char *input;
+	int n_runs;
+
+	n_runs = argc > 1 ? atoi(argv[1]) : 20;
+
+	input = malloc(INPUT_SIZE);
+	if (input == NULL) return EXIT_FAILURE;
+
+	generate_input(input, INPUT_SIZE);
+
+	for (int i = 0; i < n_runs; i++) {
+		counts = (struct counts) {0};
+
+		start_ns = get_time_ns();
+		parse_in_reads(input, INPUT_SIZE, &counts);
+		elapsed_ns = get_time_ns() - start_ns;
+
+		if (elapsed_ns < best_ns) best_ns = elapsed_ns;
+	}
+
+	printf(
+		"console_parse_input: %d KiB in %d byte reads: best of %d runs %.2f ms (%.0f MB/s), "
+		"%zu text runs (%zu bytes), %zu keys\n",
+		INPUT_SIZE / 1024, READ_SIZE, n_runs,
+		best_ns / 1e6, INPUT_SIZE / (best_ns / 1e9) / 1e6,
+		counts.n_text_calls, counts.n_text_bytes, counts.n_keys
+	);
+
+	free(input);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <platformchannel.h>
+
+/*
+ * Fuzz harness for platch_decode.
+ * The first byte of the input selects the codec, the rest is the platform message.
+ * Every message is decoded using calloc (and freed again, so leaks show up), inside an arena
+ * and, for the standard codecs, with string views.
+ * Messages that decode are encoded again, and the encoded message has to decode & encode
+ * to exactly the same bytes. (the first round trip may normalize, for example the number formatting)
+ */
+
+static const enum platch_codec codecs[] = {
+	kStringCodec,
+	kBinaryCodec,
+	kJSONMessageCodec,
+	kStandardMessageCodec,
+	kStandardMethodCall,
+	kStandardMethodCallResponse,
+	kJSONMethodCall,
+	kJSONMethodCallResponse
+};
+
+static struct platch_arena arena = {0};
+
+static void check(bool condition, const char *message) {
+	if (!condition) {
+		fprintf(stderr, "decode_fuzzer: %s\n", message);
+		abort();
+	}
+}
+
+/// platch_free_obj doesn't free method call responses, since flutter-pi only decodes them in arenas.
+static void free_obj(struct platch_obj *object) {
+	if (object->codec == kStandardMethodCallResponse) {
+		if (object->success) {
+			platch_free_value_std(&object->std_result);
+		} else {
+			free(object->error_code);
+			free(object->error_msg);
+			platch_free_value_std(&object->std_error_details);
+		}
+	} else if (object->codec == kJSONMethodCallResponse) {
+		platch_free_json_value(object->success ? &object->json_result : &object->json_error_details, false);
+	} else {
+		platch_free_obj(object);
+	}
+}
+
+/// Encodes object into a copy that stays valid after the next encode.
+static uint8_t *encode_copy(struct platch_obj *object, size_t *size_out) {
+	const uint8_t *encoded;
+	uint8_t *copy;
+	int ok;
+
+	ok = platch_encode_to_thread_buffer(object, &encoded, size_out);
+	check(ok == 0, "a decoded message couldn't be encoded");
+
+	copy = malloc(*size_out + 1);
+	check(copy != NULL, "out of memory");
+
+	memcpy(copy, encoded, *size_out);
+	platch_release_thread_buffer();
+
+	return copy;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	struct platch_obj object;
+	enum platch_codec codec;
+	uint8_t *message, *encoded, *reencoded;
+	size_t encoded_size, reencoded_size;
+	int ok;
+
+	if (size < 1) return 0;
+
+	codec = codecs[data[0] % (sizeof(codecs) / sizeof(*codecs))];
+	data++;
+	size--;
+
+	// the JSON decoder decodes strings in place, so every decode gets its own copy.
+	message = malloc(size + 1);
+	check(message != NULL, "out of memory");
+
+	memcpy(message, data, size);
+	memset(&object, 0, sizeof(object));
+	ok = platch_decode(message, size, codec, &object);
+	if (ok == 0) free_obj(&object);
+
+	if (codec == kStandardMessageCodec || codec == kStandardMethodCall || codec == kStandardMethodCallResponse) {
+		memcpy(message, data, size);
+		memset(&object, 0, sizeof(object));
+		platch_decode_string_views(message, size, codec, &object, &arena);
+		platch_arena_reset(&arena);
+	}
+
+	memcpy(message, data, size);
+	memset(&object, 0, sizeof(object));
+	ok = platch_decode_arena(message, size, codec, &object, &arena);
+	if (ok != 0) {
+		platch_arena_reset(&arena);
+		free(message);
+		return 0;
+	}
+
+	encoded = encode_copy(&object, &encoded_size);
+	platch_arena_reset(&arena);
+
+	// decode & encode the encoded message again. encoded is modified by the JSON decoder,
+	// so it's compared against a second copy.
+	memcpy(message = realloc(message, encoded_size + 1), encoded, encoded_size);
+	check(message != NULL, "out of memory");
+
+	memset(&object, 0, sizeof(object));
+	ok = platch_decode_arena(message, encoded_size, codec, &object, &arena);
+	check(ok == 0, "an encoded message couldn't be decoded again");
+
+	reencoded = encode_copy(&object, &reencoded_size);
+	platch_arena_reset(&arena);
+
+	check(
+		(reencoded_size == encoded_size) && (memcmp(reencoded, encoded, encoded_size) == 0),
+		"an encoded message was encoded differently after decoding it again"
+	);
+
+	free(reencoded);
+	free(encoded);
+	free(message);
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A main for the fuzz harnesses, for compilers without libFuzzer (like gcc) and for AFL.
+ * Runs LLVMFuzzerTestOneInput once for every file given on the command line, or for stdin
+ * if there are none. (which is how AFL passes its inputs)
+ * Build the harness with -fsanitize=address to get the same checks as under libFuzzer.
+ */
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(FILE *file) {
+	uint8_t *data = NULL, *new_data;
+	size_t size = 0, capacity = 0, n_read;
+
+	do {
+		if (size == capacity) {
+			capacity = capacity ? capacity * 2 : 4096;
+			new_data = realloc(data, capacity);
+			if (new_data == NULL) {
+				free(data);
+				return EXIT_FAILURE;
+			}
+			data = new_data;
+		}
+
+		n_read = fread(data + size, 1, capacity - size, file);
+		size += n_read;
+	} while (n_read > 0);
+
+	LLVMFuzzerTestOneInput(data, size);
+
+	free(data);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+	FILE *file;
+	int ok;
+
+	if (argc < 2)
+		return run_file(stdin);
+
+	for (int i = 1; i < argc; i++) {
+		file = fopen(argv[i], "rb");
+		if (file == NULL) {
+			perror(argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		ok = run_file(file);
+		fclose(file);
+
+		if (ok != EXIT_SUCCESS) return ok;
+	}
+
+	return EXIT_SUCCESS;
+}
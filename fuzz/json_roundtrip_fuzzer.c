@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <platformchannel.h>
+
+/*
+ * Round trip fuzz harness for the JSON encoder.
+ * The input is used twice: as an array of doubles (8 bytes each), and as a string (up to the first zero byte).
+ * Both are encoded as a JSON message and decoded again. Every finite number has to come back
+ * bit for bit (so the number formatting is the shortest one that round-trips), non-finite numbers
+ * as null, and the string has to come back unchanged (so the escaping is right).
+ */
+
+static struct platch_arena arena = {0};
+
+static void check(bool condition, const char *message) {
+	if (!condition) {
+		fprintf(stderr, "json_roundtrip_fuzzer: %s\n", message);
+		abort();
+	}
+}
+
+/// Encodes value as a JSON message and decodes it into decoded_out, inside the arena.
+/// Returns the encoded message, which the strings of decoded_out point into.
+static uint8_t *round_trip(struct json_value *value, struct json_value *decoded_out) {
+	struct platch_obj object = {.codec = kJSONMessageCodec, .json_value = *value};
+	const uint8_t *encoded;
+	uint8_t *copy;
+	size_t size;
+	int ok;
+
+	ok = platch_encode_to_thread_buffer(&object, &encoded, &size);
+	check(ok == 0, "couldn't encode");
+
+	copy = malloc(size + 1);
+	check(copy != NULL, "out of memory");
+
+	memcpy(copy, encoded, size);
+	platch_release_thread_buffer();
+
+	ok = platch_decode_arena(copy, size, kJSONMessageCodec, &object, &arena);
+	check(ok == 0, "couldn't decode an encoded message");
+
+	*decoded_out = object.json_value;
+	return copy;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	struct json_value numbers, decoded;
+	uint64_t bits, decoded_bits;
+	uint8_t *encoded;
+	char *string;
+
+	// the numbers
+	numbers.type = kJsonArray;
+	numbers.size = size / 8;
+	numbers.array = calloc(numbers.size + 1, sizeof(struct json_value));
+	check(numbers.array != NULL, "out of memory");
+
+	for (size_t i = 0; i < numbers.size; i++) {
+		numbers.array[i].type = kJsonNumber;
+		memcpy(&numbers.array[i].number_value, data + 8*i, 8);
+	}
+
+	encoded = round_trip(&numbers, &decoded);
+
+	check((decoded.type == kJsonArray) && (decoded.size == numbers.size), "the array of numbers changed");
+	for (size_t i = 0; i < numbers.size; i++) {
+		if (!isfinite(numbers.array[i].number_value)) {
+			check(decoded.array[i].type == kJsonNull, "a non-finite number wasn't encoded as null");
+			continue;
+		}
+
+		memcpy(&bits, &numbers.array[i].number_value, 8);
+		memcpy(&decoded_bits, &decoded.array[i].number_value, 8);
+		check((decoded.array[i].type == kJsonNumber) && (bits == decoded_bits), "a number didn't round-trip exactly");
+	}
+
+	free(encoded);
+	free(numbers.array);
+	platch_arena_reset(&arena);
+
+	// the string
+	string = strndup((const char *) data, size);
+	check(string != NULL, "out of memory");
+
+	encoded = round_trip(&(struct json_value) {.type = kJsonString, .string_value = string}, &decoded);
+	check((decoded.type == kJsonString) && (strcmp(decoded.string_value, string) == 0), "a string didn't round-trip");
+
+	free(encoded);
+	free(string);
+	platch_arena_reset(&arena);
+
+	return 0;
+}
@@ -185,7 +185,21 @@ static inline char *utf8_symbol_at(char *utf8str, unsigned int symbol_index) {
     return symbol_index? NULL : utf8str;
 }
 
-glfw_key console_try_get_key(char *input, char **input_out);
-char    *console_try_get_utf8char(char *input, char **input_out);
+typedef void (*console_text_callback)(const char *utf8, size_t n_bytes, void *userdata);
+typedef void (*console_key_callback)(glfw_key key, void *userdata);
+
+/// Parses the console input, calling on_key for every known control sequence
+/// and on_text for every run of printable UTF-8 text between them.
+/// Unknown escape sequences and control characters are skipped.
+/// Returns the number of bytes that were parsed. The rest of the input is the start
+/// of an escape sequence or UTF-8 character that's cut off, and should be passed again
+/// together with the next input.
+size_t console_parse_input(
+    const char *input,
+    size_t length,
+    console_text_callback on_text,
+    console_key_callback on_key,
+    void *userdata
+);
 
 #endif
\ No newline at end of file
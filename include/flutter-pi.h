@@ -38,6 +38,10 @@ typedef enum {
 	kUpdateOrientation,
 	kSendPlatformMessage,
 	kRespondToPlatformMessage,
+	kFlushPointerEvents,
+	kSendKeyEvents,
+	kProcessConsoleInput,
+	kFinishStartup,
 	kFlutterTask
 } flutterpi_task_type;
 
@@ -46,6 +50,7 @@ struct flutterpi_task {
 	flutterpi_task_type type;
 	union {
 		FlutterTask task;
+		// for kFinishStartup, vblank_ns is the time the first frame was on screen.
 		struct {
 			uint64_t vblank_ns;
 			intptr_t baton;
@@ -72,6 +77,32 @@ static inline void *memdup(const void *restrict src, const size_t n) {
 	return memcpy(dest, src, n);
 }
 
+/// A growable array of flutter pointer events.
+struct pointer_event_buffer {
+	FlutterPointerEvent *events;
+	size_t n_events;
+	size_t capacity;
+};
+
+/// Appends event to buffer, growing it if necessary.
+/// Returns false if there's not enough memory (the event is dropped then).
+static inline bool pointer_event_buffer_push(struct pointer_event_buffer *buffer, const FlutterPointerEvent *event) {
+	FlutterPointerEvent *events;
+
+	if (buffer->n_events == buffer->capacity) {
+		size_t capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+
+		events = realloc(buffer->events, capacity * sizeof(FlutterPointerEvent));
+		if (events == NULL) return false;
+
+		buffer->events = events;
+		buffer->capacity = capacity;
+	}
+
+	buffer->events[buffer->n_events++] = *event;
+	return true;
+}
+
 struct drm_fb {
 	struct gbm_bo *bo;
 	uint32_t fb_id;
@@ -130,12 +161,70 @@ struct mousepointer_mtslot {
 
 #define ISSET(uint32bitmap, bit) (uint32bitmap[(bit)/32] & (1 << ((bit) & 0x1F)))
 
+/// Something the io thread waits for.
+/// The data.ptr of every file descriptor registered in the io thread's epoll instance points to one of these.
+struct io_handler {
+	void (*on_ready)(void *userdata, uint32_t events);
+	void *userdata;
+};
+
+/// The kinds of input devices, used to decide which devices to open.
+enum input_device_class {
+	kInputDeviceClassTouchscreen = 1 << 0,
+	kInputDeviceClassTouchpad = 1 << 1,
+	kInputDeviceClassMouse = 1 << 2,
+	kInputDeviceClassKeyboard = 1 << 3,
+	/// everything else, like power buttons, lid switches or HDMI-CEC, but also keypads,
+	/// IR remotes and GPIO buttons, whose keys are sent to flutter like keyboard keys.
+	kInputDeviceClassOther = 1 << 4,
+
+	kInputDeviceClassAll = (1 << 5) - 1,
+	/// filtering is opt-in, so no device that sends keys to flutter is left out by default.
+	kInputDeviceClassDefault = kInputDeviceClassAll
+};
+
+/// The capabilities of an evdev input device, as queried using the EVIOCG* ioctls
+/// (or read from an input recording).
+struct input_device_caps {
+	char name[256];
+	struct input_id input_id;
+	uint32_t absbits[(ABS_CNT+31) /32];
+	uint32_t relbits[(REL_CNT+31) /32];
+	uint32_t keybits[(KEY_CNT+31) /32];
+	uint32_t props[(INPUT_PROP_CNT+31) /32];
+
+	// only valid for the axes set in absbits
+	struct input_absinfo absinfo[ABS_CNT];
+};
+
 struct input_device {
+	// the next opened input device
+	struct input_device *next;
+
+	// io_handler.userdata is this input device
+	struct io_handler io;
+
 	char path[PATH_MAX];
 	char name[256];
 	struct input_id input_id;
 	int  fd;
 
+	// true if the kernel timestamps the events of this device with CLOCK_MONOTONIC (see EVIOCSCLOCKID)
+	bool has_monotonic_timestamps;
+
+	// the index of this device in the input recording, or -1 if its events aren't recorded
+	int recording_index;
+
+	// the next device in the list of devices that are ready to be read in this wake of the io thread
+	// (see drain_evdev_input), and whether this device is in that list.
+	struct input_device *next_ready;
+	bool is_ready;
+
+	// the number of times the kernel dropped events of this device because they weren't read
+	// fast enough (SYN_DROPPED), and whether the events up to the next SYN_REPORT are skipped because of that.
+	unsigned int n_syn_dropped;
+	bool skip_until_syn_report;
+
 	// the pointer device kind reported to the flutter engine
 	FlutterPointerDeviceKind kind;
 
@@ -146,6 +235,19 @@ struct input_device {
 	// for EV_ABS devices (touchscreens, some touchpads)
 	struct input_absinfo xinfo, yinfo;
 
+	// the calibration matrix of a touchscreen, in the format of libinput's LIBINPUT_CALIBRATION_MATRIX:
+	// the first two rows of a 3x3 matrix that maps normalized (0..1) device coordinates to normalized
+	// screen coordinates. Identity if the device has none.
+	double calibration[6];
+
+	// the factors converting ABS_X / ABS_Y values (minus the minimum) to raw pixel coordinates,
+	// and the affine transform (the first two rows of a 3x3 matrix) from raw pixel coordinates
+	// to flutter coordinates, i.e. the calibration composed with the display rotation.
+	// Precomputed for the rotation in transform_rotation (-1 if they weren't computed yet).
+	double xscale, yscale;
+	double transform[6];
+	int transform_rotation;
+
 	// n_slots is > 1 for Multi-Touch devices (most touchscreens)
 	// just because n_slots is 0 and slots is NULL, doesn't mean active_slot is NULL.
 	// mouse devices own 0 slots (since they all share a global slot), and still have an active_slot.
@@ -0,0 +1,38 @@
+#ifndef _INPUT_CACHE_H
+#define _INPUT_CACHE_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include <flutter-pi.h>
+
+/// Version of the input cache file format.
+/// Bump this whenever the format or the meaning of some value changes.
+#define INPUT_CACHE_VERSION 1
+
+/// The input cache remembers the capabilities (name, id, event bits & absinfo) of every
+/// input device flutter-pi has seen, so they don't have to be queried with a dozen ioctls
+/// on every start, and devices that flutter-pi ignores don't need to be opened at all.
+///
+/// An entry is identified by the path of the device node, its device number and a hash of
+/// the modalias of the device in sysfs. The modalias contains the ids and all event bits of the
+/// device, so if it still matches, the device can be classified without opening it.
+/// Only the absinfo & input properties aren't part of the modalias.
+
+/// Reads the input cache at path. If the file doesn't exist or is invalid,
+/// the cache starts out empty. Returns false if there's not enough memory.
+bool input_cache_load(const char *path);
+
+/// Looks up the cached capabilities of the device node at path, whose stat is st.
+/// Returns false if the device isn't cached (or the cache entry is outdated).
+bool input_cache_lookup(const char *path, const struct stat *st, struct input_device_caps *caps_out);
+
+/// Adds or updates the cache entry for the device node at path.
+void input_cache_store(const char *path, const struct stat *st, const struct input_device_caps *caps);
+
+/// Writes the cache back to disk, if it changed since it was loaded.
+bool input_cache_write(void);
+
+void input_cache_deinit(void);
+
+#endif
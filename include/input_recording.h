@@ -0,0 +1,70 @@
+#ifndef _INPUT_RECORDING_H
+#define _INPUT_RECORDING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/input.h>
+
+#include <flutter-pi.h>
+
+/// An input recording starts with INPUT_RECORDING_MAGIC, followed by records.
+/// Every record starts with a one-byte tag:
+///   kInputRecordingDevice: followed by a struct input_device_caps. The device gets the next device index.
+///   kInputRecordingEvent:  followed by a struct input_recording_event.
+/// The records are written in host byte order & layout, so recordings are only
+/// portable between machines of the same architecture.
+#define INPUT_RECORDING_MAGIC "FPINPUT1"
+
+enum input_recording_tag {
+	kInputRecordingDevice = 'D',
+	kInputRecordingEvent = 'E'
+};
+
+struct input_recording_event {
+	/// the time since the previous event of the recording (of any device), in microseconds.
+	uint32_t delta_us;
+	uint16_t device;
+	uint16_t type;
+	uint16_t code;
+	uint16_t reserved;
+	int32_t  value;
+};
+
+/// Starts recording all input events to the file at path.
+/// Should be called before any input device is opened.
+bool input_recording_start(const char *path);
+
+/// Writes the capabilities of a newly opened device to the recording.
+/// Returns the index of the device in the recording, to be passed to
+/// input_recording_write_events, or -1 if it couldn't be recorded.
+int  input_recording_add_device(const struct input_device_caps *caps);
+
+/// Writes events read from the device with the given index to the recording
+/// and flushes it, so nothing is lost if flutter-pi is killed.
+/// If use_event_time is true, the event timestamps are used to calculate the time between the
+/// events (they need to be CLOCK_MONOTONIC), else all events are recorded at read_ns.
+void input_recording_write_events(int device_index, const struct input_event *events, size_t n_events, bool use_event_time, uint64_t read_ns);
+
+void input_recording_stop(void);
+
+/// Loads the input recording at path for replaying it.
+/// speed is the factor the recorded timing is accelerated by, 0 replays without any delays.
+bool input_replay_load(const char *path, double speed);
+
+/// The number of devices in the loaded recording.
+size_t input_replay_get_n_devices(void);
+
+/// The capabilities of the device with the given index in the loaded recording.
+const struct input_device_caps *input_replay_get_device_caps(size_t index);
+
+/// The read end of the pipe the events of the device with the given index are replayed to.
+/// The events are written as struct input_event, timestamped with CLOCK_MONOTONIC, one
+/// SYN_REPORT frame at a time, just like an evdev device would deliver them.
+/// When the replay is finished, the write end is closed, so reading returns EOF.
+int  input_replay_get_device_fd(size_t index);
+
+/// Starts replaying the events on a new thread. Only the first call does anything.
+bool input_replay_start(void);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/// The stages of the input pipeline. The latency of every stage is measured
+/// from the kernel timestamp of the input event (CLOCK_MONOTONIC).
+enum latency_stage {
+	/// the event was read by the io thread
+	kLatencyStageRead,
+	/// the event was handed to the engine (or to the pointer resampler)
+	kLatencyStageHandoff,
+	/// the next frame was presented (eglSwapBuffers & pageflip queued)
+	kLatencyStagePresent,
+	/// the pageflip of that frame completed, so the frame is on screen
+	kLatencyStagePageflip,
+	kLatencyStageCount
+};
+
+/// The width of a histogram bucket.
+#define LATENCY_BUCKET_NS 500000ull
+
+/// The number of histogram buckets. Latencies above
+/// LATENCY_N_BUCKETS * LATENCY_BUCKET_NS all go into the last bucket.
+#define LATENCY_N_BUCKETS 200
+
+/// Inputs that didn't cause a frame to be presented within this time are forgotten,
+/// so they don't show up as huge latencies of the next unrelated frame.
+#define LATENCY_MAX_PENDING_NS 500000000ull
+
+/// Starts recording the input latency.
+/// Blocks SIGUSR1 for the calling thread (and all threads created by it afterwards),
+/// so it can be received using the signal fd. Call it before any other thread is created.
+bool latency_init(void);
+
+/// Records the latency of the read & handoff stages of n input frames,
+/// and remembers them until the next latency_on_present.
+/// kernel_ns are the CLOCK_MONOTONIC kernel timestamps of the input frames (their SYN_REPORTs).
+void latency_record_input(const uint64_t *kernel_ns, size_t n, uint64_t read_ns, uint64_t handoff_ns);
+
+/// Records the present stage of the inputs since the last present.
+void latency_on_present(uint64_t present_ns);
+
+/// Records the pageflip stage of the inputs of the last present.
+void latency_on_pageflip(uint64_t pageflip_ns);
+
+/// A signalfd that's readable when SIGUSR1 was received, or -1.
+/// When it's readable, call latency_on_signal_fd_ready.
+int  latency_get_signal_fd(void);
+
+/// Reads the pending signals and prints the histograms.
+void latency_on_signal_fd_ready(void);
+
+/// Draws a bar for the latency of each stage of the last input into the upper left
+/// corner of the currently bound framebuffer. All the modified GL state is restored.
+/// Must be called with the flutter GL context current, before the buffers are swapped.
+void latency_draw_overlay(void);
+
+void latency_print_histograms(FILE *stream);
+
+void latency_deinit(void);
+
+#endif
@@ -5,8 +5,6 @@
 #include <errno.h>
 #include <flutter_embedder.h>
 
-#define JSON_DECODE_TOKENLIST_SIZE  128
-
 // andrew
 // only 32bit support for now.
 //#define __ALIGN4_REMAINING(value, remaining, ...) __align(value, 4, remaining)
@@ -75,7 +73,12 @@ enum std_value_type {
     kStdInt64Array,
     kStdFloat64Array,
     kStdList,
-    kStdMap
+    kStdMap,
+
+    /// not a type of the wire format. A string that's not NULL-terminated and points into the
+    /// platform message, only produced when decoding with string views enabled.
+    /// (see platch_decode_string_views) It's encoded as a normal kStdString.
+    kStdStringView
 };
 struct std_value {
     enum std_value_type type;
@@ -92,6 +95,7 @@ struct std_value {
                 int32_t* int32array;
                 int64_t* int64array;
                 double*  float64array;
+                const char* string_view;
                 struct std_value* list;
                 struct {
                     struct std_value* keys;
@@ -125,6 +129,12 @@ struct std_value {
 #define STDVALUE_AS_STRING(value) ((value).string_value)
 #define STDSTRING(str) ((struct std_value) {.type = kStdString, .string_value = str})
 
+#define STDVALUE_IS_STRING_VIEW(value) ((value).type == kStdStringView)
+#define STDSTRINGVIEW(str, length) ((struct std_value) {.type = kStdStringView, .size = (length), .string_view = (str)})
+
+/// true if value is a string or a string view. Use stdstring_equals & stdstring_dup to access them.
+#define STDVALUE_IS_ANY_STRING(value) (STDVALUE_IS_STRING(value) || STDVALUE_IS_STRING_VIEW(value))
+
 #define STDVALUE_IS_LIST(value) ((value).type == kStdList)
 #define STDVALUE_IS_SIZE(value, _size) ((value).size == (_size))
 #define STDVALUE_IS_SIZED_LIST(value, _size) (STDVALUE_IS_LIST(value) && STDVALUE_IS_SIZE(value, _size))
@@ -231,12 +241,59 @@ typedef int (*platch_msg_resp_callback)(struct platch_obj *object, void *userdat
 /// you'd have to manually deep-copy it.
 int platch_decode(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out);
 
+/// A bump allocator for decoded platform channel objects.
+/// Everything allocated in an arena is freed at once by platch_arena_reset.
+struct platch_arena {
+    struct platch_arena_block *blocks;
+    size_t total_size;
+
+    /// how many users the thread arena currently has. (see platch_acquire_thread_arena)
+    int depth;
+};
+
+/// Like platch_decode, but allocates all the memory object_out needs inside arena.
+/// (If arena is NULL, this is exactly like platch_decode.)
+/// The object must not be freed using platch_free_obj, it's valid until the arena is reset.
+int platch_decode_arena(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena);
+
+/// Like platch_decode_arena, but standard codec strings aren't copied: they're decoded as
+/// kStdStringView values pointing into buffer. (method names & error codes / messages
+/// are still NULL-terminated copies, but they're allocated in the arena.)
+/// The arena must not be NULL. Strings only need to be copied out once a plugin asks for them,
+/// using stdstring_dup.
+int platch_decode_string_views(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena);
+
+/// Allocates size bytes of zero-initialized memory inside arena.
+void *platch_arena_alloc(struct platch_arena *arena, size_t size);
+
+/// Frees everything allocated inside arena. If the arena had to grow since the last reset,
+/// its blocks are merged into one, so the arena is one allocation big enough for the biggest message.
+/// Arenas that grew beyond 1 MiB are freed completely instead, so one huge message doesn't pin that memory.
+void platch_arena_reset(struct platch_arena *arena);
+
+void platch_arena_deinit(struct platch_arena *arena);
+
+/// Returns the arena of the calling thread, for decoding an object that's only used
+/// until platch_release_thread_arena is called. Calls can be nested (for example, a platform message
+/// callback that decodes something else); the arena is only reset by the outermost release.
+struct platch_arena *platch_acquire_thread_arena(void);
+void platch_release_thread_arena(void);
+
 /// Encodes a generic ChannelObject into a buffer (that is, too, allocated by PlatformChannel_encode)
 /// A pointer to the buffer is put into buffer_out and the size of that buffer into size_out.
 /// The lifetime of the buffer is independent of the ChannelObject, so contents of the ChannelObject
 ///   can be freed after the object was encoded.
 int platch_encode(struct platch_obj *object, uint8_t **buffer_out, size_t *size_out);
 
+/// Like platch_encode, but encodes into a buffer of the calling thread that's reused for every message,
+/// so encoding doesn't need to allocate. *buffer_out is only valid until the next message is encoded
+/// on this thread, and must not be freed. (Binary messages aren't copied, *buffer_out is just object->binarydata.)
+int platch_encode_to_thread_buffer(struct platch_obj *object, const uint8_t **buffer_out, size_t *size_out);
+
+/// Call this when the message encoded by platch_encode_to_thread_buffer isn't needed anymore.
+/// Frees the thread buffer if it grew very big, so it's not kept around forever.
+void platch_release_thread_buffer(void);
+
 /// Encodes a generic ChannelObject (anything, string/binary codec or Standard/JSON Method Calls and responses) as a platform message
 /// and sends it to flutter on channel `channel`
 /// If you supply a response callback (i.e. on_response is != NULL):
@@ -340,8 +397,15 @@ int platch_send_error_event_json(char *channel,
 /// not freeing ChannelObjects may result in a memory leak.
 int platch_free_obj(struct platch_obj *object);
 
+/// decodes the zero-terminated JSON text in string into out.
+/// The strings of out point into string (they're unescaped in place), so string
+/// must outlive out. Free out using platch_free_json_value.
+int platch_decode_json(char *string, struct json_value *out);
+
 int platch_free_json_value(struct json_value *value, bool shallow);
 
+int platch_free_value_std(struct std_value *value);
+
 /// returns true if values a and b are equal.
 /// for JS arrays, the order of the values is relevant
 /// (so two arrays are only equal if the same values appear in exactly same order)
@@ -362,8 +426,16 @@ bool stdvalue_equals(struct std_value *a, struct std_value *b);
 /// any arbitrary StdMsgCodecValue (and must not be a string as for jsobject_get)
 struct std_value *stdmap_get(struct std_value *map, struct std_value *key);
 
+/// Searches for the entry with a string key that equals key. (The key in the map can also be a string view.)
 struct std_value *stdmap_get_str(struct std_value *map, char *key);
 
+/// Returns true if value is a string or a string view that equals the NULL-terminated string str.
+bool stdstring_equals(const struct std_value *value, const char *str);
+
+/// Returns a NULL-terminated copy of the string or string view value, allocated using malloc,
+/// or NULL if value is not a string (or there's not enough memory).
+char *stdstring_dup(const struct std_value *value);
+
 static inline int _advance(uintptr_t *value, int n_bytes, size_t *remaining) {
     if (remaining != NULL) {
         if (*remaining < n_bytes) return EBADMSG;
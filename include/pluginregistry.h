@@ -9,6 +9,9 @@
 
 #define STREQ(a, b) (strcmp(a, b) == 0)
 
+/// Like STREQ, but for a std_value that's a string or a string view.
+#define STDSTREQ(value, str) (stdstring_equals(&(value), (str)))
+
 /// Callback for Initialization or Deinitialization.
 /// Return value is 0 for success, or anything else for an error
 ///   (uses the errno error codes)
@@ -49,6 +52,11 @@ int plugin_registry_on_platform_message(FlutterPlatformMessage *message);
 /// Call this method with NULL as the callback parameter to remove the current listener on that channel.
 int plugin_registry_set_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback);
 
+/// Like plugin_registry_set_receiver, but standard codec strings are passed to the callback
+/// as kStdStringView values, which point into the platform message and aren't NULL-terminated.
+/// (See platch_decode_string_views.) Use STDSTREQ, stdmap_get_str and stdstring_dup to work with them.
+int plugin_registry_set_view_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback);
+
 int plugin_registry_deinit();
 
 #endif
\ No newline at end of file
@@ -7,6 +7,13 @@
 
 int rawkb_on_keyevent(glfw_key key, uint32_t scan_code, glfw_key_action action);
 
+/// Schedules sending the key events buffered by rawkb_on_keyevent on the platform thread.
+/// Call this once after processing all the key events of a wake of the io thread.
+void rawkb_flush_keyevents(void);
+
+/// Sends the buffered key events to flutter. Must be called on the platform thread.
+void rawkb_send_pending_keyevents(void);
+
 int rawkb_init(void);
 int rawkb_deinit(void);
 
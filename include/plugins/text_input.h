@@ -5,8 +5,6 @@
 
 #define TEXT_INPUT_CHANNEL "flutter/textinput"
 
-#define TEXT_INPUT_MAX_CHARS 8192
-
 enum text_input_type {
     kInputTypeText,
     kInputTypeMultiline,
@@ -41,12 +39,15 @@ struct text_input_configuration {
 };
 
 int textin_sync_editing_state(void);
+int textin_sync_editing_state_delta(void);
+int textin_flush_editing_state(void);
 int textin_perform_action(enum text_input_action action);
 int textin_on_connection_closed(void);
 
 // TextInput model functions (updating the text editing state)
 bool textin_delete_selected(void);
 bool textin_add_utf8_char(char *c);
+bool textin_add_utf8_text(const char *text, size_t n_bytes);
 bool textin_backspace(void);
 bool textin_delete(void);
 bool textin_move_cursor_to_beginning(void);
@@ -55,8 +56,12 @@ bool textin_move_cursor_forward(void);
 bool textin_move_cursor_back(void);
 
 // parses the input string as linux terminal input and calls the TextInput model functions
-// accordingly.
+// accordingly. The changes are only sent to flutter by textin_flush_editing_state(),
+// so callers need to call that once they processed all the input they have.
+// (process_console_input does that once per batch of console input.)
+// Like the rest of the text input state, these must only be called on the platform thread.
 int textin_on_utf8_char(char *c);
+int textin_on_utf8_text(const char *text, size_t n_bytes);
 int textin_on_key(glfw_key key);
 
 int textin_init(void);
@@ -0,0 +1,34 @@
+#ifndef _POINTER_RESAMPLER_H
+#define _POINTER_RESAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <flutter_embedder.h>
+
+/// How far before the frame time the pointers are resampled.
+/// Sampling a bit in the past means most of the time we can interpolate
+/// between two real samples instead of guessing where the pointer will be.
+#define POINTER_RESAMPLE_LATENCY_NS 5000000ull
+
+/// The maximum time pointer positions are extrapolated into the future.
+#define POINTER_MAX_EXTRAPOLATION_NS 8000000ull
+
+/// Enables vsync-aligned pointer event coalescing.
+/// schedule_flush is called (from any thread) when new move / hover samples arrived and
+/// no flush is scheduled yet. It should arrange for pointer_resampler_flush to be called
+/// at the next vsync.
+void pointer_resampler_init(void (*schedule_flush)(void));
+
+/// Sends pointer events to the engine.
+/// kMove & kHover events are buffered per pointer until the next pointer_resampler_flush,
+/// all other events (down, up, cancel, add, remove) are sent immediately and drop the
+/// buffered samples of their pointer, so a resampled move is never sent after an up.
+/// The timestamps of the events (in microseconds) need to be on the same clock as FlutterEngineGetCurrentTime.
+bool pointer_resampler_send(const FlutterPointerEvent *events, size_t n_events);
+
+/// Sends one resampled event for each pointer that moved since the last flush,
+/// with the position the pointer had at (frame_time_ns - POINTER_RESAMPLE_LATENCY_NS).
+void pointer_resampler_flush(uint64_t frame_time_ns);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include <stdbool.h>
+
+/// Configures the prefetcher.
+/// If list_path is not NULL, the asset files listed in it (one path per line, relative to the
+/// asset bundle directory) are prefetched too, and all the files inside the asset bundle the
+/// engine opens until prefetch_finish_recording is called are recorded. New files are added
+/// to the list and files that don't exist anymore are removed, so the next start can prefetch them.
+/// If lock_in_memory is true, the prefetched files are mapped & locked into memory, so they
+/// can't be evicted from the page cache.
+/// Should be called before the engine is started, so no file opens are missed.
+bool prefetch_init(const char *asset_bundle_path, const char *list_path, bool lock_in_memory);
+
+/// Reads the given files (usually the Dart snapshot & ICU data) and all the listed assets
+/// into the page cache. Blocks until everything was read, so call it on a worker thread.
+/// Prefetching is only an optimization, so this never fails.
+bool prefetch_files(const char *const *paths, int n_paths);
+
+/// Stops recording the file opens and updates the list,
+/// if new files were opened or listed files don't exist anymore.
+/// Only the first call does anything.
+void prefetch_finish_recording(void);
+
+void prefetch_deinit(void);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _SHADER_CACHE_H
+#define _SHADER_CACHE_H
+
+#include <stdbool.h>
+
+/// The name of the SkSL warm-up bundle inside the asset bundle.
+/// (the file `flutter build bundle --bundle-sksl-path <captured .sksl.json>` generates)
+/// The engine loads it from the asset bundle and precompiles all the shaders
+/// inside it when the rendering surface is created.
+#define SKSL_WARMUP_BUNDLE_NAME "io.flutter.shaders.json"
+
+/// Creates the persistent shader cache directory (if it doesn't exist yet),
+/// counts the shaders that are already cached in it, checks if the asset bundle
+/// contains an SkSL warm-up bundle and starts watching the cache directory,
+/// so every shader the engine has to compile at runtime (a cache miss) can be reported.
+bool shader_cache_init(const char *cache_dir, const char *asset_bundle_path);
+
+/// The inotify file descriptor watching the cache directory, or -1 if
+/// the shader cache is not watched. When it's readable, call shader_cache_on_fd_ready.
+int  shader_cache_get_fd(void);
+
+/// Processes all pending inotify events and reports the new cache entries as misses.
+/// (Entries written by the precompile of the warm-up bundle are counted separately.)
+void shader_cache_on_fd_ready(void);
+
+/// Call this when the first frame is on screen. Cache entries written after that
+/// are never counted as written by the warm-up.
+void shader_cache_finish_warmup(void);
+
+void shader_cache_print_stats(void);
+
+void shader_cache_deinit(void);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _STARTUP_H
+#define _STARTUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+/// The dependency bit for the step at index `index` of the steps array.
+#define STARTUP_DEPENDENCY(index) (((uint32_t) 1) << (index))
+
+/// The maximum number of steps startup_run can run.
+#define STARTUP_MAX_STEPS 32
+
+/// One step of the flutter-pi startup.
+/// Steps run concurrently on their own worker threads, as soon as all the steps
+/// they depend on have finished successfully. If a step fails, all steps that
+/// (directly or indirectly) depend on it are skipped.
+struct startup_step {
+	const char *name;
+
+	/// the function doing the actual work. Returns true on success.
+	bool (*run)(void);
+
+	/// bitmask of the steps that need to finish before this step can run.
+	/// (build it using STARTUP_DEPENDENCY)
+	uint32_t dependencies;
+
+	/// run this step on the thread that called startup_run, instead of a worker thread.
+	/// Used for everything that has to happen on the platform thread, like FlutterEngineRun.
+	/// These steps run in the order they're listed in the steps array.
+	bool on_calling_thread;
+
+	// filled in by startup_run
+	pthread_t thread;
+	bool finished, failed, skipped;
+	struct timespec started_at, finished_at;
+};
+
+/// Runs all the startup steps, waits for them to finish and prints
+/// the duration of each step and the critical path of the startup.
+/// Returns true if all steps ran successfully.
+bool startup_run(struct startup_step *steps, size_t n_steps);
+
+#endif
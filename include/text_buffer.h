@@ -0,0 +1,58 @@
+#ifndef _TEXT_BUFFER_H
+#define _TEXT_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// A UTF-8 string stored as a gap buffer, indexed using UTF-16 code units
+/// (like the selection & composing indices flutter uses).
+///
+/// The gap sits where the last edit happened, so typing, backspacing and moving
+/// the cursor around only touch the text near the cursor. The UTF-16 index of the gap and
+/// of the last looked up position are cached, so converting an index near the cursor to
+/// a byte offset doesn't need to walk the text from the start.
+struct text_buffer {
+	char *data;
+	size_t capacity;
+
+	/// the text is data[0, gap_start) followed by data[gap_end, capacity).
+	size_t gap_start, gap_end;
+
+	/// the UTF-16 index of the gap, and the UTF-16 length of the whole text.
+	size_t gap_utf16;
+	size_t length_utf16;
+
+	/// the last position converted from UTF-16 to a byte offset (in the text, not in data).
+	size_t cached_utf16, cached_byte;
+};
+
+bool   text_buffer_init(struct text_buffer *buffer);
+
+void   text_buffer_deinit(struct text_buffer *buffer);
+
+/// Replaces the whole text with the NULL-terminated UTF-8 string text.
+bool   text_buffer_set(struct text_buffer *buffer, const char *text);
+
+size_t text_buffer_get_length(const struct text_buffer *buffer);
+
+/// Returns the byte offset of the UTF-16 index in the string returned by text_buffer_get_string.
+size_t text_buffer_get_byte_offset(struct text_buffer *buffer, size_t index);
+
+/// Returns the UTF-16 index of the code point after / before the one at index.
+/// (Surrogate pairs count as one code point.)
+size_t text_buffer_next_index(struct text_buffer *buffer, size_t index);
+size_t text_buffer_previous_index(struct text_buffer *buffer, size_t index);
+
+/// Inserts n_bytes of UTF-8 at the given UTF-16 index.
+/// Returns the UTF-16 index after the inserted text, or -1 if there's not enough memory.
+size_t text_buffer_insert(struct text_buffer *buffer, size_t index, const char *utf8, size_t n_bytes);
+
+/// Erases the text between the UTF-16 indices start (inclusive) and end (exclusive).
+/// Returns the index of the erased text.
+size_t text_buffer_erase(struct text_buffer *buffer, size_t start, size_t end);
+
+/// Returns the whole text as a NULL-terminated string, valid until the next change.
+/// Moves the gap to the end of the text, so this is O(n) if the gap isn't there already.
+const char *text_buffer_get_string(struct text_buffer *buffer);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/// The maximum number of phases & marks the startup timeline can record.
+/// Everything recorded after that is dropped.
+#define TIMELINE_MAX_ENTRIES 128
+
+/// Starts the startup timeline. All times in the report are relative to this call,
+/// so call it as early as possible in main.
+void timeline_init(void);
+
+/// Starts a new phase of the startup timeline. Returns the id to pass to timeline_end,
+/// or -1 if the phase wasn't recorded. (in which case timeline_end does nothing)
+/// Can be called from any thread. name is copied.
+int  timeline_begin(const char *name);
+
+/// Ends the phase with the given id.
+void timeline_end(int id);
+
+/// Records a single point in time. If time is NULL, the current time is used.
+/// time has to be a CLOCK_MONOTONIC timestamp.
+void timeline_mark(const char *name, const struct timespec *time);
+
+/// Records the first frame being on screen at time (or now, if time is NULL) and finishes the timeline.
+/// If report_path is not NULL, the timeline is written to it as JSON. ("-" for stdout)
+/// If notify_systemd is true, the systemd service manager is notified
+/// that flutter-pi is ready, using the socket in $NOTIFY_SOCKET.
+/// Only the first call does anything, all later calls return immediately.
+void timeline_finish(const struct timespec *time, const char *report_path, bool notify_systemd);
+
+#endif
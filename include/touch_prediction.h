@@ -0,0 +1,35 @@
+#ifndef _TOUCH_PREDICTION_H
+#define _TOUCH_PREDICTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <flutter_embedder.h>
+
+/// The maximum number of samples the velocity of a pointer is fitted to.
+#define TOUCH_PREDICTION_N_SAMPLES 8
+
+/// Only the samples of the last 50ms are used to fit the velocity,
+/// so the prediction quickly follows changes of direction.
+#define TOUCH_PREDICTION_WINDOW_NS 50000000ull
+
+/// Pointers are only predicted once they have this many samples in the window.
+#define TOUCH_PREDICTION_MIN_SAMPLES 3
+
+/// Predictions are never further ahead than this, even if the next frame is displayed later.
+/// (the velocity fitted over the last 50ms doesn't say much about where the pointer is after that)
+#define TOUCH_PREDICTION_MAX_HORIZON_NS 100000000ull
+
+/// Remembers the position of event, and if it's a kMove event, replaces its position with
+/// the one predicted for display_ns, the time the frame showing the event is expected to be on screen.
+/// The position of the pointer is fitted using least squares over its recent samples,
+/// and extrapolated from the last sample with the fitted velocity.
+/// The event timestamp (in microseconds) and display_ns need to be CLOCK_MONOTONIC.
+/// Every prediction is also compared to the position the pointer actually had at the predicted
+/// time, once that's known, to measure the prediction error. See touch_prediction_print_stats.
+void touch_prediction_process(FlutterPointerEvent *event, uint64_t display_ns);
+
+/// Prints the mean, RMS & maximum error of the predictions so far, and the error
+/// without prediction (how far the reported position trailed the actual one at the predicted time).
+void touch_prediction_print_stats(void);
+
+#endif
@@ -200,6 +200,8 @@ int console_make_raw(void) {
         return errno;
     }
 
+    is_raw = true;
+
     return 0;
 }
 
@@ -242,38 +244,167 @@ size_t   utf8_symbol_length(char *c) {
     return 0;
 }
 
-glfw_key console_try_get_key(char *input, char **input_out) {
-    if (input_out)
-        *input_out = input;
+/// The control sequences of glfw_key_control_sequence as a trie, so the parser can match
+/// input against all of them at once, byte by byte.
+/// Node 0 is the root. A child index of 0 means there's no such child.
+#define MAX_TRIE_NODES 128
+
+static struct {
+    bool initialized;
+    int n_nodes;
+    uint8_t children[MAX_TRIE_NODES][256];
+    glfw_key keys[MAX_TRIE_NODES];
+} control_sequence_trie;
+
+static void build_control_sequence_trie(void) {
+    const uint8_t *sequence;
+    int node;
+
+    memset(&control_sequence_trie, 0, sizeof(control_sequence_trie));
+    control_sequence_trie.n_nodes = 1;
+    control_sequence_trie.keys[0] = GLFW_KEY_UNKNOWN;
 
     for (glfw_key key = 0; key <= GLFW_KEY_LAST; key++) {
         if (glfw_key_control_sequence[key] == NULL)
             continue;
 
-        if (strcmp(input, glfw_key_control_sequence[key]) == 0) {
-            if (input_out)
-                *input_out += strlen(glfw_key_control_sequence[key]);
-            
-            return key;
+        node = 0;
+        for (sequence = (const uint8_t*) glfw_key_control_sequence[key]; *sequence; sequence++) {
+            if (control_sequence_trie.children[node][*sequence] == 0) {
+                if (control_sequence_trie.n_nodes == MAX_TRIE_NODES) {
+                    fprintf(stderr, "[console keyboard] Too many control sequences. Some keys won't be recognized.\n");
+                    control_sequence_trie.initialized = true;
+                    return;
+                }
+
+                control_sequence_trie.keys[control_sequence_trie.n_nodes] = GLFW_KEY_UNKNOWN;
+                control_sequence_trie.children[node][*sequence] = control_sequence_trie.n_nodes++;
+            }
+
+            node = control_sequence_trie.children[node][*sequence];
         }
+
+        control_sequence_trie.keys[node] = key;
     }
 
-    return GLFW_KEY_UNKNOWN;
+    control_sequence_trie.initialized = true;
 }
 
-char    *console_try_get_utf8char(char *input, char **input_out) {
-    if (input_out)
-        *input_out = input;
-    
-    size_t length = utf8_symbol_length(input);
+/// Returns the length of the UTF-8 sequence at input, 0 if it's invalid,
+/// or -1 if it's cut off by the end of the input.
+static int utf8_sequence_length(const uint8_t *input, size_t length) {
+    int n;
 
-    if ((length == 1) && !isprint(*input))
-        return NULL;
-    
-    if (length == 0)
-        return NULL;
+    if (input[0] <= 0x7F) return 1;
+    else if ((input[0] >> 5) == 0b110) n = 2;
+    else if ((input[0] >> 4) == 0b1110) n = 3;
+    else if ((input[0] >> 3) == 0b11110) n = 4;
+    else return 0;
+
+    for (int i = 1; i < n; i++) {
+        if (i >= length) return -1;
+        if ((input[i] >> 6) != 0b10) return 0;
+    }
+
+    return n;
+}
+
+/// Returns the length of the unknown escape sequence at input (which starts with ESC),
+/// or -1 if it's cut off by the end of the input.
+static int escape_sequence_length(const uint8_t *input, size_t length) {
+    size_t i;
+
+    if (length < 2) return -1;
 
-    *input_out += length;
+    if (input[1] == '[') {
+        // CSI: parameter & intermediate bytes, terminated by a final byte.
+        for (i = 2; i < length; i++) {
+            if ((input[i] >= 0x40) && (input[i] <= 0x7E)) return i + 1;
+            if ((input[i] < 0x20) || (input[i] > 0x3F)) return i;
+        }
+        return -1;
+    } else if (input[1] == 'O') {
+        // SS3: one more byte.
+        return length < 3 ? -1 : 3;
+    }
+
+    return 1;
+}
+
+size_t console_parse_input(
+    const char *input,
+    size_t length,
+    console_text_callback on_text,
+    console_key_callback on_key,
+    void *userdata
+) {
+    const uint8_t *bytes = (const uint8_t*) input;
+    size_t i = 0, j, run_start;
+    int node, matched_node, n;
+    size_t matched_length;
+
+    if (!control_sequence_trie.initialized)
+        build_control_sequence_trie();
+
+    while (i < length) {
+        if (control_sequence_trie.children[0][bytes[i]] != 0) {
+            // walk the trie as far as the input matches, remembering the longest complete sequence.
+            node = 0;
+            matched_node = 0;
+            matched_length = 0;
+            for (j = i; (j < length) && control_sequence_trie.children[node][bytes[j]]; j++) {
+                node = control_sequence_trie.children[node][bytes[j]];
+                if (control_sequence_trie.keys[node] != GLFW_KEY_UNKNOWN) {
+                    matched_node = node;
+                    matched_length = j + 1 - i;
+                }
+            }
+
+            // the input ended in the middle of a sequence, wait for the rest of it.
+            if ((j == length) && (node != matched_node))
+                return i;
+
+            if (matched_length) {
+                on_key(control_sequence_trie.keys[matched_node], userdata);
+                i += matched_length;
+                continue;
+            }
+
+            if (bytes[i] == '\e') {
+                n = escape_sequence_length(bytes + i, length - i);
+                if (n == -1) return i;
+
+                i += n;
+                continue;
+            }
+        }
+
+        // collect as much printable text as possible and hand it over in one piece.
+        run_start = i;
+        while (i < length) {
+            if (bytes[i] <= 0x7F) {
+                if (!isprint(bytes[i])) break;
+                i++;
+                continue;
+            }
+
+            n = utf8_sequence_length(bytes + i, length - i);
+            if (n <= 0) break;
+            i += n;
+        }
 
-    return input;
-}
\ No newline at end of file
+        if (i > run_start) {
+            on_text(input + run_start, i - run_start, userdata);
+            continue;
+        }
+
+        // a UTF-8 sequence that's cut off by the end of the input.
+        if ((bytes[i] > 0x7F) && (utf8_sequence_length(bytes + i, length - i) == -1))
+            return i;
+
+        // an unknown control character or an invalid byte.
+        i++;
+    }
+
+    return i;
+}
@@ -20,6 +20,15 @@
 #include <assert.h>
 #include <time.h>
 #include <glob.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sched.h>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -36,6 +45,15 @@
 #include <console_keyboard.h>
 #include <platformchannel.h>
 #include <pluginregistry.h>
+#include <shader_cache.h>
+#include <input_cache.h>
+#include <startup.h>
+#include <timeline.h>
+#include <prefetch.h>
+#include <pointer_resampler.h>
+#include <latency.h>
+#include <input_recording.h>
+#include <touch_prediction.h>
 //#include <plugins/services.h>
 #include <plugins/text_input.h>
 #include <plugins/raw_keyboard.h>
@@ -60,8 +78,112 @@ OPTIONS:\n\
                         Note that you need to properly escape each glob pattern\n\
                       you use as a parameter so it isn't implicitly expanded\n\
                       by your shell.\n\
+                        Devices matching the patterns that are plugged in\n\
+                      later are picked up too.\n\
                       \n\
-  -h                  Show this help and exit.\n\
+  --display-cache <path>  Remember the selected DRM device, connector, mode,\n\
+                      CRTC, GBM format and EGL config in the file at <path>.\n\
+                      On the next start, flutter-pi only revalidates the\n\
+                      cached configuration instead of enumerating every\n\
+                      DRM device, connector, mode and EGL config.\n\
+                      The cache is invalidated automatically when the\n\
+                      hardware setup changes.\n\
+                      \n\
+  --cache-dir <path>  Store the shaders compiled by the flutter engine in\n\
+                      the directory at <path>, so they don't have to be\n\
+                      compiled again on the next start. The directory is\n\
+                      created if it doesn't exist. If the asset bundle\n\
+                      contains an SkSL warm-up bundle (io.flutter.shaders.json)\n\
+                      its shaders are precompiled while starting up.\n\
+                      Every shader that still has to be compiled at runtime\n\
+                      is logged as a cache miss.\n\
+                      \n\
+  --timeline <path>   When the first frame is on screen, write the startup\n\
+                      timeline (the duration of every startup phase and\n\
+                      the time to the first frame) as JSON to <path>.\n\
+                      Use \"-\" to print it to stdout.\n\
+                      \n\
+  --sd-notify         Notify systemd (READY=1) when the first frame is on\n\
+                      screen. Use this with Type=notify services.\n\
+                      \n\
+  --prefetch-list <path>  Besides the Dart snapshot and the ICU data, also\n\
+                      prefetch the asset files listed in the file at <path>\n\
+                      while starting up. The asset files the engine opens\n\
+                      until the first frame is on screen are recorded, and\n\
+                      the list is updated if they changed.\n\
+                      \n\
+  --prefetch-mlock    Lock all prefetched files into memory, so they can't\n\
+                      be evicted from the page cache.\n\
+                      \n\
+  --pointer-resampling  Coalesce the pointer moves of each touch / mouse\n\
+                      pointer and send flutter a single move per frame,\n\
+                      resampled at the next vblank minus 5ms. Reduces\n\
+                      jitter when the input device reports at a different\n\
+                      rate than the display refreshes, at the cost of\n\
+                      up to one frame of extra latency.\n\
+                      \n\
+  --latency-stats     Record the latency of every touch / mouse input from\n\
+                      its kernel timestamp to when it's read, handed to\n\
+                      the engine, presented and on screen (pageflip).\n\
+                      The histograms are printed when flutter-pi receives\n\
+                      SIGUSR1 and on exit.\n\
+                      \n\
+  --latency-overlay   Like --latency-stats, but also draw the latency of\n\
+                      the last input as bars (4px per ms) in the upper left\n\
+                      corner of the screen.\n\
+                      \n\
+  --record-input <path>  Record the events of all touch / mouse input\n\
+                      devices, together with their capabilities, to the\n\
+                      file at <path>.\n\
+                      \n\
+  --replay-input <path>  Replay the input recording at <path> once the\n\
+                      first frame is on screen. The recorded devices are\n\
+                      used instead of the real ones, so no input devices\n\
+                      are needed. Useful for reproducible benchmarks.\n\
+                      \n\
+  --replay-speed <factor>  Replay the input recording <factor> times\n\
+                      faster than it was recorded. 0 replays all events\n\
+                      without any delays. (default: 1)\n\
+                      \n\
+  --touch-prediction <frames>  Predict where moving touch / mouse pointers\n\
+                      will be when the frame showing them is on screen,\n\
+                      and send flutter the predicted position instead, to\n\
+                      hide the latency of the rendering pipeline. That's\n\
+                      estimated to be <frames> frames after the next\n\
+                      vblank. 2 is a good start. The error of the\n\
+                      predictions is printed when an input device is\n\
+                      removed (for example at the end of an input replay)\n\
+                      and on exit.\n\
+                      \n\
+  --input-classes <list>  Comma-separated list of the kinds of input devices\n\
+                      to use: touchscreen, touchpad, mouse, keyboard, other\n\
+                      or all. Entries starting with + or - are added to /\n\
+                      removed from the default list instead, for example\n\
+                      \"-other\" or \"-keyboard\". Devices of other kinds\n\
+                      aren't used. (default: all. \"-other\" skips devices\n\
+                      like power buttons or HDMI-CEC, but also keypads,\n\
+                      remotes & GPIO buttons. With --input-cache, skipped\n\
+                      devices aren't even opened.)\n\
+                      \n\
+  --input-cache <path>  Remember the capabilities of every input device in\n\
+                      the file at <path>. On the next start, they don't have\n\
+                      to be queried again, and devices that aren't used\n\
+                      (see --input-classes) aren't opened. An entry is\n\
+                      invalidated when another device shows up at its path.\n\
+                      \n\
+  --calibration-matrix \"<a> <b> <c> <d> <e> <f>[@<glob>]\"  Calibrate the\n\
+                      touchscreens whose path matches <glob> (or all of\n\
+                      them) with the given matrix, like libinput's\n\
+                      LIBINPUT_CALIBRATION_MATRIX: a touch at the normalized\n\
+                      position (x, y) is moved to (a*x + b*y + c,\n\
+                      d*x + e*y + f). Without this option, the\n\
+                      LIBINPUT_CALIBRATION_MATRIX udev property of the\n\
+                      device is used, if it has one.\n\
+                      \n\
+  -v, --verbose       Print every DRM device, connector, mode and the\n\
+                      EGL / OpenGL ES information while probing the display.\n\
+                      \n\
+  -h, --help          Show this help and exit.\n\
 \n\
 EXAMPLES:\n\
   flutter-pi -i \"/dev/input/event{0,1}\" -i \"/dev/input/event{2,3}\" /home/pi/helloworld_flutterassets\n\
@@ -141,11 +263,127 @@ struct {
 	EGLSurface (*eglCreatePlatformPixmapSurfaceEXT)(EGLDisplay dpy, EGLConfig config, void *native_pixmap, const EGLint *attrib_list);
 } egl = {0};
 
+/// Version of the display cache file format.
+/// Bump this whenever the format or the meaning of some value changes.
+#define DISPLAY_CACHE_VERSION 1
+#define DISPLAY_CACHE_N_KEYS  12
+
+/// The display configuration that is persisted in the display cache.
+/// The DRM device is identified by its path and device number, the connector by its
+/// type & type id. If any of those don't match anymore, the cache is ignored.
+struct display_cache_entry {
+	char     drm_device[PATH_MAX];
+	dev_t    drm_rdev;
+	uint32_t connector_id;
+	uint32_t connector_type;
+	uint32_t connector_type_id;
+	uint16_t hdisplay, vdisplay;
+	uint32_t vrefresh, flags, clock;
+	uint32_t crtc_id;
+	size_t   crtc_index;
+	uint32_t width_mm, height_mm;
+	uint32_t gbm_format;
+	EGLint   egl_config_id;
+};
+
+struct {
+	char path[PATH_MAX];
+	bool enabled;
+} display_cache = {0};
+
+/// What to do with the startup timeline once the first frame is on screen.
+/// (set with the --timeline and --sd-notify options)
+struct {
+	char report_path[PATH_MAX];
+	bool write_report;
+	bool notify_systemd;
+} startup_timeline = {0};
+
+/// Whether the DRM, EGL & OpenGL ES enumeration should be logged in detail.
+/// (set with the -v or --verbose option)
+bool verbose = false;
+
+#define LOG_VERBOSE(...) do { if (verbose) printf(__VA_ARGS__); } while (0)
+
+/// Whether pointer moves should be coalesced & resampled once per frame.
+/// (set with the --pointer-resampling option)
+bool pointer_resampling = false;
+
+/// The time of the last vblank flutter was notified about. (in FlutterEngineGetCurrentTime() nanoseconds)
+/// Used to estimate when the next vblank will happen.
+_Atomic uint64_t last_vblank_ns = 0;
+
+/// Whether the input latency should be recorded and printed on SIGUSR1 & on exit,
+/// and whether it should be drawn on top of every frame.
+/// (set with the --latency-stats and --latency-overlay options)
+struct {
+	bool enabled;
+	bool overlay;
+} input_latency = {0};
+
+/// The file all input events are recorded to, or the recording that's replayed
+/// instead of using the real input devices.
+/// (set with the --record-input, --replay-input and --replay-speed options)
+struct {
+	char path[PATH_MAX];
+	bool record;
+	bool replay;
+	double replay_speed;
+} input_recording = {
+	.replay_speed = 1.0
+};
+
+/// The kinds of input devices that are used (a combination of enum input_device_class),
+/// and the file their capabilities are cached in.
+/// (set with the --input-classes and --input-cache options)
+unsigned int input_device_classes = kInputDeviceClassDefault;
+
+struct {
+	char path[PATH_MAX];
+	bool enabled;
+} input_device_cache = {0};
+
+/// The calibration matrices given with --calibration-matrix, each applied to the
+/// touchscreens whose path matches its pattern (or to all of them if pattern is NULL).
+struct calibration_matrix {
+	double matrix[6];
+	const char *pattern;
+};
+
+struct calibration_matrix *calibration_matrices = NULL;
+int n_calibration_matrices = 0;
+
+/// Whether the positions of moving pointers should be predicted, and how many frames
+/// after the next vblank the frame showing them is expected to be on screen.
+/// (set with the --touch-prediction option)
+bool   touch_prediction_enabled = false;
+double touch_prediction_frames = 0;
+
 struct {
 	char asset_bundle_path[240];
 	char kernel_blob_path[256];
+	char app_elf_path[256];
 	char executable_path[256];
 	char icu_data_path[256];
+
+	/// The directory the engine should store compiled shaders in.
+	/// (set with the --cache-dir option, empty if shaders shouldn't be cached)
+	char cache_dir[PATH_MAX];
+
+	/// The list of asset files to prefetch, and to record the opened asset files to.
+	/// (set with the --prefetch-list option)
+	char prefetch_list_path[PATH_MAX];
+	bool has_prefetch_list;
+
+	/// Whether the prefetched files should be locked into memory.
+	/// (set with the --prefetch-mlock option)
+	bool prefetch_mlock;
+
+	/// true if the asset bundle contains an AOT-compiled app (app.so)
+	/// and the engine is a release / profile mode engine.
+	bool is_aot;
+	void *app_elf_handle;
+
 	FlutterRendererConfig renderer_config;
 	FlutterProjectArgs args;
 	int engine_argc;
@@ -162,11 +400,18 @@ uint8_t         i_batons = 0;
 int			    scheduled_frames = 0;
 
 glob_t					   input_devices_glob;
-size_t                     n_input_devices;
 struct input_device       *input_devices;
+
+/// The glob patterns of the input devices. (given with -i, or "/dev/input/event*")
+/// Devices matching one of them that are plugged in later are picked up too.
+const char               **input_device_patterns;
+size_t                     n_input_device_patterns;
 struct mousepointer_mtslot mousepointer;
 
 pthread_t io_thread_id;
+pthread_t drm_thread_id;
+/// Written to make the DRM event thread stop. (see stop_drm_thread)
+int       drm_thread_wakeup_fd = -1;
 pthread_t platform_thread_id;
 struct flutterpi_task tasklist = {
 	.next = NULL,
@@ -180,6 +425,8 @@ pthread_cond_t  task_added = PTHREAD_COND_INITIALIZER;
 FlutterEngine engine;
 _Atomic bool  engine_running = false;
 
+void  process_console_input(void);
+
 
 /*********************
  * FLUTTER CALLBACKS *
@@ -200,8 +447,45 @@ bool     	   clear_current(void* userdata) {
 	
 	return true;
 }
+/// Finishes the startup timeline, once the first frame is on screen.
+/// Writes the report & notifies systemd, so this needs to run on the platform thread (see kFinishStartup),
+/// not on the DRM event thread.
+void		   finish_startup_timeline(const struct timespec *first_frame) {
+	timeline_finish(
+		first_frame,
+		startup_timeline.write_report ? startup_timeline.report_path : NULL,
+		startup_timeline.notify_systemd
+	);
+
+	prefetch_finish_recording();
+
+	// the engine precompiled the SkSL warm-up bundle before the first frame.
+	if (flutter.cache_dir[0] != '\0')
+		shader_cache_finish_warmup();
+
+	// replay the input only once the app is on screen, so it's not
+	// affected by how long the startup took.
+	if (input_recording.replay)
+		input_replay_start();
+}
 void		   pageflip_handler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *userdata) {
+	static bool is_first_pageflip = true;
+
 	FlutterEngineTraceEventInstant("pageflip");
+
+	// the kernel timestamps pageflips using CLOCK_MONOTONIC.
+	if (is_first_pageflip) {
+		post_platform_task(&(struct flutterpi_task) {
+			.type = kFinishStartup,
+			.target_time = 0,
+			.vblank_ns = sec*1000000000ull + usec*1000ull
+		});
+		is_first_pageflip = false;
+	}
+
+	if (input_latency.enabled)
+		latency_on_pageflip(sec*1000000000ull + usec*1000ull);
+
 	post_platform_task(&(struct flutterpi_task) {
 		.type = kVBlankReply,
 		.target_time = 0,
@@ -272,13 +556,21 @@ struct drm_fb *drm_fb_get_from_bo(struct gbm_bo *bo) {
 	return fb;
 }
 bool     	   present(void* userdata) {
+	static bool is_first_present = true;
 	fd_set fds;
 	struct gbm_bo *next_bo;
 	struct drm_fb *fb;
-	int ok;
+	int ok, timeline_id = -1;
 
 	FlutterEngineTraceEventDurationBegin("present");
 
+	if (is_first_present) {
+		timeline_id = timeline_begin("first present");
+	}
+
+	if (input_latency.overlay)
+		latency_draw_overlay();
+
 	eglSwapBuffers(egl.display, egl.surface);
 	next_bo = gbm_surface_lock_front_buffer(gbm.surface);
 	fb = drm_fb_get_from_bo(next_bo);
@@ -301,6 +593,31 @@ bool     	   present(void* userdata) {
 	gbm_surface_release_buffer(gbm.surface, drm.previous_bo);
 	drm.previous_bo = (struct gbm_bo *) next_bo;
 
+	if (input_latency.enabled) {
+		uint64_t present_ns = FlutterEngineGetCurrentTime();
+
+		latency_on_present(present_ns);
+
+		// without vsync, the frame is on screen as soon as the CRTC is set.
+		if (drm.disable_vsync)
+			latency_on_pageflip(present_ns);
+	}
+
+	if (is_first_present) {
+		timeline_end(timeline_id);
+
+		// without vsync, there are no pageflip events. The frame is on screen now.
+		if (drm.disable_vsync) {
+			post_platform_task(&(struct flutterpi_task) {
+				.type = kFinishStartup,
+				.target_time = 0,
+				.vblank_ns = FlutterEngineGetCurrentTime()
+			});
+		}
+
+		is_first_present = false;
+	}
+
 	FlutterEngineTraceEventDurationEnd("present");
 	
 	return true;
@@ -484,6 +801,33 @@ FlutterTransformation transformation_callback(void *userdata) {
 /************************
  * PLATFORM TASK-RUNNER *
  ************************/
+uint64_t get_frame_period_ns(void) {
+	return 1000000000ull / (refresh_rate ? refresh_rate : 60);
+}
+/// Estimates the time of the first vblank after time_ns (both in FlutterEngineGetCurrentTime() nanoseconds),
+/// using the last vblank flutter was notified about and the refresh rate.
+uint64_t estimate_next_vblank_ns(uint64_t time_ns) {
+	uint64_t period, vblank;
+
+	period = get_frame_period_ns();
+
+	vblank = last_vblank_ns;
+	if (vblank == 0) {
+		vblank = time_ns + period;
+	} else if (vblank <= time_ns) {
+		vblank += ((time_ns - vblank) / period + 1) * period;
+	}
+
+	return vblank;
+}
+/// Called by the pointer resampler when pointer moves arrived.
+/// Flushes them at the next (estimated) vblank, so flutter gets one resampled event per pointer and frame.
+void  schedule_pointer_flush(void) {
+	post_platform_task(&(struct flutterpi_task) {
+		.type = kFlushPointerEvents,
+		.target_time = estimate_next_vblank_ns(FlutterEngineGetCurrentTime())
+	});
+}
 bool  init_message_loop() {
 	platform_thread_id = pthread_self();
 	return true;
@@ -539,9 +883,29 @@ bool  message_loop(void) {
 			}
 
 			if (has_baton) {
+				static bool is_first_vsync = true;
+
+				last_vblank_ns = ns;
+
+				if (is_first_vsync) {
+					timeline_mark("first vsync", NULL);
+					is_first_vsync = false;
+				}
+
 				FlutterEngineOnVsync(engine, baton, ns, ns + (1000000000ull / refresh_rate));
 			}
 		
+		} else if (task->type == kFlushPointerEvents) {
+			pointer_resampler_flush(task->target_time);
+		} else if (task->type == kSendKeyEvents) {
+			rawkb_send_pending_keyevents();
+		} else if (task->type == kProcessConsoleInput) {
+			process_console_input();
+		} else if (task->type == kFinishStartup) {
+			finish_startup_timeline(&(struct timespec) {
+				.tv_sec = task->vblank_ns / 1000000000ull,
+				.tv_nsec = task->vblank_ns % 1000000000ull
+			});
 		} else if (task->type == kUpdateOrientation) {
 			rotation += ANGLE_FROM_ORIENTATION(task->orientation) - ANGLE_FROM_ORIENTATION(orientation);
 			if (rotation < 0) rotation += 360;
@@ -710,6 +1074,7 @@ int   flutterpi_respond_to_platform_message(FlutterPlatformMessageResponseHandle
  ******************/
 bool setup_paths(void) {
 	#define PATH_EXISTS(path) (access((path),R_OK)==0)
+	bool has_kernel_blob, has_app_elf;
 
 	if (!PATH_EXISTS(flutter.asset_bundle_path)) {
 		fprintf(stderr, "Asset Bundle Directory \"%s\" does not exist\n", flutter.asset_bundle_path);
@@ -717,11 +1082,35 @@ bool setup_paths(void) {
 	}
 	
 	snprintf(flutter.kernel_blob_path, sizeof(flutter.kernel_blob_path), "%s/kernel_blob.bin", flutter.asset_bundle_path);
-	if (!PATH_EXISTS(flutter.kernel_blob_path)) {
-		fprintf(stderr, "Kernel blob does not exist inside Asset Bundle Directory.\n");
-		return false;
+	snprintf(flutter.app_elf_path, sizeof(flutter.app_elf_path), "%s/app.so", flutter.asset_bundle_path);
+
+	has_kernel_blob = PATH_EXISTS(flutter.kernel_blob_path);
+	has_app_elf = PATH_EXISTS(flutter.app_elf_path);
+
+	// debug engines can only run kernel snapshots (JIT), release & profile engines
+	// can only run AOT snapshots. If the asset bundle contains both, the engine decides.
+	if (FlutterEngineRunsAOTCompiledDartCode()) {
+		if (!has_app_elf) {
+			fprintf(stderr, "The flutter engine runs in release / profile mode, but there's no AOT snapshot (app.so) inside the Asset Bundle Directory.\n");
+			if (has_kernel_blob)
+				fprintf(stderr, "The Asset Bundle Directory only contains a kernel snapshot (kernel_blob.bin), which needs a debug mode engine.\n");
+			return false;
+		}
+
+		flutter.is_aot = true;
+	} else {
+		if (!has_kernel_blob) {
+			fprintf(stderr, "Kernel blob does not exist inside Asset Bundle Directory.\n");
+			if (has_app_elf)
+				fprintf(stderr, "The Asset Bundle Directory only contains an AOT snapshot (app.so), which needs a release or profile mode engine.\n");
+			return false;
+		}
+
+		flutter.is_aot = false;
 	}
 
+	printf("Running the app in %s mode.\n", flutter.is_aot ? "AOT (app.so)" : "JIT (kernel_blob.bin)");
+
 	snprintf(flutter.icu_data_path, sizeof(flutter.icu_data_path), "/usr/lib/icudtl.dat");
 
 	if (!PATH_EXISTS(flutter.icu_data_path)) {
@@ -736,15 +1125,250 @@ bool setup_paths(void) {
 	#undef PATH_EXISTS
 }
 
-bool init_display(void) {
-	/**********************
-	 * DRM INITIALIZATION *
-	 **********************/
+/// Loads the AOT-compiled app ELF (app.so) and resolves the VM & isolate snapshot symbols.
+/// The snapshots are used directly from the mapped ELF, so the handle must stay open
+/// as long as the engine is running.
+bool load_aot_snapshots(void) {
+	const uint8_t *vm_snapshot_data, *vm_snapshot_instructions;
+	const uint8_t *isolate_snapshot_data, *isolate_snapshot_instructions;
+
+	flutter.app_elf_handle = dlopen(flutter.app_elf_path, RTLD_NOW | RTLD_LOCAL);
+	if (flutter.app_elf_handle == NULL) {
+		fprintf(stderr, "Could not load AOT snapshot \"%s\": %s\n", flutter.app_elf_path, dlerror());
+		return false;
+	}
+
+	vm_snapshot_data = dlsym(flutter.app_elf_handle, "kDartVmSnapshotData");
+	vm_snapshot_instructions = dlsym(flutter.app_elf_handle, "kDartVmSnapshotInstructions");
+	isolate_snapshot_data = dlsym(flutter.app_elf_handle, "kDartIsolateSnapshotData");
+	isolate_snapshot_instructions = dlsym(flutter.app_elf_handle, "kDartIsolateSnapshotInstructions");
+
+	if (!vm_snapshot_data || !vm_snapshot_instructions || !isolate_snapshot_data || !isolate_snapshot_instructions) {
+		fprintf(stderr, "\"%s\" doesn't look like an AOT snapshot. Could not resolve the VM / isolate snapshot symbols.\n", flutter.app_elf_path);
+		dlclose(flutter.app_elf_handle);
+		flutter.app_elf_handle = NULL;
+		return false;
+	}
+
+	// the engine doesn't need the sizes of the snapshots, the symbols only mark their beginnings.
+	flutter.args.vm_snapshot_data = vm_snapshot_data;
+	flutter.args.vm_snapshot_data_size = 0;
+	flutter.args.vm_snapshot_instructions = vm_snapshot_instructions;
+	flutter.args.vm_snapshot_instructions_size = 0;
+	flutter.args.isolate_snapshot_data = isolate_snapshot_data;
+	flutter.args.isolate_snapshot_data_size = 0;
+	flutter.args.isolate_snapshot_instructions = isolate_snapshot_instructions;
+	flutter.args.isolate_snapshot_instructions_size = 0;
+
+	return true;
+}
+
+bool read_display_cache(struct display_cache_entry *entry) {
+	unsigned int version = 0, n_keys = 0;
+	char line[PATH_MAX + 64];
+	char *value;
+	FILE *file;
+
+	file = fopen(display_cache.path, "r");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			fprintf(stderr, "Could not open display cache \"%s\": %s\n", display_cache.path, strerror(errno));
+		return false;
+	}
+
+	memset(entry, 0, sizeof(*entry));
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if ((line[0] == '#') || ((value = strchr(line, '=')) == NULL))
+			continue;
+
+		*value++ = '\0';
+		value[strcspn(value, "\n")] = '\0';
+
+		n_keys++;
+		if (strcmp(line, "version") == 0) {
+			version = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "drm_device") == 0) {
+			snprintf(entry->drm_device, sizeof(entry->drm_device), "%s", value);
+		} else if (strcmp(line, "drm_rdev") == 0) {
+			entry->drm_rdev = strtoull(value, NULL, 10);
+		} else if (strcmp(line, "connector_id") == 0) {
+			entry->connector_id = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "connector_type") == 0) {
+			entry->connector_type = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "connector_type_id") == 0) {
+			entry->connector_type_id = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "mode") == 0) {
+			if (sscanf(value, "%hu %hu %u %u %u", &entry->hdisplay, &entry->vdisplay,
+					   &entry->vrefresh, &entry->flags, &entry->clock) != 5)
+				n_keys--;
+		} else if (strcmp(line, "crtc_id") == 0) {
+			entry->crtc_id = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "crtc_index") == 0) {
+			entry->crtc_index = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "physical_size") == 0) {
+			if (sscanf(value, "%u %u", &entry->width_mm, &entry->height_mm) != 2)
+				n_keys--;
+		} else if (strcmp(line, "gbm_format") == 0) {
+			entry->gbm_format = strtoul(value, NULL, 10);
+		} else if (strcmp(line, "egl_config_id") == 0) {
+			entry->egl_config_id = strtol(value, NULL, 10);
+		} else {
+			n_keys--;
+		}
+	}
+
+	fclose(file);
+
+	if ((version != DISPLAY_CACHE_VERSION) || (n_keys != DISPLAY_CACHE_N_KEYS)) {
+		fprintf(stderr, "Ignoring invalid or outdated display cache \"%s\".\n", display_cache.path);
+		return false;
+	}
+
+	return true;
+}
+bool write_display_cache(const struct display_cache_entry *entry) {
+	char tmp_path[PATH_MAX + 8];
+	FILE *file;
+	int ok;
+
+	// write to a temporary file first and then rename it, so a power loss
+	// while writing never leaves a half-written cache behind.
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", display_cache.path);
 
+	file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Could not create display cache \"%s\": %s\n", tmp_path, strerror(errno));
+		return false;
+	}
+
+	fprintf(file,
+		"# flutter-pi display cache. Delete this file to force a full display probe.\n"
+		"version=%u\n"
+		"drm_device=%s\n"
+		"drm_rdev=%llu\n"
+		"connector_id=%u\n"
+		"connector_type=%u\n"
+		"connector_type_id=%u\n"
+		"mode=%hu %hu %u %u %u\n"
+		"crtc_id=%u\n"
+		"crtc_index=%zu\n"
+		"physical_size=%u %u\n"
+		"gbm_format=%u\n"
+		"egl_config_id=%d\n",
+		DISPLAY_CACHE_VERSION,
+		entry->drm_device,
+		(unsigned long long) entry->drm_rdev,
+		entry->connector_id,
+		entry->connector_type,
+		entry->connector_type_id,
+		entry->hdisplay, entry->vdisplay, entry->vrefresh, entry->flags, entry->clock,
+		entry->crtc_id,
+		entry->crtc_index,
+		entry->width_mm, entry->height_mm,
+		entry->gbm_format,
+		entry->egl_config_id
+	);
+
+	ok = ferror(file);
+	if (fclose(file) != 0) ok = 1;
+
+	if (ok || (rename(tmp_path, display_cache.path) != 0)) {
+		fprintf(stderr, "Could not write display cache \"%s\": %s\n", display_cache.path, strerror(errno));
+		unlink(tmp_path);
+		return false;
+	}
+
+	return true;
+}
+bool restore_drm_from_display_cache(const struct display_cache_entry *entry, drmModeConnector **connector_out) {
+	drmModeConnector *connector;
+	drmModeEncoder *encoder;
+	drmModeModeInfo *mode;
+	struct stat statbuf;
+	uint32_t crtc_id;
+	int fd, i;
+
+	fd = open(entry->drm_device, O_RDWR);
+	if (fd < 0) return false;
+
+	// the device node could've been re-assigned to some other device.
+	if ((fstat(fd, &statbuf) != 0) || (statbuf.st_rdev != entry->drm_rdev)) {
+		close(fd);
+		return false;
+	}
+
+	// drmModeGetConnectorCurrent doesn't make the kernel re-probe the connector
+	// (which can take hundreds of milliseconds for HDMI), it just reports
+	// the connector state the kernel already knows about.
+	connector = drmModeGetConnectorCurrent(fd, entry->connector_id);
+	if (connector == NULL) {
+		close(fd);
+		return false;
+	}
+
+	if ((connector->connection != DRM_MODE_CONNECTED) ||
+		(connector->connector_type != entry->connector_type) ||
+		(connector->connector_type_id != entry->connector_type_id)) {
+		goto fail_free_connector;
+	}
+
+	for (i = 0, mode = NULL; i < connector->count_modes; i++) {
+		drmModeModeInfo *current_mode = &connector->modes[i];
+
+		if ((current_mode->hdisplay == entry->hdisplay) &&
+			(current_mode->vdisplay == entry->vdisplay) &&
+			(current_mode->vrefresh == entry->vrefresh) &&
+			(current_mode->flags == entry->flags) &&
+			(current_mode->clock == entry->clock)) {
+			mode = current_mode;
+			break;
+		}
+	}
+
+	if (mode == NULL) goto fail_free_connector;
+
+	encoder = drmModeGetEncoder(fd, connector->encoder_id);
+	if (encoder == NULL) goto fail_free_connector;
+
+	crtc_id = encoder->crtc_id;
+	drmModeFreeEncoder(encoder);
+
+	if (crtc_id != entry->crtc_id) goto fail_free_connector;
+
+	// the cached configuration is still valid.
+	snprintf(drm.device, sizeof(drm.device), "%s", entry->drm_device);
+	drm.has_device = true;
+	drm.fd = fd;
+	drm.connector_id = connector->connector_id;
+	drm.mode = mode;
+	drm.crtc_id = crtc_id;
+	drm.crtc_index = entry->crtc_index;
+
+	width = mode->hdisplay;
+	height = mode->vdisplay;
+	refresh_rate = mode->vrefresh;
+	orientation = width >= height ? kLandscapeLeft : kPortraitUp;
+
+	if ((width_mm == 0) && (height_mm == 0)) {
+		width_mm = entry->width_mm;
+		height_mm = entry->height_mm;
+	}
+
+	*connector_out = connector;
+	return true;
+
+
+	fail_free_connector:
+	drmModeFreeConnector(connector);
+	close(fd);
+	return false;
+}
+bool probe_drm(drmModeConnector **connector_out) {
 	drmModeRes *resources = NULL;
 	drmModeConnector *connector;
 	drmModeEncoder *encoder = NULL;
-	int i, ok, area;
+	int i, area;
 	
 	if (!drm.has_device) {
 		printf("Finding a suitable DRM device, since none is given...\n");
@@ -757,55 +1381,57 @@ bool init_display(void) {
 			return false;
 		}
 		
-		printf("looking for a suitable DRM device from %d available DRM devices...\n", num_devices);
+		LOG_VERBOSE("looking for a suitable DRM device from %d available DRM devices...\n", num_devices);
 		for (i = 0; i < num_devices; i++) {
 			drmDevicePtr device = devices[i];
 
-			printf("  devices[%d]: \n", i);
-
-			printf("    available nodes: ");
-			if (device->available_nodes & (1 << DRM_NODE_PRIMARY)) printf("DRM_NODE_PRIMARY, ");
-			if (device->available_nodes & (1 << DRM_NODE_CONTROL)) printf("DRM_NODE_CONTROL, ");
-			if (device->available_nodes & (1 << DRM_NODE_RENDER))  printf("DRM_NODE_RENDER");
-			printf("\n");
-
-			for (int j=0; j < DRM_NODE_MAX; j++) {
-				if (device->available_nodes & (1 << j)) {
-					printf("    nodes[%s] = \"%s\"\n",
-						j == DRM_NODE_PRIMARY ? "DRM_NODE_PRIMARY" :
-						j == DRM_NODE_CONTROL ? "DRM_NODE_CONTROL" :
-						j == DRM_NODE_RENDER  ? "DRM_NODE_RENDER" : "unknown",
-						device->nodes[j]
-					);
+			if (verbose) {
+				printf("  devices[%d]: \n", i);
+
+				printf("    available nodes: ");
+				if (device->available_nodes & (1 << DRM_NODE_PRIMARY)) printf("DRM_NODE_PRIMARY, ");
+				if (device->available_nodes & (1 << DRM_NODE_CONTROL)) printf("DRM_NODE_CONTROL, ");
+				if (device->available_nodes & (1 << DRM_NODE_RENDER))  printf("DRM_NODE_RENDER");
+				printf("\n");
+
+				for (int j=0; j < DRM_NODE_MAX; j++) {
+					if (device->available_nodes & (1 << j)) {
+						printf("    nodes[%s] = \"%s\"\n",
+							j == DRM_NODE_PRIMARY ? "DRM_NODE_PRIMARY" :
+							j == DRM_NODE_CONTROL ? "DRM_NODE_CONTROL" :
+							j == DRM_NODE_RENDER  ? "DRM_NODE_RENDER" : "unknown",
+							device->nodes[j]
+						);
+					}
 				}
-			}
 
-			printf("    bustype: %s\n",
-						device->bustype == DRM_BUS_PCI ? "DRM_BUS_PCI" :
-						device->bustype == DRM_BUS_USB ? "DRM_BUS_USB" :
-						device->bustype == DRM_BUS_PLATFORM ? "DRM_BUS_PLATFORM" :
-						device->bustype == DRM_BUS_HOST1X ? "DRM_BUS_HOST1X" :
-						"unknown"
-				);
+				printf("    bustype: %s\n",
+							device->bustype == DRM_BUS_PCI ? "DRM_BUS_PCI" :
+							device->bustype == DRM_BUS_USB ? "DRM_BUS_USB" :
+							device->bustype == DRM_BUS_PLATFORM ? "DRM_BUS_PLATFORM" :
+							device->bustype == DRM_BUS_HOST1X ? "DRM_BUS_HOST1X" :
+							"unknown"
+					);
 
-			if (device->bustype == DRM_BUS_PLATFORM) {
-				printf("    businfo.fullname: %s\n", device->businfo.platform->fullname);
-				// seems like deviceinfo.platform->compatible is not really used.
-				//printf("    deviceinfo.compatible: %s\n", device->deviceinfo.platform->compatible);
+				if (device->bustype == DRM_BUS_PLATFORM) {
+					printf("    businfo.fullname: %s\n", device->businfo.platform->fullname);
+					// seems like deviceinfo.platform->compatible is not really used.
+					//printf("    deviceinfo.compatible: %s\n", device->deviceinfo.platform->compatible);
+				}
 			}
 
 			// we want a device that's DRM_NODE_PRIMARY and that we can call a drmModeGetResources on.
 			if (drm.has_device) continue;
 			if (!(device->available_nodes & (1 << DRM_NODE_PRIMARY))) continue;
 			
-			printf("    opening DRM device candidate at \"%s\"...\n", device->nodes[DRM_NODE_PRIMARY]);
+			LOG_VERBOSE("    opening DRM device candidate at \"%s\"...\n", device->nodes[DRM_NODE_PRIMARY]);
 			fd = open(device->nodes[DRM_NODE_PRIMARY], O_RDWR);
 			if (fd < 0) {
 				printf("      could not open DRM device candidate at \"%s\": %s\n", device->nodes[DRM_NODE_PRIMARY], strerror(errno));
 				continue;
 			}
 
-			printf("    getting resources of DRM device candidate at \"%s\"...\n", device->nodes[DRM_NODE_PRIMARY]);
+			LOG_VERBOSE("    getting resources of DRM device candidate at \"%s\"...\n", device->nodes[DRM_NODE_PRIMARY]);
 			resources = drmModeGetResources(fd);
 			if (resources == NULL) {
 				printf("      could not query DRM resources for DRM device candidate at \"%s\":", device->nodes[DRM_NODE_PRIMARY]);
@@ -816,12 +1442,14 @@ bool init_display(void) {
 			}
 
 			// we found our DRM device.
-			printf("    flutter-pi chose \"%s\" as its DRM device.\n", device->nodes[DRM_NODE_PRIMARY]);
+			printf("flutter-pi chose \"%s\" as its DRM device.\n", device->nodes[DRM_NODE_PRIMARY]);
 			drm.fd = fd;
 			drm.has_device = true;
 			snprintf(drm.device, sizeof(drm.device)-1, "%s", device->nodes[DRM_NODE_PRIMARY]);
 		}
 
+		drmFreeDevices(devices, num_devices);
+
 		if (!drm.has_device) {
 			fprintf(stderr, "flutter-pi couldn't find a usable DRM device.\n"
 							"Please make sure you've enabled the Fake-KMS driver in raspi-config.\n"
@@ -840,7 +1468,7 @@ bool init_display(void) {
 	}
 
 	if (!resources) {
-		printf("Getting DRM resources...\n");
+		LOG_VERBOSE("Getting DRM resources...\n");
 		resources = drmModeGetResources(drm.fd);
 		if (resources == NULL) {
 			if ((errno == EOPNOTSUPP) || (errno = EINVAL))
@@ -853,12 +1481,12 @@ bool init_display(void) {
 	}
 
 
-	printf("Finding a connected connector from %d available connectors...\n", resources->count_connectors);
+	LOG_VERBOSE("Finding a connected connector from %d available connectors...\n", resources->count_connectors);
 	connector = NULL;
 	for (i = 0; i < resources->count_connectors; i++) {
 		drmModeConnector *conn = drmModeGetConnector(drm.fd, resources->connectors[i]);
 		
-		printf("  connectors[%d]: connected? %s, type: 0x%02X%s, %umm x %umm\n",
+		LOG_VERBOSE("  connectors[%d]: connected? %s, type: 0x%02X%s, %umm x %umm\n",
 			   i,
 			   (conn->connection == DRM_MODE_CONNECTED) ? "yes" :
 			   (conn->connection == DRM_MODE_DISCONNECTED) ? "no" : "unknown",
@@ -899,12 +1527,12 @@ bool init_display(void) {
 		return false;
 	}
 
-	printf("Choosing DRM mode from %d available modes...\n", connector->count_modes);
+	LOG_VERBOSE("Choosing DRM mode from %d available modes...\n", connector->count_modes);
 	bool found_preferred = false;
 	for (i = 0, area = 0; i < connector->count_modes; i++) {
 		drmModeModeInfo *current_mode = &connector->modes[i];
 
-		printf("  modes[%d]: name: \"%s\", %ux%u%s, %uHz, type: %u, flags: %u\n",
+		LOG_VERBOSE("  modes[%d]: name: \"%s\", %ux%u%s, %uHz, type: %u, flags: %u\n",
 			   i, current_mode->name, current_mode->hdisplay, current_mode->vdisplay,
 			   (current_mode->flags & DRM_MODE_FLAG_INTERLACE) ? "i" : "p",
 			   current_mode->vrefresh, current_mode->type, current_mode->flags
@@ -928,7 +1556,7 @@ bool init_display(void) {
 
 			// if the preferred DRM mode is bogus, we're screwed.
 			if (current_mode->type & DRM_MODE_TYPE_PREFERRED) {
-				printf("    this mode is preferred by DRM. (DRM_MODE_TYPE_PREFERRED)\n");
+				LOG_VERBOSE("    this mode is preferred by DRM. (DRM_MODE_TYPE_PREFERRED)\n");
 				found_preferred = true;
 			}
 		}
@@ -938,20 +1566,8 @@ bool init_display(void) {
 		fprintf(stderr, "could not find a suitable DRM mode!\n");
 		return false;
 	}
-	
-	// calculate the pixel ratio
-	if (pixel_ratio == 0.0) {
-		if ((width_mm == 0) || (height_mm == 0)) {
-			pixel_ratio = 1.0;
-		} else {
-			pixel_ratio = (10.0 * width) / (width_mm * 38.0);
-			if (pixel_ratio < 1.0) pixel_ratio = 1.0;
-		}
-	}
-
-	printf("Display properties:\n  %u x %u, %uHz\n  %umm x %umm\n  pixel_ratio = %f\n", width, height, refresh_rate, width_mm, height_mm, pixel_ratio);
 
-	printf("Finding DRM encoder...\n");
+	LOG_VERBOSE("Finding DRM encoder...\n");
 	for (i = 0; i < resources->count_encoders; i++) {
 		encoder = drmModeGetEncoder(drm.fd, resources->encoders[i]);
 		if (encoder->encoder_id == connector->encoder_id)
@@ -962,6 +1578,7 @@ bool init_display(void) {
 	
 	if (encoder) {
 		drm.crtc_id = encoder->crtc_id;
+		drmModeFreeEncoder(encoder);
 	} else {
 		fprintf(stderr, "could not find a suitable crtc!\n");
 		return false;
@@ -978,11 +1595,56 @@ bool init_display(void) {
 
 	drm.connector_id = connector->connector_id;
 
+	*connector_out = connector;
+	return true;
+}
+
+bool init_display(void) {
+	struct display_cache_entry cache_entry;
+	drmModeConnector *connector;
+	bool restored_from_cache = false;
+	int ok, timeline_id;
+
+	/**********************
+	 * DRM INITIALIZATION *
+	 **********************/
+	timeline_id = timeline_begin("DRM probe");
+
+	if (display_cache.enabled && read_display_cache(&cache_entry)) {
+		restored_from_cache = restore_drm_from_display_cache(&cache_entry, &connector);
+		if (restored_from_cache) {
+			printf("Restored DRM configuration from display cache \"%s\".\n", display_cache.path);
+		} else {
+			printf("Display cache \"%s\" doesn't match the current hardware anymore. Probing the display...\n", display_cache.path);
+		}
+	}
+
+	if (!restored_from_cache) {
+		if (!probe_drm(&connector)) {
+			return false;
+		}
+	}
+	
+	// calculate the pixel ratio
+	if (pixel_ratio == 0.0) {
+		if ((width_mm == 0) || (height_mm == 0)) {
+			pixel_ratio = 1.0;
+		} else {
+			pixel_ratio = (10.0 * width) / (width_mm * 38.0);
+			if (pixel_ratio < 1.0) pixel_ratio = 1.0;
+		}
+	}
+
+	printf("Display properties:\n  %u x %u, %uHz\n  %umm x %umm\n  pixel_ratio = %f\n", width, height, refresh_rate, width_mm, height_mm, pixel_ratio);
+
+	timeline_end(timeline_id);
 
 
 	/**********************
 	 * GBM INITIALIZATION *
 	 **********************/
+	timeline_id = timeline_begin("GBM init");
+
 	printf("Creating GBM device\n");
 	gbm.device = gbm_create_device(drm.fd);
 	gbm.format = DRM_FORMAT_XRGB8888;
@@ -1004,11 +1666,15 @@ bool init_display(void) {
 		return false;
 	}
 
+	timeline_end(timeline_id);
+
 	/**********************
 	 * EGL INITIALIZATION *
 	 **********************/
 	EGLint major, minor;
 
+	timeline_id = timeline_begin("EGL init");
+
 	static const EGLint context_attribs[] = {
 		EGL_CONTEXT_CLIENT_VERSION, 2,
 		EGL_NONE
@@ -1027,7 +1693,7 @@ bool init_display(void) {
 
 	const char *egl_exts_client, *egl_exts_dpy, *gl_exts;
 
-	printf("Querying EGL client extensions...\n");
+	LOG_VERBOSE("Querying EGL client extensions...\n");
 	egl_exts_client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
 
 	egl.eglGetPlatformDisplayEXT = (void*) eglGetProcAddress("eglGetPlatformDisplayEXT");
@@ -1047,19 +1713,21 @@ bool init_display(void) {
 		return false;
 	}
 
-	printf("Querying EGL display extensions...\n");
+	LOG_VERBOSE("Querying EGL display extensions...\n");
 	egl_exts_dpy = eglQueryString(egl.display, EGL_EXTENSIONS);
 	egl.modifiers_supported = strstr(egl_exts_dpy, "EGL_EXT_image_dma_buf_import_modifiers") != NULL;
 
 
 	printf("Using display %p with EGL version %d.%d\n", egl.display, major, minor);
-	printf("===================================\n");
-	printf("EGL information:\n");
-	printf("  version: %s\n", eglQueryString(egl.display, EGL_VERSION));
-	printf("  vendor: \"%s\"\n", eglQueryString(egl.display, EGL_VENDOR));
-	printf("  client extensions: \"%s\"\n", egl_exts_client);
-	printf("  display extensions: \"%s\"\n", egl_exts_dpy);
-	printf("===================================\n");
+	if (verbose) {
+		printf("===================================\n");
+		printf("EGL information:\n");
+		printf("  version: %s\n", eglQueryString(egl.display, EGL_VERSION));
+		printf("  vendor: \"%s\"\n", eglQueryString(egl.display, EGL_VENDOR));
+		printf("  client extensions: \"%s\"\n", egl_exts_client);
+		printf("  display extensions: \"%s\"\n", egl_exts_dpy);
+		printf("===================================\n");
+	}
 
 
 	printf("Binding OpenGL ES API...\n");
@@ -1073,37 +1741,58 @@ bool init_display(void) {
 	EGLint count = 0, matched = 0;
 	EGLConfig *configs;
 	bool _found_matching_config = false;
-	
-	if (!eglGetConfigs(egl.display, NULL, 0, &count) || count < 1) {
-		fprintf(stderr, "No EGL configs to choose from.\n");
-		return false;
-	}
 
-	configs = malloc(count * sizeof(EGLConfig));
-	if (!configs) return false;
+	// if the display configuration was restored from the cache, try the cached
+	// EGL config first. (EGL ignores all other attributes when EGL_CONFIG_ID is given)
+	if (restored_from_cache && (cache_entry.gbm_format == gbm.format)) {
+		const EGLint cached_config_attribs[] = {
+			EGL_CONFIG_ID, cache_entry.egl_config_id,
+			EGL_NONE
+		};
+		EGLint id;
 
-	printf("Finding EGL configs with appropriate attributes...\n");
-	if (!eglChooseConfig(egl.display, config_attribs, configs, count, &matched) || !matched) {
-		fprintf(stderr, "No EGL configs with appropriate attributes.\n");
-		free(configs);
-		return false;
+		if (eglChooseConfig(egl.display, cached_config_attribs, &egl.config, 1, &matched) && (matched == 1) &&
+			eglGetConfigAttrib(egl.display, egl.config, EGL_NATIVE_VISUAL_ID, &id) && (id == gbm.format)) {
+			_found_matching_config = true;
+		}
 	}
+	
+	if (!_found_matching_config) {
+		if (!eglGetConfigs(egl.display, NULL, 0, &count) || count < 1) {
+			fprintf(stderr, "No EGL configs to choose from.\n");
+			return false;
+		}
 
-	if (!gbm.format) {
-		_found_matching_config = true;
-	} else {
-		for (int i = 0; i < count; i++) {
-			EGLint id;
-			if (!eglGetConfigAttrib(egl.display, configs[i], EGL_NATIVE_VISUAL_ID, &id))	continue;
+		configs = malloc(count * sizeof(EGLConfig));
+		if (!configs) return false;
 
-			if (id == gbm.format) {
-				egl.config = configs[i];
-				_found_matching_config = true;
-				break;
+		LOG_VERBOSE("Finding EGL configs with appropriate attributes...\n");
+		if (!eglChooseConfig(egl.display, config_attribs, configs, count, &matched) || !matched) {
+			fprintf(stderr, "No EGL configs with appropriate attributes.\n");
+			free(configs);
+			return false;
+		}
+
+		if (!gbm.format) {
+			egl.config = configs[0];
+			_found_matching_config = true;
+		} else {
+			for (int i = 0; i < matched; i++) {
+				EGLint id;
+				if (!eglGetConfigAttrib(egl.display, configs[i], EGL_NATIVE_VISUAL_ID, &id))	continue;
+
+				if (id == gbm.format) {
+					egl.config = configs[i];
+					_found_matching_config = true;
+					break;
+				}
 			}
 		}
+		free(configs);
+
+		// the cached EGL config is stale, so the cache needs to be rewritten.
+		restored_from_cache = false;
 	}
-	free(configs);
 
 	if (!_found_matching_config) {
 		fprintf(stderr, "Could not find context with appropriate attributes and matching native visual ID.\n");
@@ -1133,15 +1822,19 @@ bool init_display(void) {
 
 	egl.renderer = (char*) glGetString(GL_RENDERER);
 
-	gl_exts = (char*) glGetString(GL_EXTENSIONS);
-	printf("===================================\n");
-	printf("OpenGL ES information:\n");
-	printf("  version: \"%s\"\n", glGetString(GL_VERSION));
-	printf("  shading language version: \"%s\"\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
-	printf("  vendor: \"%s\"\n", glGetString(GL_VENDOR));
-	printf("  renderer: \"%s\"\n", egl.renderer);
-	printf("  extensions: \"%s\"\n", gl_exts);
-	printf("===================================\n");
+	if (verbose) {
+		gl_exts = (char*) glGetString(GL_EXTENSIONS);
+		printf("===================================\n");
+		printf("OpenGL ES information:\n");
+		printf("  version: \"%s\"\n", glGetString(GL_VERSION));
+		printf("  shading language version: \"%s\"\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+		printf("  vendor: \"%s\"\n", glGetString(GL_VENDOR));
+		printf("  renderer: \"%s\"\n", egl.renderer);
+		printf("  extensions: \"%s\"\n", gl_exts);
+		printf("===================================\n");
+	} else {
+		printf("OpenGL ES renderer: \"%s\"\n", egl.renderer);
+	}
 
 	// it seems that after some Raspbian update, regular users are sometimes no longer allowed
 	//   to use the direct-rendering infrastructure; i.e. the open the devices inside /dev/dri/
@@ -1154,6 +1847,8 @@ bool init_display(void) {
 			   "         This warning will probably result in a \"failed to set mode\" error\n"
 			   "         later on in the initialization.\n");
 
+	timeline_end(timeline_id);
+
 	drm.evctx = (drmEventContext) {
 		.version = 4,
 		.vblank_handler = NULL,
@@ -1162,6 +1857,8 @@ bool init_display(void) {
 		.sequence_handler = NULL
 	};
 
+	timeline_id = timeline_begin("initial modeset");
+
 	printf("Swapping buffers...\n");
 	eglSwapBuffers(egl.display, egl.surface);
 
@@ -1188,6 +1885,37 @@ bool init_display(void) {
 		return false;
 	}
 
+	timeline_end(timeline_id);
+
+	// remember this configuration so the next start can skip the full probe.
+	if (display_cache.enabled && !restored_from_cache) {
+		struct stat statbuf;
+
+		cache_entry = (struct display_cache_entry) {
+			.connector_id = drm.connector_id,
+			.connector_type = connector->connector_type,
+			.connector_type_id = connector->connector_type_id,
+			.hdisplay = drm.mode->hdisplay,
+			.vdisplay = drm.mode->vdisplay,
+			.vrefresh = drm.mode->vrefresh,
+			.flags = drm.mode->flags,
+			.clock = drm.mode->clock,
+			.crtc_id = drm.crtc_id,
+			.crtc_index = drm.crtc_index,
+			.width_mm = width_mm,
+			.height_mm = height_mm,
+			.gbm_format = gbm.format
+		};
+		snprintf(cache_entry.drm_device, sizeof(cache_entry.drm_device), "%s", drm.device);
+		eglGetConfigAttrib(egl.display, egl.config, EGL_CONFIG_ID, &cache_entry.egl_config_id);
+
+		if (fstat(drm.fd, &statbuf) == 0) {
+			cache_entry.drm_rdev = statbuf.st_rdev;
+			if (write_display_cache(&cache_entry))
+				printf("Wrote display configuration to display cache \"%s\".\n", display_cache.path);
+		}
+	}
+
 	printf("finished display setup!\n");
 
 	return true;
@@ -1196,8 +1924,8 @@ void destroy_display(void) {
 	fprintf(stderr, "Deinitializing display not yet implemented\n");
 }
 
-bool init_application(void) {
-	int ok, _errno;
+bool init_plugins(void) {
+	int ok;
 
 	printf("Initializing Plugin Registry...\n");
 	ok = plugin_registry_init();
@@ -1206,8 +1934,25 @@ bool init_application(void) {
 		return false;
 	}
 
-	// configure flutter rendering
-	flutter.renderer_config.type = kOpenGL;
+	return true;
+}
+
+/// Reads the Dart snapshot, the ICU data and the listed asset files into the page cache,
+/// so the engine doesn't have to wait for the (often slow) SD card when it starts up.
+bool prefetch_engine_files(void) {
+	const char *paths[] = {
+		flutter.is_aot ? flutter.app_elf_path : flutter.kernel_blob_path,
+		flutter.icu_data_path
+	};
+
+	return prefetch_files(paths, sizeof(paths) / sizeof(*paths));
+}
+
+bool init_application(void) {
+	int ok, _errno;
+
+	// configure flutter rendering
+	flutter.renderer_config.type = kOpenGL;
 	flutter.renderer_config.open_gl.struct_size		= sizeof(flutter.renderer_config.open_gl);
 	flutter.renderer_config.open_gl.make_current	= make_current;
 	flutter.renderer_config.open_gl.clear_current	= clear_current;
@@ -1228,6 +1973,19 @@ bool init_application(void) {
 	flutter.args.vm_snapshot_data			= NULL;
 	flutter.args.vm_snapshot_instructions_size = 0;
 	flutter.args.vm_snapshot_instructions	= NULL;
+	if (flutter.is_aot && !load_aot_snapshots()) {
+		return false;
+	}
+
+	if (flutter.cache_dir[0] != '\0') {
+		if (!shader_cache_init(flutter.cache_dir, flutter.asset_bundle_path)) {
+			return false;
+		}
+
+		flutter.args.persistent_cache_path	= flutter.cache_dir;
+		flutter.args.is_persistent_cache_read_only = false;
+	}
+
 	flutter.args.command_line_argc			= flutter.engine_argc;
 	flutter.args.command_line_argv			= flutter.engine_argv;
 	flutter.args.platform_message_callback	= on_platform_message;
@@ -1264,7 +2022,9 @@ bool init_application(void) {
 	}
 
 	// spin up the engine
+	int timeline_id = timeline_begin("FlutterEngineRun");
 	FlutterEngineResult _result = FlutterEngineRun(FLUTTER_ENGINE_VERSION, &flutter.renderer_config, &flutter.args, NULL, &engine);
+	timeline_end(timeline_id);
 	if (_result != kSuccess) {
 		fprintf(stderr, "Could not run the flutter engine\n");
 		return false;
@@ -1297,6 +2057,33 @@ void destroy_application(void) {
 		engine = NULL;
 	}
 
+	if (flutter.cache_dir[0] != '\0') {
+		shader_cache_print_stats();
+		shader_cache_deinit();
+	}
+
+	if (input_device_cache.enabled) {
+		input_cache_deinit();
+	}
+
+	if (flutter.app_elf_handle != NULL) {
+		dlclose(flutter.app_elf_handle);
+		flutter.app_elf_handle = NULL;
+	}
+
+	prefetch_deinit();
+
+	if (input_latency.enabled) {
+		latency_print_histograms(stdout);
+		latency_deinit();
+	}
+
+	if (input_recording.record)
+		input_recording_stop();
+
+	if (touch_prediction_enabled)
+		touch_prediction_print_stats();
+
 	if ((ok = plugin_registry_deinit()) != 0) {
 		fprintf(stderr, "Could not deinitialize plugin registry: %s\n", strerror(ok));
 	}
@@ -1305,536 +2092,1673 @@ void destroy_application(void) {
 /****************
  * Input-Output *
  ****************/
-void  init_io(void) {
-	int ok;
-	int n_flutter_slots = 0;
-	FlutterPointerEvent   flutterevents[64] = {0};
-	size_t                i_flutterevent = 0;
+/// The kAdd events for the mousepointer and all multitouch slots.
+/// Collected by probe_input_devices and sent to flutter by send_pointer_add_events,
+/// once the engine is running.
+FlutterPointerEvent initial_pointer_events[64];
+size_t              n_initial_pointer_events = 0;
+
+/// The number of flutter pointer ids handed out so far. Pointer ids are never reused,
+/// so the events of a removed device can't be confused with the ones of a newly plugged in device.
+int32_t n_flutter_slots = 0;
+
+/// The SCHED_FIFO priority of the DRM event thread.
+/// Above all normal threads, but well below the threaded IRQ handlers (50).
+#define DRM_THREAD_PRIORITY 10
+
+/// The epoll instance of the io thread. See struct io_handler.
+int io_epoll_fd = -1;
+
+struct input_hotplug_watch {
+	int wd;
+	char dir[PATH_MAX];
+};
 
-	n_input_devices = 0;
-	input_devices = NULL;
+/// Watches the directories of the input device glob patterns for new devices.
+struct {
+	int inotify_fd;
+	struct io_handler io;
+	struct input_hotplug_watch *watches;
+	size_t n_watches;
+} input_hotplug = {
+	.inotify_fd = -1
+};
 
-	// add the mouse slot
-	mousepointer = (struct mousepointer_mtslot) {
-		.id = 0,
-		.flutter_slot_id = n_flutter_slots++,
-		.x = 0, .y = 0,
-		.phase = kCancel
-	};
+/// Sends pointer events to flutter, through the pointer resampler if --pointer-resampling was given.
+bool  send_pointer_events(const FlutterPointerEvent *events, size_t n_events) {
+	if (pointer_resampling)
+		return pointer_resampler_send(events, n_events);
 
-	flutterevents[i_flutterevent++] = (FlutterPointerEvent) {
-		.struct_size = sizeof(FlutterPointerEvent),
-		.phase = kAdd,
-		.timestamp = (size_t) (FlutterEngineGetCurrentTime()*1000),
-		.x = 0,
-		.y = 0,
-		.signal_kind = kFlutterPointerSignalKindNone,
-		.device_kind = kFlutterPointerDeviceKindMouse,
-		.device = 0,
-		.buttons = 0
-	};
-	
-	// go through all the given paths and add everything you can
-	for (int i=0; i < input_devices_glob.gl_pathc; i++) {
-		struct input_device dev = {0};
-		uint32_t absbits[(ABS_CNT+31) /32] = {0};
-		uint32_t relbits[(REL_CNT+31) /32] = {0};
-		uint32_t keybits[(KEY_CNT+31) /32] = {0};
-		uint32_t props[(INPUT_PROP_CNT+31) /32] = {0};
-		
-		snprintf(dev.path, sizeof(dev.path), "%s", input_devices_glob.gl_pathv[i]);
-		printf("  input device %i: path=\"%s\"\n", i, dev.path);
-		
-		// first, try to open the event device.
-		dev.fd = open(dev.path, O_RDONLY);
-		if (dev.fd < 0) {
-			perror("\n    error opening the input device");
-			continue;
-		}
+	return FlutterEngineSendPointerEvent(engine, events, n_events) == kSuccess;
+}
 
-		// query name
-		ok = ioctl(dev.fd, EVIOCGNAME(sizeof(dev.name)), &dev.name);
-		if (ok != -1) ok = ioctl(dev.fd, EVIOCGID, &dev.input_id);
-		if (ok == -1) {
-			perror("\n    could not query input device name / id: ioctl for EVIOCGNAME or EVIOCGID failed");
-			goto close_continue;
-		}
+/// Fills events with an event of the given phase for each multitouch slot of device.
+/// Pointer devices (mouse, touchpads) share the global mousepointer, so there are no events for them.
+/// Returns the number of events written to events (at most max_events).
+size_t get_mtslot_events(struct input_device *device, FlutterPointerPhase phase, FlutterPointerEvent *events, size_t max_events) {
+	size_t n_events = 0;
+
+	if (device->is_pointer) return 0;
+
+	for (int j = 0; (j < device->n_mtslots) && (n_events < max_events); j++) {
+		events[n_events++] = (FlutterPointerEvent) {
+			.struct_size = sizeof(FlutterPointerEvent),
+			.phase = phase,
+			.timestamp = (size_t) (FlutterEngineGetCurrentTime()*1000),
+			.x = device->mtslots[j].x == -1 ? 0 : device->mtslots[j].x,
+			.y = device->mtslots[j].y == -1 ? 0 : device->mtslots[j].y,
+			.signal_kind = kFlutterPointerSignalKindNone,
+			.device_kind = device->kind,
+			.device = device->mtslots[j].flutter_slot_id,
+			.buttons = 0
+		};
+	}
 
-		printf("      %s, connected via %s. vendor: 0x%04X, product: 0x%04X, version: 0x%04X\n", dev.name,
-			   INPUT_BUSTYPE_FRIENDLY_NAME(dev.input_id.bustype), dev.input_id.vendor, dev.input_id.product, dev.input_id.version);
+	return n_events;
+}
 
-		// query supported event codes (for EV_ABS, EV_REL and EV_KEY event types)
-		ok = ioctl(dev.fd, EVIOCGBIT(EV_ABS, sizeof(absbits)), absbits);
-		if (ok != -1) ok = ioctl(dev.fd, EVIOCGBIT(EV_REL, sizeof(relbits)), relbits);
-		if (ok != -1) ok = ioctl(dev.fd, EVIOCGBIT(EV_KEY, sizeof(keybits)), keybits);
-		if (ok != -1) ok = ioctl(dev.fd, EVIOCGPROP(sizeof(props)), props);
-		if (ok == -1) {
-			perror("    could not query input device: ioctl for EVIOCGBIT(EV_ABS), EVIOCGBIT(EV_REL), EVIOCGBIT(EV_KEY) or EVIOCGPROP failed");
-			goto close_continue;
-		}
+void  on_evdev_input(void *userdata, uint32_t epoll_events);
+void  drain_evdev_input(void);
+void  flush_evdev_input(void);
 
-		// check if this input device needs a mousepointer (true for mouse, touchpads)
-		dev.is_pointer = ISSET(props, INPUT_PROP_POINTER);
-		dev.is_direct  = ISSET(props, INPUT_PROP_DIRECT);
-		if (!dev.is_pointer && !dev.is_direct) {
-			bool touch = ISSET(absbits, ABS_MT_SLOT) || ISSET(keybits, BTN_TOUCH);
-			bool touchpad = touch && ISSET(keybits, BTN_TOOL_FINGER);
-			bool touchscreen = touch && !touchpad;
-			bool mouse = !touch && (ISSET(relbits, REL_X) || ISSET(relbits, REL_Y));
-			dev.is_pointer = touchpad || mouse;
-			dev.is_direct  = touchscreen;
-		}
-		dev.kind = dev.is_pointer ? kFlutterPointerDeviceKindMouse : kFlutterPointerDeviceKindTouch;
-
-		// check if the device emits ABS_X and ABS_Y events, and if yes
-		// query some calibration data.
-		if (ISSET(absbits, ABS_X) && ISSET(absbits, ABS_Y)) {
-			ok = ioctl(dev.fd, EVIOCGABS(ABS_X), &(dev.xinfo));
-			if (ok != -1) ok = ioctl(dev.fd, EVIOCGABS(ABS_Y), &(dev.yinfo));
-			if (ok == -1) {
-				perror("    could not query input_absinfo: ioctl for ECIOCGABS(ABS_X) or EVIOCGABS(ABS_Y) failed");
-				goto close_continue;
-			}
-		}
+/// The number of input events read from an evdev device at once.
+#define EVDEV_READ_BUFFER_SIZE 256
 
-		// check if the device is multitouch (so a multitouch touchscreen or touchpad)
-		if (ISSET(absbits, ABS_MT_SLOT)) {
-			struct input_absinfo slotinfo;
+/// The ready devices are drained in at most this many rounds of one read per device per wake,
+/// so the batch sent to flutter stays bounded even if a device floods us with events.
+/// (the rest is read right in the next wake, since epoll is level-triggered)
+#define EVDEV_MAX_READS_PER_WAKE 16
 
-			// query the ABS_MT_SLOT absinfo
-			ok = ioctl(dev.fd, EVIOCGABS(ABS_MT_SLOT), &slotinfo);
-			if (ok == -1) {
-				perror("    could not query input_absinfo: ioctl for EVIOCGABS(ABS_MT_SLOT) failed");
-				goto close_continue;
-			}
+/// The input devices that epoll reported readable in the current wake of the io thread,
+/// in the order they were reported. Linked using input_device.next_ready. Only used on the io thread.
+struct input_device *ready_input_devices = NULL;
 
-			// put the info in the input_device field
-			dev.n_mtslots = slotinfo.maximum + 1;
-			dev.i_active_mtslot = slotinfo.value;
-		} else {
-			// even if the device doesn't have multitouch support,
-			// i may need some space to store coordinates, for example
-			// to convert ABS_X/Y events into relative ones (no-multitouch touchpads for example)
-			dev.n_mtslots = 1;
-			dev.i_active_mtslot = 0;
-		}
+/// The maximum number of input frames per batch whose latency is recorded.
+#define EVDEV_BATCH_MAX_INPUTS 1024
 
-		dev.mtslots = calloc(dev.n_mtslots, sizeof(struct mousepointer_mtslot));
-		for (int j=0; j < dev.n_mtslots; j++) {
-			dev.mtslots[j].id = -1;
-			dev.mtslots[j].flutter_slot_id = n_flutter_slots++;
-			dev.mtslots[j].x = -1;
-			dev.mtslots[j].y = -1;
+/// The flutter pointer events of all input devices that were ready in one wake
+/// of the io thread. They're sent to flutter together by flush_evdev_input.
+/// Only used on the io thread.
+static struct {
+	struct pointer_event_buffer events;
 
-			if (dev.is_pointer) continue;
+	/// the kernel timestamps of the input frames in the batch (for the latency stats)
+	/// and when they were read.
+	uint64_t input_ns[EVDEV_BATCH_MAX_INPUTS];
+	uint64_t read_ns[EVDEV_BATCH_MAX_INPUTS];
+	size_t n_inputs;
+} evdev_batch = {0};
 
-			flutterevents[i_flutterevent++] = (FlutterPointerEvent) {
-				.struct_size = sizeof(FlutterPointerEvent),
-				.phase = kAdd,
-				.timestamp = (size_t) (FlutterEngineGetCurrentTime()*1000),
-				.x = dev.mtslots[j].x == -1 ? 0 : dev.mtslots[j].x,
-				.y = dev.mtslots[j].y == -1 ? 0 : dev.mtslots[j].y,
-				.signal_kind = kFlutterPointerSignalKindNone,
-				.device_kind = dev.kind,
-				.device = dev.mtslots[j].flutter_slot_id,
-				.buttons = 0
-			};
-		}
+/// Queries the name, id, capability bits & absinfo of the evdev device opened as fd.
+bool  query_input_device_caps(int fd, struct input_device_caps *caps) {
+	int ok;
 
-		// if everything worked we expand the input_devices array and add our dev.
-		input_devices = realloc(input_devices, ++n_input_devices * sizeof(struct input_device));
-		input_devices[n_input_devices-1] = dev;
-		continue;
+	memset(caps, 0, sizeof(*caps));
 
-		close_continue:
-			close(dev.fd);
-			dev.fd = -1;
+	// query name
+	ok = ioctl(fd, EVIOCGNAME(sizeof(caps->name)), caps->name);
+	if (ok != -1) ok = ioctl(fd, EVIOCGID, &caps->input_id);
+	if (ok == -1) {
+		perror("\n    could not query input device name / id: ioctl for EVIOCGNAME or EVIOCGID failed");
+		return false;
 	}
 
-	if (n_input_devices == 0)
-		printf("Warning: No evdev input devices configured.\n");
-	
-	// configure the console
-	ok = console_make_raw();
-	if (ok != 0) {
-		printf("[flutter-pi] warning: could not make stdin raw\n");
+	// query supported event codes (for EV_ABS, EV_REL and EV_KEY event types)
+	ok = ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(caps->absbits)), caps->absbits);
+	if (ok != -1) ok = ioctl(fd, EVIOCGBIT(EV_REL, sizeof(caps->relbits)), caps->relbits);
+	if (ok != -1) ok = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(caps->keybits)), caps->keybits);
+	if (ok != -1) ok = ioctl(fd, EVIOCGPROP(sizeof(caps->props)), caps->props);
+	if (ok == -1) {
+		perror("    could not query input device: ioctl for EVIOCGBIT(EV_ABS), EVIOCGBIT(EV_REL), EVIOCGBIT(EV_KEY) or EVIOCGPROP failed");
+		return false;
 	}
 
-	console_flush_stdin();
+	// query the calibration data of all axes
+	for (int i = 0; i < ABS_CNT; i++) {
+		if (!ISSET(caps->absbits, i)) continue;
 
-	// now send all the kAdd events to flutter.
-	ok = kSuccess == FlutterEngineSendPointerEvent(engine, flutterevents, i_flutterevent);
-	if (!ok) fprintf(stderr, "error while sending initial mousepointer / multitouch slot information to flutter\n");
-}
-void  on_evdev_input(fd_set fds, size_t n_ready_fds) {
-	struct input_event    linuxevents[64];
-	size_t                n_linuxevents;
-	struct input_device  *device;
-	struct mousepointer_mtslot *active_mtslot;
-	FlutterPointerEvent   flutterevents[64] = {0};
-	size_t                i_flutterevent = 0;
-	int    ok, i, j;
-
-	while (n_ready_fds > 0) {
-		// find out which device got new data
-		i = 0;
-		while (!FD_ISSET(input_devices[i].fd, &fds))  i++;
-		device = &input_devices[i];
-		active_mtslot = &device->mtslots[device->i_active_mtslot];
-
-		// read the input events, convert them to flutter pointer events
-		ok = read(input_devices[i].fd, linuxevents, sizeof(linuxevents));
+		ok = ioctl(fd, EVIOCGABS(i), caps->absinfo + i);
 		if (ok == -1) {
-			fprintf(stderr, "error reading input events from device \"%s\" with path \"%s\": %s\n",
-					input_devices[i].name, input_devices[i].path, strerror(errno));
-			return;
-		} else if (ok == 0) {
-			fprintf(stderr, "reached EOF for input device \"%s\" with path \"%s\": %s\n",
-					input_devices[i].name, input_devices[i].path, strerror(errno));
-			return;
+			fprintf(stderr, "    could not query input_absinfo: ioctl for EVIOCGABS(0x%02X) failed: %s\n", i, strerror(errno));
+			return false;
 		}
-		n_ready_fds--;
-		n_linuxevents = ok / sizeof(struct input_event);
-		
-		// now go through all linux events and update the state and flutterevents array accordingly.
-		for (int i=0; i < n_linuxevents; i++) {
-			struct input_event *e = &linuxevents[i];
-		
-			if (e->type == EV_REL) {
-				// pointer moved relatively in the X or Y direction
-				// for now, without a speed multiplier
-
-				double relx = e->code == REL_X ? e->value : 0;
-				double rely = e->code == REL_Y ? e->value : 0;
-
-				mousepointer.x += relx;
-				mousepointer.y += rely;
-
-				// only change the current phase if we don't yet have one.
-				if ((mousepointer.phase == kCancel) && (relx != 0 || rely != 0))
-					mousepointer.phase = device->active_buttons ? kMove : kHover;
-
-			} else if (e->type == EV_ABS) {
-
-				if (e->code == ABS_MT_SLOT) {
-
-					// select a new active mtslot.
-					device->i_active_mtslot = e->value;
-					active_mtslot = &device->mtslots[device->i_active_mtslot];
-
-				} else if (e->code == ABS_MT_POSITION_X || e->code == ABS_X || e->code == ABS_MT_POSITION_Y || e->code == ABS_Y) {
-					double relx = 0, rely = 0;
-					
-					if (e->code == ABS_MT_POSITION_X || (e->code == ABS_X && device->n_mtslots == 1)) {
-						double newx = (e->value - device->xinfo.minimum) * width / (double) (device->xinfo.maximum - device->xinfo.minimum);
-						relx = active_mtslot->phase == kDown ? 0 : newx - active_mtslot->x;
-						active_mtslot->x = newx;
-					} else if (e->code == ABS_MT_POSITION_Y || (e->code == ABS_Y && device->n_mtslots == 1)) {
-						double newy = (e->value - device->yinfo.minimum) * height / (double) (device->yinfo.maximum - device->yinfo.minimum);
-						rely = active_mtslot->phase == kDown ? 0 : newy - active_mtslot->y;
-						active_mtslot->y = newy;
-					}
+	}
 
-					// if the device is associated with the mouse pointer (touchpad), update that pointer.
-					if (relx != 0 || rely != 0) {
-						struct mousepointer_mtslot *slot = active_mtslot;
+	return true;
+}
 
-						if (device->is_pointer) {
-							mousepointer.x += relx;
-							mousepointer.y += rely;
-							slot = &mousepointer;
-						}
+static const double identity_calibration[6] = {1, 0, 0, 0, 1, 0};
 
-						if (slot->phase == kCancel)
-							slot->phase = device->active_buttons ? kMove : kHover;
-					}
-				} else if ((e->code == ABS_MT_TRACKING_ID) && (active_mtslot->id == -1 || e->value == -1)) {
-
-					// id -1 means no id, or no touch. one tracking id is equivalent one continuous touch contact.
-					bool before = device->active_buttons && true;
-
-					if (active_mtslot->id == -1) {
-						active_mtslot->id = e->value;
-						// only set active_buttons if a touch equals a kMove (not kHover, as it is for multitouch touchpads)
-						device->active_buttons |= (device->is_direct ? FLUTTER_BUTTON_FROM_EVENT_CODE(BTN_TOUCH) : 0);
-					} else {
-						active_mtslot->id = -1;
-						device->active_buttons &= ~(device->is_direct ? FLUTTER_BUTTON_FROM_EVENT_CODE(BTN_TOUCH) : 0);
-					}
+/// Parses a calibration matrix given as 6 numbers, separated by spaces or commas.
+/// Returns a pointer to the rest of the string, or NULL if it's not a valid matrix.
+const char *parse_calibration_matrix(const char *str, double matrix_out[6]) {
+	char *end;
 
-					if (!before != !device->active_buttons)
-						active_mtslot->phase = before ? kUp : kDown;
-				}
+	for (int i = 0; i < 6; i++) {
+		while ((*str == ' ') || (*str == ',')) str++;
 
-			} else if (e->type == EV_KEY) {
-				
-				// remember if some buttons were pressed before this update
-				bool before = device->active_buttons && true;
+		errno = 0;
+		matrix_out[i] = strtod(str, &end);
+		if ((errno != 0) || (end == str) || !isfinite(matrix_out[i]))
+			return NULL;
 
-				// update the active_buttons bitmap
-				// only apply BTN_TOUCH to the active buttons if a touch really equals a pressed button (device->is_direct is set)
-				//   is_direct is true for touchscreens, but not for touchpads; so BTN_TOUCH doesn't result in a kMove for touchpads
-
-				glfw_key glfw_key = EVDEV_KEY_TO_GLFW_KEY(e->code);
-				if ((glfw_key != GLFW_KEY_UNKNOWN) && (glfw_key != 0)) {
-					glfw_key_action action;
-					switch (e->value) {
-						case 0: action = GLFW_RELEASE; break;
-						case 1: action = GLFW_PRESS; break;
-						case 2: action = GLFW_REPEAT; break;
-						default: action = -1; break;
-					}
+		str = end;
+	}
 
-					rawkb_on_keyevent(EVDEV_KEY_TO_GLFW_KEY(e->code), 0, action);
-				} else if (e->code != BTN_TOUCH || device->is_direct) {
-					if (e->value == 1) device->active_buttons |=  FLUTTER_BUTTON_FROM_EVENT_CODE(e->code);
-					else               device->active_buttons &= ~FLUTTER_BUTTON_FROM_EVENT_CODE(e->code);
-				}
+	return str;
+}
 
-				// check if the button state changed
-				// if yes, change the current pointer phase
-				if (!before != !device->active_buttons)
-					(device->is_pointer ? &mousepointer : active_mtslot) ->phase = before ? kUp : kDown;
+/// Reads the LIBINPUT_CALIBRATION_MATRIX udev property of the input device with the device number rdev
+/// from the udev database. (So we don't need libudev just for that)
+bool  get_udev_calibration_matrix(dev_t rdev, double matrix_out[6]) {
+	static const char property[] = "E:LIBINPUT_CALIBRATION_MATRIX=";
+	char path[64], line[256];
+	FILE *file;
+	bool found = false;
 
-			} else if ((e->type == EV_SYN) && (e->code == SYN_REPORT)) {
-				
-				// We can now summarise the updates we received from the evdev into a FlutterPointerEvent
-				// and put it in the flutterevents buffer.
-				
-				size_t n_slots = 0;
-				struct mousepointer_mtslot *slots;
-
-				// if this is a pointer device, we don't care about the multitouch slots & only send the updated mousepointer.
-				if (device->is_pointer) {
-					slots = &mousepointer;
-					n_slots = 1;
-				} else if (device->is_direct) {
-					slots = device->mtslots;
-					n_slots = device->n_mtslots;
-				}
+	snprintf(path, sizeof(path), "/run/udev/data/c%u:%u", major(rdev), minor(rdev));
 
-				for (j = 0; j < n_slots; j++) {
-
-					// we don't want to send an event to flutter if nothing changed.
-					if (slots[j].phase == kCancel) continue;
-
-					// convert raw pixel coordinates to flutter pixel coordinates
-					// (raw pixel coordinates don't respect screen rotation)
-					double flutterx, fluttery;
-					if (rotation == 0) {
-						flutterx = slots[j].x;
-						fluttery = slots[j].y;
-					} else if (rotation == 90) {
-						flutterx = slots[j].y;
-						fluttery = width - slots[j].x;
-					} else if (rotation == 180) {
-						flutterx = width - slots[j].x;
-						fluttery = height - slots[j].y;
-					} else if (rotation == 270) {
-						flutterx = height - slots[j].y;
-						fluttery = slots[j].x;
-					}
+	file = fopen(path, "r");
+	if (file == NULL) return false;
 
-					flutterevents[i_flutterevent++] = (FlutterPointerEvent) {
-						.struct_size = sizeof(FlutterPointerEvent),
-						.phase = slots[j].phase,
-						.timestamp = e->time.tv_sec*1000000 + e->time.tv_usec,
-						.x = flutterx, .y = fluttery,
-						.device = slots[j].flutter_slot_id,
-						.signal_kind = kFlutterPointerSignalKindNone,
-						.scroll_delta_x = 0, .scroll_delta_y = 0,
-						.device_kind = device->kind,
-						.buttons = device->active_buttons & 0xFF
-					};
-
-					slots[j].phase = kCancel;
-				}
-			}
+	while (!found && (fgets(line, sizeof(line), file) != NULL)) {
+		if (strncmp(line, property, sizeof(property) - 1) == 0)
+			found = parse_calibration_matrix(line + sizeof(property) - 1, matrix_out) != NULL;
+	}
+
+	fclose(file);
+
+	return found;
+}
+
+/// Sets the calibration matrix of a touchscreen. A matrix given with --calibration-matrix
+/// whose pattern matches the device path takes precedence over the udev property.
+/// rdev is the device number of the device, or 0 if it has none (devices of an input replay).
+void  configure_input_device_calibration(struct input_device *dev, dev_t rdev) {
+	double matrix[6];
+	bool found = false;
+
+	if (!dev->is_direct) return;
+
+	for (int i = 0; (i < n_calibration_matrices) && !found; i++) {
+		if ((calibration_matrices[i].pattern == NULL) || (fnmatch(calibration_matrices[i].pattern, dev->path, 0) == 0)) {
+			memcpy(matrix, calibration_matrices[i].matrix, sizeof(matrix));
+			found = true;
 		}
 	}
 
-	if (i_flutterevent == 0) return;
+	if (!found && (rdev != 0))
+		found = get_udev_calibration_matrix(rdev, matrix);
 
-	// now, send the data to the flutter engine
-	ok = kSuccess == FlutterEngineSendPointerEvent(engine, flutterevents, i_flutterevent);
-	if (!ok) {
-		fprintf(stderr, "could not send pointer events to flutter engine\n");
+	if (!found) return;
+
+	printf("    calibration matrix: %g %g %g %g %g %g\n", matrix[0], matrix[1], matrix[2], matrix[3], matrix[4], matrix[5]);
+	memcpy(dev->calibration, matrix, sizeof(matrix));
+	dev->transform_rotation = -1;
+}
+
+/// Precomputes the conversion of ABS_X / ABS_Y values to raw pixel coordinates, and the
+/// transform of raw pixel coordinates to flutter coordinates for the current display rotation.
+void  update_input_device_transform(struct input_device *dev) {
+	const double *c = dev->calibration;
+	double k[6], r[6];
+	double w = width, h = height;
+
+	dev->xscale = dev->xinfo.maximum > dev->xinfo.minimum ? w / (dev->xinfo.maximum - dev->xinfo.minimum) : 0;
+	dev->yscale = dev->yinfo.maximum > dev->yinfo.minimum ? h / (dev->yinfo.maximum - dev->yinfo.minimum) : 0;
+
+	// the calibration matrix works on normalized coordinates, scale it to pixels.
+	k[0] = c[0];         k[1] = c[1] * w / h; k[2] = c[2] * w;
+	k[3] = c[3] * h / w; k[4] = c[4];         k[5] = c[5] * h;
+
+	// raw pixel coordinates don't respect the screen rotation
+	if (rotation == 90) {
+		r[0] = 0;  r[1] = 1;  r[2] = 0;
+		r[3] = -1; r[4] = 0;  r[5] = w;
+	} else if (rotation == 180) {
+		r[0] = -1; r[1] = 0;  r[2] = w;
+		r[3] = 0;  r[4] = -1; r[5] = h;
+	} else if (rotation == 270) {
+		r[0] = 0;  r[1] = -1; r[2] = h;
+		r[3] = 1;  r[4] = 0;  r[5] = 0;
+	} else {
+		r[0] = 1;  r[1] = 0;  r[2] = 0;
+		r[3] = 0;  r[4] = 1;  r[5] = 0;
 	}
+
+	// transform = r * k
+	dev->transform[0] = r[0]*k[0] + r[1]*k[3];
+	dev->transform[1] = r[0]*k[1] + r[1]*k[4];
+	dev->transform[2] = r[0]*k[2] + r[1]*k[5] + r[2];
+	dev->transform[3] = r[3]*k[0] + r[4]*k[3];
+	dev->transform[4] = r[3]*k[1] + r[4]*k[4];
+	dev->transform[5] = r[3]*k[2] + r[4]*k[5] + r[5];
+
+	dev->transform_rotation = rotation;
 }
-void  on_console_input(void) {
-	static char buffer[4096];
-	glfw_key key;
-	char *cursor;
-	char *c;
-	int ok;
 
-	ok = read(STDIN_FILENO, buffer, sizeof(buffer));
-	if (ok == -1) {
-		perror("could not read from stdin");
-		return;
-	} else if (ok == 0) {
-		fprintf(stderr, "warning: reached EOF for stdin\n");
-		return;
+/// Creates an input device reading its events from fd, classifies it using its
+/// capabilities and allocates its multitouch slots.
+/// Used for real evdev devices and for the devices of an input replay alike,
+/// so both go through the exact same conversion to flutter pointer events.
+struct input_device *create_input_device(const char *path, int fd, const struct input_device_caps *caps) {
+	struct input_device *dev;
+
+	dev = calloc(1, sizeof(struct input_device));
+	if (dev == NULL) {
+		fprintf(stderr, "could not allocate memory for input device\n");
+		return NULL;
 	}
 
-	buffer[ok] = '\0';
+	snprintf(dev->path, sizeof(dev->path), "%s", path);
+	snprintf(dev->name, sizeof(dev->name), "%s", caps->name);
+	dev->input_id = caps->input_id;
+	dev->fd = fd;
+	dev->recording_index = -1;
+	memcpy(dev->calibration, identity_calibration, sizeof(dev->calibration));
+	dev->transform_rotation = -1;
+
+	printf("      %s, connected via %s. vendor: 0x%04X, product: 0x%04X, version: 0x%04X\n", dev->name,
+		   INPUT_BUSTYPE_FRIENDLY_NAME(dev->input_id.bustype), dev->input_id.vendor, dev->input_id.product, dev->input_id.version);
+
+	// check if this input device needs a mousepointer (true for mouse, touchpads)
+	dev->is_pointer = ISSET(caps->props, INPUT_PROP_POINTER);
+	dev->is_direct  = ISSET(caps->props, INPUT_PROP_DIRECT);
+	if (!dev->is_pointer && !dev->is_direct) {
+		bool touch = ISSET(caps->absbits, ABS_MT_SLOT) || ISSET(caps->keybits, BTN_TOUCH);
+		bool touchpad = touch && ISSET(caps->keybits, BTN_TOOL_FINGER);
+		bool touchscreen = touch && !touchpad;
+		bool mouse = !touch && (ISSET(caps->relbits, REL_X) || ISSET(caps->relbits, REL_Y));
+		dev->is_pointer = touchpad || mouse;
+		dev->is_direct  = touchscreen;
+	}
+	dev->kind = dev->is_pointer ? kFlutterPointerDeviceKindMouse : kFlutterPointerDeviceKindTouch;
+
+	// if the device emits ABS_X and ABS_Y events, remember their calibration data.
+	if (ISSET(caps->absbits, ABS_X) && ISSET(caps->absbits, ABS_Y)) {
+		dev->xinfo = caps->absinfo[ABS_X];
+		dev->yinfo = caps->absinfo[ABS_Y];
+	}
+
+	// check if the device is multitouch (so a multitouch touchscreen or touchpad)
+	if (ISSET(caps->absbits, ABS_MT_SLOT)) {
+		dev->n_mtslots = caps->absinfo[ABS_MT_SLOT].maximum + 1;
+		dev->i_active_mtslot = caps->absinfo[ABS_MT_SLOT].value;
+	} else {
+		// even if the device doesn't have multitouch support,
+		// i may need some space to store coordinates, for example
+		// to convert ABS_X/Y events into relative ones (no-multitouch touchpads for example)
+		dev->n_mtslots = 1;
+		dev->i_active_mtslot = 0;
+	}
 
-	cursor = buffer;
-	while (*cursor) {
-		if (key = console_try_get_key(cursor, &cursor), key != GLFW_KEY_UNKNOWN) {
-			textin_on_key(key);
-		} else if (c = console_try_get_utf8char(cursor, &cursor), c != NULL) {
-			textin_on_utf8_char(c);
-		} else {
-			// neither a char nor a (function) key. we don't know when
-			// we can start parsing the buffer again, so just stop here
-			break;
-		} 
+	dev->mtslots = calloc(dev->n_mtslots, sizeof(struct mousepointer_mtslot));
+	if (dev->mtslots == NULL) {
+		fprintf(stderr, "    could not allocate memory for the multitouch slots\n");
+		free(dev);
+		return NULL;
+	}
+
+	for (int j=0; j < dev->n_mtslots; j++) {
+		dev->mtslots[j].id = -1;
+		dev->mtslots[j].flutter_slot_id = n_flutter_slots++;
+		dev->mtslots[j].x = -1;
+		dev->mtslots[j].y = -1;
 	}
+
+	dev->io = (struct io_handler) {
+		.on_ready = on_evdev_input,
+		.userdata = dev
+	};
+
+	return dev;
 }
-void *io_loop(void *userdata) {
-	int n_ready_fds;
-	fd_set fds;
-	int nfds;
 
+/// Returns what kind of input device a device with the given capabilities is.
+/// Uses the same rules as create_input_device.
+enum input_device_class classify_input_device(const struct input_device_caps *caps) {
+	bool touch = ISSET(caps->absbits, ABS_MT_SLOT) || ISSET(caps->keybits, BTN_TOUCH);
+	bool touchpad = touch && ISSET(caps->keybits, BTN_TOOL_FINGER);
 
-	// put all file-descriptors in the `fds` fd set
-	nfds = 0;
-	FD_ZERO(&fds);
+	if (ISSET(caps->props, INPUT_PROP_DIRECT))
+		return kInputDeviceClassTouchscreen;
 
-	for (int i = 0; i < n_input_devices; i++) {
-		FD_SET(input_devices[i].fd, &fds);
-		if (input_devices[i].fd + 1 > nfds) nfds = input_devices[i].fd + 1;
-	}
+	if (ISSET(caps->props, INPUT_PROP_POINTER) || touchpad)
+		return touchpad ? kInputDeviceClassTouchpad : kInputDeviceClassMouse;
 
-	FD_SET(drm.fd, &fds);
-	if (drm.fd + 1 > nfds) nfds = drm.fd + 1;
-	
-	//FD_SET(STDIN_FILENO, &fds);
+	if (touch)
+		return kInputDeviceClassTouchscreen;
 
-	const fd_set const_fds = fds;
+	if (ISSET(caps->relbits, REL_X) || ISSET(caps->relbits, REL_Y))
+		return kInputDeviceClassMouse;
 
-	while (engine_running) {
-		// wait for any device to offer new data,
-		// but only if no file descriptors have new data.
-		n_ready_fds = select(nfds, &fds, NULL, NULL, NULL);
+	if (ISSET(caps->keybits, KEY_A) && ISSET(caps->keybits, KEY_SPACE))
+		return kInputDeviceClassKeyboard;
 
-		if (n_ready_fds == -1) {
-			perror("error while waiting for I/O");
-			return NULL;
-		} else if (n_ready_fds == 0) {
-			perror("reached EOF while waiting for I/O");
-			return NULL;
-		}
-		
-		if (FD_ISSET(drm.fd, &fds)) {
-			drmHandleEvent(drm.fd, &drm.evctx);
-			FD_CLR(drm.fd, &fds);
-			n_ready_fds--;
-		}
-		
-		if (FD_ISSET(STDIN_FILENO, &fds)) {
-			on_console_input();
-			FD_CLR(STDIN_FILENO, &fds);
-			n_ready_fds--;
-		}
+	return kInputDeviceClassOther;
+}
+
+static const char *input_device_class_names[] = {
+	"touchscreen", "touchpad", "mouse", "keyboard", "other"
+};
+
+const char *input_device_class_name(enum input_device_class class) {
+	for (int i = 0; i < sizeof(input_device_class_names) / sizeof(*input_device_class_names); i++)
+		if (class == (1 << i)) return input_device_class_names[i];
+
+	return "unknown";
+}
+
+/// Parses the argument of --input-classes into a combination of enum input_device_class.
+bool  parse_input_device_classes(const char *list, unsigned int *classes_out) {
+	unsigned int classes, class;
+	char buffer[256], *entry, *saveptr;
+	bool first = true;
+	int i;
+
+	snprintf(buffer, sizeof(buffer), "%s", list);
 
-		if (n_ready_fds > 0) {
-			on_evdev_input(fds, n_ready_fds);
+	classes = kInputDeviceClassDefault;
+	for (entry = strtok_r(buffer, ",", &saveptr); entry != NULL; entry = strtok_r(NULL, ",", &saveptr), first = false) {
+		char sign = (entry[0] == '+' || entry[0] == '-') ? *entry++ : 0;
+
+		if (strcmp(entry, "all") == 0) {
+			class = kInputDeviceClassAll;
+		} else {
+			for (i = 0; i < sizeof(input_device_class_names) / sizeof(*input_device_class_names); i++)
+				if (strcmp(entry, input_device_class_names[i]) == 0) break;
+
+			if (i == sizeof(input_device_class_names) / sizeof(*input_device_class_names))
+				return false;
+
+			class = 1 << i;
 		}
 
-		fds = const_fds;
+		// a list without + or - at the start replaces the default.
+		if (first && !sign) classes = 0;
+
+		if (sign == '-') classes &= ~class;
+		else classes |= class;
 	}
 
-	return NULL;
+	*classes_out = classes;
+	return true;
 }
-bool  run_io_thread(void) {
-	int ok = pthread_create(&io_thread_id, NULL, &io_loop, NULL);
-	if (ok != 0) {
-		fprintf(stderr, "couldn't create flutter-pi io thread: [%s]", strerror(ok));
-		return false;
+
+/// Opens the evdev input device at path, queries its capabilities and
+/// allocates its multitouch slots. Returns NULL if the device can't be opened,
+/// if it isn't an evdev device or if its class isn't used (see --input-classes).
+struct input_device *open_input_device(const char *path) {
+	struct input_device_caps caps;
+	struct input_device *dev;
+	enum input_device_class class;
+	struct input_id input_id;
+	struct stat st;
+	bool has_monotonic_timestamps, cached = false;
+	int fd, ok;
+
+	printf("  input device: path=\"%s\"\n", path);
+
+	// if the capabilities of the device are cached, we know whether we need it without opening it.
+	if (input_device_cache.enabled && (stat(path, &st) == 0) && input_cache_lookup(path, &st, &caps)) {
+		cached = true;
+
+		class = classify_input_device(&caps);
+		if (!(input_device_classes & class)) {
+			printf("    ignoring %s \"%s\" (cached).\n", input_device_class_name(class), caps.name);
+			return NULL;
+		}
 	}
 
-	ok = pthread_setname_np(io_thread_id, "io.flutter-pi");
-	if (ok != 0) {
-		fprintf(stderr, "couldn't set name of flutter-pi io thread: [%s]", strerror(ok));
-		return false;
+	// first, try to open the event device.
+	fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror("\n    error opening the input device");
+		return NULL;
 	}
 
-	return true;
-}
+	// make sure it's still the same device with a single ioctl.
+	if (cached && ((ioctl(fd, EVIOCGID, &input_id) == -1) || (memcmp(&input_id, &caps.input_id, sizeof(input_id)) != 0)))
+		cached = false;
 
+	if (!cached) {
+		if (!query_input_device_caps(fd, &caps)) {
+			close(fd);
+			return NULL;
+		}
 
-bool  parse_cmd_args(int argc, char **argv) {
-	bool input_specified = false;
-	int ok, opt, index = 0;
-	input_devices_glob = (glob_t) {0};
+		if (input_device_cache.enabled && (fstat(fd, &st) == 0))
+			input_cache_store(path, &st, &caps);
 
-	while ((opt = getopt(argc, (char *const *) argv, "+i:h")) != -1) {
-		index++;
-		switch(opt) {
-			case 'i':
-				input_specified = true;
-				glob(optarg, GLOB_BRACE | GLOB_TILDE | (input_specified ? GLOB_APPEND : 0), NULL, &input_devices_glob);
-				index++;
-				break;
-			case 'h':
-			default:
-				printf("%s", usage);
-				return false;
+		class = classify_input_device(&caps);
+		if (!(input_device_classes & class)) {
+			printf("    ignoring %s \"%s\".\n", input_device_class_name(class), caps.name);
+			close(fd);
+			return NULL;
 		}
 	}
-	
-	if (!input_specified)
-		// user specified no input devices. use /dev/input/event*.
-		glob("/dev/input/event*", GLOB_BRACE | GLOB_TILDE, NULL, &input_devices_glob);
 
-	if (optind >= argc) {
-		fprintf(stderr, "error: expected asset bundle path after options.\n");
-		printf("%s", usage);
-		return false;
+	// let the kernel timestamp the events using the same clock as the flutter engine,
+	// so the timestamps can be compared to FlutterEngineGetCurrentTime().
+	ok = ioctl(fd, EVIOCSCLOCKID, &(int) {CLOCK_MONOTONIC});
+	if (ok == -1) {
+		perror("    could not switch input device to monotonic timestamps, using the time of reading instead. ioctl for EVIOCSCLOCKID failed");
 	}
+	has_monotonic_timestamps = ok != -1;
 
-	snprintf(flutter.asset_bundle_path, sizeof(flutter.asset_bundle_path), "%s", argv[optind]);
+	dev = create_input_device(path, fd, &caps);
+	if (dev == NULL) {
+		close(fd);
+		return NULL;
+	}
 
-	argv[optind] = argv[0];
-	flutter.engine_argc = argc-optind;
-	flutter.engine_argv = (const char* const*) &(argv[optind]);
+	dev->has_monotonic_timestamps = has_monotonic_timestamps;
 
-	for (int i=0; i<flutter.engine_argc; i++)
-		printf("engine_argv[%i] = %s\n", i, flutter.engine_argv[i]);
-	
-	return true;
+	configure_input_device_calibration(dev, fstat(fd, &st) == 0 ? st.st_rdev : 0);
+
+	if (input_recording.record)
+		dev->recording_index = input_recording_add_device(&caps);
+
+	return dev;
 }
-int   main(int argc, char **argv) {
-	if (!parse_cmd_args(argc, argv)) {
-		return EXIT_FAILURE;
+
+/// Closes an input device that was removed (or stopped working), removes it from
+/// the list of input devices and tells flutter its pointers are gone.
+/// Must be called on the io thread.
+void close_input_device(struct input_device *device) {
+	struct input_device **cursor;
+	FlutterPointerEvent *events;
+	size_t n_events = 0;
+
+	printf("input device \"%s\" with path \"%s\" was removed.\n", device->name, device->path);
+
+	// the events of the device that were read before need to reach flutter before its kRemove events.
+	flush_evdev_input();
+
+	epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+	close(device->fd);
+
+	for (cursor = &input_devices; *cursor != NULL; cursor = &(*cursor)->next) {
+		if (*cursor == device) {
+			*cursor = device->next;
+			break;
+		}
 	}
 
-	// check if asset bundle path is valid
-	if (!setup_paths()) {
-		return EXIT_FAILURE;
+	for (cursor = &ready_input_devices; *cursor != NULL; cursor = &(*cursor)->next_ready) {
+		if (*cursor == device) {
+			*cursor = device->next_ready;
+			break;
+		}
 	}
 
-	if (!init_message_loop()) {
-		return EXIT_FAILURE;
+	if (device->n_syn_dropped > 0) {
+		fprintf(stderr, "  the kernel dropped events of this device %u times, because they weren't read fast enough.\n", device->n_syn_dropped);
 	}
-	
-	// initialize display
-	printf("initializing display...\n");
-	if (!init_display()) {
-		return EXIT_FAILURE;
+
+	// cancel all touches that are still going on & remove all the slots.
+	events = malloc(2 * device->n_mtslots * sizeof(FlutterPointerEvent));
+	if ((events != NULL) && !device->is_pointer) {
+		for (int j = 0; j < device->n_mtslots; j++) {
+			if (device->mtslots[j].id == -1) continue;
+
+			events[n_events++] = (FlutterPointerEvent) {
+				.struct_size = sizeof(FlutterPointerEvent),
+				.phase = kCancel,
+				.timestamp = (size_t) (FlutterEngineGetCurrentTime()*1000),
+				.x = device->mtslots[j].x, .y = device->mtslots[j].y,
+				.signal_kind = kFlutterPointerSignalKindNone,
+				.device_kind = device->kind,
+				.device = device->mtslots[j].flutter_slot_id,
+				.buttons = 0
+			};
+		}
+
+		n_events += get_mtslot_events(device, kRemove, events + n_events, device->n_mtslots);
+
+		if ((n_events > 0) && !send_pointer_events(events, n_events))
+			fprintf(stderr, "could not send pointer kRemove events to flutter engine\n");
 	}
+
+	free(events);
+	free(device->mtslots);
+	free(device);
+
+	// when an input replay is finished, all its devices are closed.
+	// That's a good time to report how well the prediction did.
+	if (touch_prediction_enabled)
+		touch_prediction_print_stats();
+}
+
+bool  probe_input_devices(void) {
+	struct input_device *dev, **tail;
+	char path[PATH_MAX];
+	int ok;
+
+	input_devices = NULL;
+	tail = &input_devices;
+
+	// add the mouse slot
+	mousepointer = (struct mousepointer_mtslot) {
+		.id = 0,
+		.flutter_slot_id = n_flutter_slots++,
+		.x = 0, .y = 0,
+		.phase = kCancel
+	};
+
+	initial_pointer_events[n_initial_pointer_events++] = (FlutterPointerEvent) {
+		.struct_size = sizeof(FlutterPointerEvent),
+		.phase = kAdd,
+		.timestamp = (size_t) (FlutterEngineGetCurrentTime()*1000),
+		.x = 0,
+		.y = 0,
+		.signal_kind = kFlutterPointerSignalKindNone,
+		.device_kind = kFlutterPointerDeviceKindMouse,
+		.device = 0,
+		.buttons = 0
+	};
+	
+	// go through all the given paths (or the devices of the input recording
+	// that's replayed) and add everything you can
+	for (int i=0; i < (input_recording.replay ? input_replay_get_n_devices() : input_devices_glob.gl_pathc); i++) {
+		if (input_recording.replay) {
+			snprintf(path, sizeof(path), "%s#%d", input_recording.path, i);
+			printf("  input device: path=\"%s\" (replayed)\n", path);
+
+			dev = create_input_device(path, input_replay_get_device_fd(i), input_replay_get_device_caps(i));
+			if (dev == NULL) continue;
+
+			// the replay timestamps the events using CLOCK_MONOTONIC
+			dev->has_monotonic_timestamps = true;
+
+			configure_input_device_calibration(dev, 0);
+		} else {
+			dev = open_input_device(input_devices_glob.gl_pathv[i]);
+			if (dev == NULL) continue;
+		}
+
+		n_initial_pointer_events += get_mtslot_events(
+			dev,
+			kAdd,
+			initial_pointer_events + n_initial_pointer_events,
+			sizeof(initial_pointer_events) / sizeof(*initial_pointer_events) - n_initial_pointer_events
+		);
+
+		*tail = dev;
+		tail = &dev->next;
+	}
+
+	if (input_devices == NULL)
+		printf("Warning: No evdev input devices configured.\n");
+
+	if (input_device_cache.enabled)
+		input_cache_write();
+	
+	// configure the console
+	ok = console_make_raw();
+	if (ok != 0) {
+		printf("[flutter-pi] warning: could not make stdin raw\n");
+	}
+
+	console_flush_stdin();
+
+	return true;
+}
+bool  send_pointer_add_events(void) {
+	bool ok;
+
+	ok = send_pointer_events(initial_pointer_events, n_initial_pointer_events);
+	if (!ok) fprintf(stderr, "error while sending initial mousepointer / multitouch slot information to flutter\n");
+
+	return ok;
+}
+/// Converts the linux input events of device, read at read_ns, to flutter pointer events
+/// and adds them to the evdev batch.
+void  process_evdev_events(struct input_device *device, const struct input_event *linuxevents, size_t n_linuxevents, uint64_t read_ns) {
+	struct mousepointer_mtslot *active_mtslot;
+	uint64_t display_ns = 0;
+	int j;
+
+	active_mtslot = &device->mtslots[device->i_active_mtslot];
+
+	// the events read now are handled by flutter in the frame that starts at the next vblank,
+	// and that frame is on screen touch_prediction_frames frames later. Predict the pointers to that time.
+	if (touch_prediction_enabled)
+		display_ns = estimate_next_vblank_ns(read_ns) + (uint64_t) (touch_prediction_frames * get_frame_period_ns());
+
+	// the scale factors & transform only change when the display is rotated.
+	if (device->transform_rotation != rotation)
+		update_input_device_transform(device);
+
+	// now go through all linux events and update the state and the evdev batch accordingly.
+	for (int i=0; i < n_linuxevents; i++) {
+		const struct input_event *e = &linuxevents[i];
+
+		// the kernel buffer of the device overflowed. The events up to the next
+		// SYN_REPORT are incomplete, so they're skipped. (see the evdev protocol docs)
+		if ((e->type == EV_SYN) && (e->code == SYN_DROPPED)) {
+			if (device->n_syn_dropped++ == 0)
+				fprintf(stderr, "warning: events of input device \"%s\" were dropped by the kernel.\n", device->name);
+
+			device->skip_until_syn_report = true;
+			continue;
+		} else if (device->skip_until_syn_report) {
+			if ((e->type == EV_SYN) && (e->code == SYN_REPORT))
+				device->skip_until_syn_report = false;
+			continue;
+		}
 	
-	// initialize application
-	printf("Initializing Application...\n");
-	if (!init_application()) {
+		if (e->type == EV_REL) {
+			// pointer moved relatively in the X or Y direction
+			// for now, without a speed multiplier
+
+			double relx = e->code == REL_X ? e->value : 0;
+			double rely = e->code == REL_Y ? e->value : 0;
+
+			mousepointer.x += relx;
+			mousepointer.y += rely;
+
+			// only change the current phase if we don't yet have one.
+			if ((mousepointer.phase == kCancel) && (relx != 0 || rely != 0))
+				mousepointer.phase = device->active_buttons ? kMove : kHover;
+
+		} else if (e->type == EV_ABS) {
+
+			if (e->code == ABS_MT_SLOT) {
+
+				// select a new active mtslot.
+				device->i_active_mtslot = e->value;
+				active_mtslot = &device->mtslots[device->i_active_mtslot];
+
+			} else if (e->code == ABS_MT_POSITION_X || e->code == ABS_X || e->code == ABS_MT_POSITION_Y || e->code == ABS_Y) {
+				double relx = 0, rely = 0;
+				
+				if (e->code == ABS_MT_POSITION_X || (e->code == ABS_X && device->n_mtslots == 1)) {
+					double newx = (e->value - device->xinfo.minimum) * device->xscale;
+					relx = active_mtslot->phase == kDown ? 0 : newx - active_mtslot->x;
+					active_mtslot->x = newx;
+				} else if (e->code == ABS_MT_POSITION_Y || (e->code == ABS_Y && device->n_mtslots == 1)) {
+					double newy = (e->value - device->yinfo.minimum) * device->yscale;
+					rely = active_mtslot->phase == kDown ? 0 : newy - active_mtslot->y;
+					active_mtslot->y = newy;
+				}
+
+				// if the device is associated with the mouse pointer (touchpad), update that pointer.
+				if (relx != 0 || rely != 0) {
+					struct mousepointer_mtslot *slot = active_mtslot;
+
+					if (device->is_pointer) {
+						mousepointer.x += relx;
+						mousepointer.y += rely;
+						slot = &mousepointer;
+					}
+
+					if (slot->phase == kCancel)
+						slot->phase = device->active_buttons ? kMove : kHover;
+				}
+			} else if ((e->code == ABS_MT_TRACKING_ID) && (active_mtslot->id == -1 || e->value == -1)) {
+
+				// id -1 means no id, or no touch. one tracking id is equivalent one continuous touch contact.
+				bool before = device->active_buttons && true;
+
+				if (active_mtslot->id == -1) {
+					active_mtslot->id = e->value;
+					// only set active_buttons if a touch equals a kMove (not kHover, as it is for multitouch touchpads)
+					device->active_buttons |= (device->is_direct ? FLUTTER_BUTTON_FROM_EVENT_CODE(BTN_TOUCH) : 0);
+				} else {
+					active_mtslot->id = -1;
+					device->active_buttons &= ~(device->is_direct ? FLUTTER_BUTTON_FROM_EVENT_CODE(BTN_TOUCH) : 0);
+				}
+
+				if (!before != !device->active_buttons)
+					active_mtslot->phase = before ? kUp : kDown;
+			}
+
+		} else if (e->type == EV_KEY) {
+			
+			// remember if some buttons were pressed before this update
+			bool before = device->active_buttons && true;
+
+			// update the active_buttons bitmap
+			// only apply BTN_TOUCH to the active buttons if a touch really equals a pressed button (device->is_direct is set)
+			//   is_direct is true for touchscreens, but not for touchpads; so BTN_TOUCH doesn't result in a kMove for touchpads
+
+			glfw_key glfw_key = EVDEV_KEY_TO_GLFW_KEY(e->code);
+			if ((glfw_key != GLFW_KEY_UNKNOWN) && (glfw_key != 0)) {
+				glfw_key_action action;
+				switch (e->value) {
+					case 0: action = GLFW_RELEASE; break;
+					case 1: action = GLFW_PRESS; break;
+					case 2: action = GLFW_REPEAT; break;
+					default: action = -1; break;
+				}
+
+				rawkb_on_keyevent(EVDEV_KEY_TO_GLFW_KEY(e->code), 0, action);
+			} else if (e->code != BTN_TOUCH || device->is_direct) {
+				if (e->value == 1) device->active_buttons |=  FLUTTER_BUTTON_FROM_EVENT_CODE(e->code);
+				else               device->active_buttons &= ~FLUTTER_BUTTON_FROM_EVENT_CODE(e->code);
+			}
+
+			// check if the button state changed
+			// if yes, change the current pointer phase
+			if (!before != !device->active_buttons)
+				(device->is_pointer ? &mousepointer : active_mtslot) ->phase = before ? kUp : kDown;
+
+		} else if ((e->type == EV_SYN) && (e->code == SYN_REPORT)) {
+			
+			// We can now summarise the updates we received from the evdev into a FlutterPointerEvent
+			// and put it in the evdev batch.
+			
+			size_t n_slots = 0;
+			struct mousepointer_mtslot *slots;
+			uint64_t timestamp_ns;
+			bool has_events = false;
+
+			timestamp_ns = device->has_monotonic_timestamps ? e->time.tv_sec*1000000000ull + e->time.tv_usec*1000ull : read_ns;
+
+			// if this is a pointer device, we don't care about the multitouch slots & only send the updated mousepointer.
+			if (device->is_pointer) {
+				slots = &mousepointer;
+				n_slots = 1;
+			} else if (device->is_direct) {
+				slots = device->mtslots;
+				n_slots = device->n_mtslots;
+			}
+
+			for (j = 0; j < n_slots; j++) {
+
+				// we don't want to send an event to flutter if nothing changed.
+				if (slots[j].phase == kCancel) continue;
+
+				// convert raw pixel coordinates to flutter pixel coordinates
+				// (applies the calibration & the screen rotation in one step)
+				const double *t = device->transform;
+				double flutterx = t[0] * slots[j].x + t[1] * slots[j].y + t[2];
+				double fluttery = t[3] * slots[j].x + t[4] * slots[j].y + t[5];
+
+				FlutterPointerEvent event = {
+					.struct_size = sizeof(FlutterPointerEvent),
+					.phase = slots[j].phase,
+					.timestamp = timestamp_ns / 1000,
+					.x = flutterx, .y = fluttery,
+					.device = slots[j].flutter_slot_id,
+					.signal_kind = kFlutterPointerSignalKindNone,
+					.scroll_delta_x = 0, .scroll_delta_y = 0,
+					.device_kind = device->kind,
+					.buttons = device->active_buttons & 0xFF
+				};
+
+				if (touch_prediction_enabled)
+					touch_prediction_process(&event, display_ns);
+
+				pointer_event_buffer_push(&evdev_batch.events, &event);
+
+				slots[j].phase = kCancel;
+				has_events = true;
+			}
+
+			if (has_events && device->has_monotonic_timestamps && (evdev_batch.n_inputs < EVDEV_BATCH_MAX_INPUTS)) {
+				evdev_batch.input_ns[evdev_batch.n_inputs] = timestamp_ns;
+				evdev_batch.read_ns[evdev_batch.n_inputs] = read_ns;
+				evdev_batch.n_inputs++;
+			}
+		}
+	}
+}
+/// Only puts the device into the list of ready devices. They're all read by drain_evdev_input
+/// once the io thread handled all ready fds, so the devices can take turns.
+void  on_evdev_input(void *userdata, uint32_t epoll_events) {
+	struct input_device *device = userdata, **tail;
+
+	if (device->is_ready) return;
+
+	for (tail = &ready_input_devices; *tail != NULL; tail = &(*tail)->next_ready);
+
+	device->next_ready = NULL;
+	device->is_ready = true;
+	*tail = device;
+}
+
+enum evdev_read_result {
+	kEvdevReadMore,
+	kEvdevReadDrained,
+	kEvdevReadClosed
+};
+
+/// Reads & processes one buffer full of events of device.
+/// If the device was removed (or reading failed), closes it.
+static enum evdev_read_result read_evdev_input(struct input_device *device) {
+	// Every read is converted to flutter events before the next one, and everything that spans
+	// reads (like the multitouch slots or a report cut in half) is kept in the device, so one buffer is enough for all devices.
+	static struct input_event linuxevents[EVDEV_READ_BUFFER_SIZE];
+	size_t n_linuxevents;
+	uint64_t read_ns;
+	int ok;
+
+	ok = read(device->fd, linuxevents, sizeof(linuxevents));
+	if (ok == -1) {
+		if (errno == EAGAIN) return kEvdevReadDrained;
+		if (errno == EINTR) return kEvdevReadMore;
+
+		// ENODEV means the device was unplugged.
+		if (errno != ENODEV) {
+			fprintf(stderr, "error reading input events from device \"%s\" with path \"%s\": %s\n",
+					device->name, device->path, strerror(errno));
+		}
+		close_input_device(device);
+		return kEvdevReadClosed;
+	} else if (ok == 0) {
+		fprintf(stderr, "reached EOF for input device \"%s\" with path \"%s\"\n",
+				device->name, device->path);
+		close_input_device(device);
+		return kEvdevReadClosed;
+	}
+	n_linuxevents = ok / sizeof(struct input_event);
+	read_ns = FlutterEngineGetCurrentTime();
+
+	if (device->recording_index >= 0)
+		input_recording_write_events(device->recording_index, linuxevents, n_linuxevents, device->has_monotonic_timestamps, read_ns);
+
+	process_evdev_events(device, linuxevents, n_linuxevents, read_ns);
+
+	// the kernel had less events than fit in the buffer, so the device is drained.
+	// No need for another read to find that out.
+	return n_linuxevents < EVDEV_READ_BUFFER_SIZE ? kEvdevReadDrained : kEvdevReadMore;
+}
+
+/// Drains the devices that were ready in this wake round-robin, one read per device and round,
+/// so a device flooding us with events can't starve the others. Devices that still have events
+/// after EVDEV_MAX_READS_PER_WAKE rounds are read again in the next wake.
+void  drain_evdev_input(void) {
+	struct input_device **cursor, *device;
+
+	for (int round = 0; (round < EVDEV_MAX_READS_PER_WAKE) && (ready_input_devices != NULL); round++) {
+		cursor = &ready_input_devices;
+		while (*cursor != NULL) {
+			device = *cursor;
+
+			switch (read_evdev_input(device)) {
+				case kEvdevReadMore:
+					cursor = &device->next_ready;
+					break;
+				case kEvdevReadDrained:
+					device->is_ready = false;
+					*cursor = device->next_ready;
+					break;
+				case kEvdevReadClosed:
+					// close_input_device already removed the device from the list, *cursor is the next one.
+					break;
+			}
+		}
+	}
+
+	for (device = ready_input_devices; device != NULL; device = device->next_ready)
+		device->is_ready = false;
+
+	ready_input_devices = NULL;
+}
+/// Sends all the pointer & key events collected by the input handlers since the last flush
+/// to flutter, in one go. Called by the io thread once all ready fds were handled.
+void  flush_evdev_input(void) {
+	uint64_t handoff_ns;
+	size_t start;
+
+	// all key events are sent to flutter with a single platform task.
+	// (console text input is edited & sent on the platform thread, see process_console_input)
+	rawkb_flush_keyevents();
+
+	if (evdev_batch.events.n_events == 0) return;
+
+	if (!send_pointer_events(evdev_batch.events.events, evdev_batch.events.n_events)) {
+		fprintf(stderr, "could not send pointer events to flutter engine\n");
+	}
+
+	if (input_latency.enabled) {
+		handoff_ns = FlutterEngineGetCurrentTime();
+
+		// record the inputs grouped by the read they came from.
+		for (size_t i = 0; i < evdev_batch.n_inputs; i = start) {
+			for (start = i + 1; (start < evdev_batch.n_inputs) && (evdev_batch.read_ns[start] == evdev_batch.read_ns[i]); start++);
+			latency_record_input(evdev_batch.input_ns + i, start - i, evdev_batch.read_ns[i], handoff_ns);
+		}
+	}
+
+	evdev_batch.events.n_events = 0;
+	evdev_batch.n_inputs = 0;
+}
+/// The console input the io thread read, but the platform thread didn't process yet.
+/// The text input state is only touched on the platform thread (where the text input plugin
+/// receives its messages), so the io thread only reads stdin and hands the bytes over.
+struct {
+	pthread_mutex_t lock;
+	char *data;
+	size_t size, capacity;
+	// whether a kProcessConsoleInput task is already posted for the pending bytes.
+	bool is_scheduled;
+} console_input = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void on_console_text(const char *utf8, size_t n_bytes, void *userdata) {
+	textin_on_utf8_text(utf8, n_bytes);
+}
+static void on_console_key(glfw_key key, void *userdata) {
+	textin_on_key(key);
+}
+/// Called by the io thread when stdin is readable.
+void  on_console_input(void) {
+	char buffer[4096], *data;
+	size_t capacity;
+	bool schedule = false;
+	ssize_t ok;
+
+	ok = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if ((ok == -1) && ((errno == EAGAIN) || (errno == EINTR))) {
+		return;
+	} else if (ok <= 0) {
+		if (ok == -1) perror("could not read from stdin");
+		else fprintf(stderr, "warning: reached EOF for stdin\n");
+
+		// stdin would stay readable (epoll is level-triggered), so stop watching it.
+		fprintf(stderr, "Console text input is disabled from now on.\n");
+		epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+		return;
+	}
+
+	pthread_mutex_lock(&console_input.lock);
+
+	if (console_input.size + ok > console_input.capacity) {
+		capacity = console_input.capacity ? console_input.capacity * 2 : sizeof(buffer);
+		while (capacity < console_input.size + ok) capacity *= 2;
+
+		data = realloc(console_input.data, capacity);
+		if (data == NULL) {
+			pthread_mutex_unlock(&console_input.lock);
+			fprintf(stderr, "[console input] Out of memory, dropping %zd bytes of console input.\n", ok);
+			return;
+		}
+
+		console_input.data = data;
+		console_input.capacity = capacity;
+	}
+
+	memcpy(console_input.data + console_input.size, buffer, ok);
+	console_input.size += ok;
+
+	// all bytes read until the platform thread gets to them are processed by one task,
+	// so there's one editing state update per batch and the input stays in order.
+	if (!console_input.is_scheduled) {
+		console_input.is_scheduled = true;
+		schedule = true;
+	}
+
+	pthread_mutex_unlock(&console_input.lock);
+
+	if (schedule) {
+		post_platform_task(&(struct flutterpi_task) {
+			.type = kProcessConsoleInput,
+			.target_time = 0
+		});
+	}
+}
+/// Called on the platform thread. Parses the pending console input, edits the text input state
+/// accordingly and sends the new editing state to flutter once.
+void  process_console_input(void) {
+	// the unparsed rest of the last batch (a control sequence or UTF-8 character
+	// that was split across two reads) is kept at the start of the buffer.
+	static char *buffer = NULL;
+	static size_t n_buffered = 0, capacity = 0;
+	size_t n_parsed;
+	char *new_buffer;
+
+	pthread_mutex_lock(&console_input.lock);
+
+	if (n_buffered + console_input.size > capacity) {
+		new_buffer = realloc(buffer, n_buffered + console_input.size);
+		if (new_buffer == NULL) {
+			console_input.size = 0;
+			console_input.is_scheduled = false;
+			pthread_mutex_unlock(&console_input.lock);
+			fprintf(stderr, "[console input] Out of memory, dropping console input.\n");
+			return;
+		}
+
+		buffer = new_buffer;
+		capacity = n_buffered + console_input.size;
+	}
+
+	memcpy(buffer + n_buffered, console_input.data, console_input.size);
+	n_buffered += console_input.size;
+
+	console_input.size = 0;
+	console_input.is_scheduled = false;
+
+	pthread_mutex_unlock(&console_input.lock);
+
+	n_parsed = console_parse_input(buffer, n_buffered, on_console_text, on_console_key, NULL);
+
+	// a split sequence can't be longer than a few bytes. If it is, it's garbage.
+	if (n_buffered - n_parsed > 16) n_parsed = n_buffered;
+
+	memmove(buffer, buffer + n_parsed, n_buffered - n_parsed);
+	n_buffered -= n_parsed;
+
+	// all the edits of this batch are sent to flutter with a single editing state update.
+	textin_flush_editing_state();
+}
+/// Returns true if path matches one of the input device glob patterns.
+bool  matches_input_device_patterns(const char *path) {
+	glob_t matches;
+	bool matched = false;
+
+	for (int i = 0; (i < n_input_device_patterns) && !matched; i++) {
+		matches = (glob_t) {0};
+		if (glob(input_device_patterns[i], GLOB_BRACE | GLOB_TILDE, NULL, &matches) != 0)
+			continue;
+
+		for (int j = 0; (j < matches.gl_pathc) && !matched; j++)
+			matched = strcmp(matches.gl_pathv[j], path) == 0;
+
+		globfree(&matches);
+	}
+
+	return matched;
+}
+void  on_input_hotplug(void *userdata, uint32_t epoll_events) {
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	struct input_device *dev, **tail;
+	FlutterPointerEvent *events;
+	const char *dir;
+	size_t n_events;
+	ssize_t n_read;
+
+	while ((n_read = read(input_hotplug.inotify_fd, buffer, sizeof(buffer))) > 0) {
+		for (char *cursor = buffer; cursor < buffer + n_read;) {
+			struct inotify_event *event = (struct inotify_event *) cursor;
+			cursor += sizeof(struct inotify_event) + event->len;
+
+			if ((event->len == 0) || (event->mask & IN_ISDIR))
+				continue;
+
+			dir = NULL;
+			for (int i = 0; i < input_hotplug.n_watches; i++)
+				if (input_hotplug.watches[i].wd == event->wd)
+					dir = input_hotplug.watches[i].dir;
+
+			if (dir == NULL) continue;
+
+			snprintf(path, sizeof(path), "%s/%s", dir, event->name);
+
+			// udev creates the device node first and changes its permissions afterwards (IN_ATTRIB),
+			// so we might not be able to open it on IN_CREATE yet.
+			if (access(path, R_OK) != 0)
+				continue;
+
+			for (tail = &input_devices; *tail != NULL; tail = &(*tail)->next)
+				if (strcmp((*tail)->path, path) == 0)
+					break;
+
+			// already opened
+			if (*tail != NULL) continue;
+
+			if (!matches_input_device_patterns(path))
+				continue;
+
+			printf("new input device:\n");
+			dev = open_input_device(path);
+
+			if (input_device_cache.enabled)
+				input_cache_write();
+
+			if (dev == NULL) continue;
+
+			if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, dev->fd, &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &dev->io}) != 0) {
+				perror("could not add input device to epoll instance");
+				close(dev->fd);
+				free(dev->mtslots);
+				free(dev);
+				continue;
+			}
+
+			*tail = dev;
+
+			events = malloc(dev->n_mtslots * sizeof(FlutterPointerEvent));
+			if (events != NULL) {
+				n_events = get_mtslot_events(dev, kAdd, events, dev->n_mtslots);
+				if ((n_events > 0) && !send_pointer_events(events, n_events))
+					fprintf(stderr, "could not send pointer kAdd events to flutter engine\n");
+				free(events);
+			}
+		}
+	}
+}
+/// Watches the directories of the input device glob patterns, so input devices
+/// plugged in after startup are picked up. Patterns with wildcards in their directory part are not watched.
+bool  init_input_hotplug(void) {
+	struct input_hotplug_watch *watches;
+	char dir[PATH_MAX];
+	char *last_slash;
+	int wd;
+
+	input_hotplug.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (input_hotplug.inotify_fd < 0) {
+		perror("could not create inotify instance for input device hotplug");
+		return false;
+	}
+
+	for (int i = 0; i < n_input_device_patterns; i++) {
+		snprintf(dir, sizeof(dir), "%s", input_device_patterns[i]);
+
+		last_slash = strrchr(dir, '/');
+		if ((last_slash == NULL) || (last_slash == dir)) continue;
+		*last_slash = '\0';
+
+		if (strpbrk(dir, "*?[{~") != NULL) {
+			LOG_VERBOSE("Not watching \"%s\" for new input devices, since its directory contains wildcards.\n", input_device_patterns[i]);
+			continue;
+		}
+
+		wd = inotify_add_watch(input_hotplug.inotify_fd, dir, IN_CREATE | IN_ATTRIB | IN_ONLYDIR);
+		if (wd < 0) {
+			fprintf(stderr, "could not watch \"%s\" for new input devices: %s\n", dir, strerror(errno));
+			continue;
+		}
+
+		watches = realloc(input_hotplug.watches, (input_hotplug.n_watches + 1) * sizeof(*watches));
+		if (watches == NULL) continue;
+
+		input_hotplug.watches = watches;
+		input_hotplug.watches[input_hotplug.n_watches].wd = wd;
+		snprintf(input_hotplug.watches[input_hotplug.n_watches].dir, sizeof(input_hotplug.watches[0].dir), "%s", dir);
+		input_hotplug.n_watches++;
+	}
+
+	input_hotplug.io = (struct io_handler) {
+		.on_ready = on_input_hotplug,
+		.userdata = NULL
+	};
+
+	if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, input_hotplug.inotify_fd, &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &input_hotplug.io}) != 0) {
+		perror("could not add input device hotplug inotify instance to epoll instance");
+		return false;
+	}
+
+	return true;
+}
+void  on_console_fd_ready(void *userdata, uint32_t epoll_events) {
+	on_console_input();
+}
+void  on_shader_cache_fd_ready(void *userdata, uint32_t epoll_events) {
+	shader_cache_on_fd_ready();
+}
+void  on_latency_signal_fd_ready(void *userdata, uint32_t epoll_events) {
+	latency_on_signal_fd_ready();
+}
+void *io_loop(void *userdata) {
+	static struct io_handler console_io = {.on_ready = on_console_fd_ready};
+	static struct io_handler shader_cache_io = {.on_ready = on_shader_cache_fd_ready};
+	static struct io_handler latency_io = {.on_ready = on_latency_signal_fd_ready};
+	struct epoll_event events[16];
+	struct io_handler *handler;
+	int n_events;
+
+	io_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (io_epoll_fd < 0) {
+		perror("could not create epoll instance for the io thread");
+		return NULL;
+	}
+
+	// every fd gets its io_handler as the epoll userdata, so there's no need
+	// to search for the device that got new data.
+	for (struct input_device *dev = input_devices; dev != NULL; dev = dev->next) {
+		if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, dev->fd, &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &dev->io}) != 0) {
+			fprintf(stderr, "could not add input device \"%s\" to epoll instance: %s\n", dev->path, strerror(errno));
+		}
+	}
+
+	// text input is read from the console. (probe_input_devices made it raw)
+	// If stdin is a regular file or /dev/null, epoll refuses it with EPERM. Nobody's typing there anyway.
+	if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &console_io}) != 0) {
+		if (errno != EPERM) perror("could not add stdin to epoll instance");
+		LOG_VERBOSE("Console text input is disabled, since stdin can't be watched.\n");
+	}
+
+	if (shader_cache_get_fd() >= 0) {
+		if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, shader_cache_get_fd(), &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &shader_cache_io}) != 0) {
+			perror("could not add shader cache inotify instance to epoll instance");
+		}
+	}
+
+	if (latency_get_signal_fd() >= 0) {
+		if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, latency_get_signal_fd(), &(struct epoll_event) {.events = EPOLLIN, .data.ptr = &latency_io}) != 0) {
+			perror("could not add latency signalfd to epoll instance");
+		}
+	}
+
+	// when replaying an input recording, its devices are the only input devices.
+	if (!input_recording.replay && !init_input_hotplug()) {
+		fprintf(stderr, "Input devices plugged in from now on won't be picked up.\n");
+	}
+
+	while (engine_running) {
+		n_events = epoll_wait(io_epoll_fd, events, sizeof(events) / sizeof(*events), -1);
+		if (n_events == -1) {
+			if (errno == EINTR) continue;
+
+			perror("error while waiting for I/O");
+			return NULL;
+		}
+
+		// A handler may only close its own fd (like an input device that was unplugged),
+		// and epoll reports every fd at most once per call, so the handlers of the other events are still valid.
+		for (int i = 0; i < n_events; i++) {
+			handler = events[i].data.ptr;
+			handler->on_ready(handler->userdata, events[i].events);
+		}
+
+		// the input of all devices that were ready is sent to flutter in one batch.
+		drain_evdev_input();
+		flush_evdev_input();
+	}
+
+	return NULL;
+}
+bool  run_io_thread(void) {
+	int ok = pthread_create(&io_thread_id, NULL, &io_loop, NULL);
+	if (ok != 0) {
+		fprintf(stderr, "couldn't create flutter-pi io thread: [%s]", strerror(ok));
+		return false;
+	}
+
+	ok = pthread_setname_np(io_thread_id, "io.flutter-pi");
+	if (ok != 0) {
+		fprintf(stderr, "couldn't set name of flutter-pi io thread: [%s]", strerror(ok));
+		return false;
+	}
+
+	return true;
+}
+
+/// The DRM events (pageflips) are handled on their own thread, so a burst of input events
+/// can't delay the kVBlankReply the next frame is waiting for.
+/// The pageflip handler only does the vsync bookkeeping, everything else is posted to the platform thread.
+void *drm_event_loop(void *userdata) {
+	struct pollfd fds[2] = {
+		{.fd = drm.fd, .events = POLLIN},
+		{.fd = drm_thread_wakeup_fd, .events = POLLIN}
+	};
+	int ok;
+
+	while (true) {
+		ok = poll(fds, 2, -1);
+		if (ok == -1) {
+			if (errno == EINTR) continue;
+
+			perror("error while waiting for DRM events");
+			return NULL;
+		}
+
+		// stop_drm_thread was called.
+		if (fds[1].revents & POLLIN)
+			return NULL;
+
+		if (fds[0].revents & POLLIN)
+			drmHandleEvent(drm.fd, &drm.evctx);
+	}
+
+	return NULL;
+}
+bool  run_drm_thread(void) {
+	pthread_attr_t attr;
+	int ok;
+
+	drm_thread_wakeup_fd = eventfd(0, EFD_CLOEXEC);
+	if (drm_thread_wakeup_fd < 0) {
+		perror("couldn't create eventfd for the flutter-pi DRM event thread");
+		return false;
+	}
+
+	// try to run the DRM event thread with real-time priority, so it's scheduled
+	// as soon as the pageflip completes, even if the CPUs are busy.
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &(struct sched_param) {.sched_priority = DRM_THREAD_PRIORITY});
+
+	ok = pthread_create(&drm_thread_id, &attr, &drm_event_loop, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (ok == EPERM) {
+		printf("[flutter-pi] no permission to use real-time scheduling, running the DRM event thread with normal priority.\n");
+		ok = pthread_create(&drm_thread_id, NULL, &drm_event_loop, NULL);
+	}
+
+	if (ok != 0) {
+		fprintf(stderr, "couldn't create flutter-pi DRM event thread: [%s]", strerror(ok));
+		return false;
+	}
+
+	ok = pthread_setname_np(drm_thread_id, "drm.flutter-pi");
+	if (ok != 0) {
+		fprintf(stderr, "couldn't set name of flutter-pi DRM event thread: [%s]", strerror(ok));
+		return false;
+	}
+
+	return true;
+}
+/// Stops the DRM event thread and waits for it to exit, so no pageflip
+/// is handled anymore while the engine & the display are destroyed.
+void  stop_drm_thread(void) {
+	if (drm_thread_wakeup_fd < 0) return;
+
+	eventfd_write(drm_thread_wakeup_fd, 1);
+	pthread_join(drm_thread_id, NULL);
+
+	close(drm_thread_wakeup_fd);
+	drm_thread_wakeup_fd = -1;
+}
+
+
+void  add_input_device_pattern(const char *pattern) {
+	const char **patterns;
+
+	patterns = realloc(input_device_patterns, (n_input_device_patterns + 1) * sizeof(*patterns));
+	if (patterns == NULL) return;
+
+	input_device_patterns = patterns;
+	input_device_patterns[n_input_device_patterns++] = pattern;
+}
+bool  add_calibration_matrix(const char *arg) {
+	struct calibration_matrix *matrices;
+	double matrix[6];
+	const char *rest;
+
+	rest = parse_calibration_matrix(arg, matrix);
+	if ((rest == NULL) || ((*rest != '\0') && (*rest != '@')))
+		return false;
+
+	matrices = realloc(calibration_matrices, (n_calibration_matrices + 1) * sizeof(*matrices));
+	if (matrices == NULL) return false;
+
+	calibration_matrices = matrices;
+	memcpy(calibration_matrices[n_calibration_matrices].matrix, matrix, sizeof(matrix));
+	calibration_matrices[n_calibration_matrices].pattern = *rest == '@' ? rest + 1 : NULL;
+	n_calibration_matrices++;
+
+	return true;
+}
+bool  parse_cmd_args(int argc, char **argv) {
+	bool input_specified = false;
+	double prediction_frames;
+	char *endptr;
+	int ok, opt, index = 0;
+	input_devices_glob = (glob_t) {0};
+
+	enum {
+		kOptionDisplayCache = 0x100,
+		kOptionCacheDir,
+		kOptionTimeline,
+		kOptionSdNotify,
+		kOptionPrefetchList,
+		kOptionPrefetchMlock,
+		kOptionPointerResampling,
+		kOptionLatencyStats,
+		kOptionLatencyOverlay,
+		kOptionRecordInput,
+		kOptionReplayInput,
+		kOptionReplaySpeed,
+		kOptionTouchPrediction,
+		kOptionInputClasses,
+		kOptionInputCache,
+		kOptionCalibrationMatrix
+	};
+
+	const struct option long_options[] = {
+		{"input",         required_argument, NULL, 'i'},
+		{"display-cache", required_argument, NULL, kOptionDisplayCache},
+		{"cache-dir",     required_argument, NULL, kOptionCacheDir},
+		{"timeline",      required_argument, NULL, kOptionTimeline},
+		{"sd-notify",     no_argument,       NULL, kOptionSdNotify},
+		{"prefetch-list", required_argument, NULL, kOptionPrefetchList},
+		{"prefetch-mlock", no_argument,      NULL, kOptionPrefetchMlock},
+		{"pointer-resampling", no_argument,  NULL, kOptionPointerResampling},
+		{"latency-stats", no_argument,       NULL, kOptionLatencyStats},
+		{"latency-overlay", no_argument,     NULL, kOptionLatencyOverlay},
+		{"record-input",  required_argument, NULL, kOptionRecordInput},
+		{"replay-input",  required_argument, NULL, kOptionReplayInput},
+		{"replay-speed",  required_argument, NULL, kOptionReplaySpeed},
+		{"touch-prediction", required_argument, NULL, kOptionTouchPrediction},
+		{"input-classes", required_argument, NULL, kOptionInputClasses},
+		{"input-cache",   required_argument, NULL, kOptionInputCache},
+		{"calibration-matrix", required_argument, NULL, kOptionCalibrationMatrix},
+		{"verbose",       no_argument,       NULL, 'v'},
+		{"help",          no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	while ((opt = getopt_long(argc, (char *const *) argv, "+i:vh", long_options, NULL)) != -1) {
+		index++;
+		switch(opt) {
+			case 'i':
+				input_specified = true;
+				glob(optarg, GLOB_BRACE | GLOB_TILDE | (input_specified ? GLOB_APPEND : 0), NULL, &input_devices_glob);
+				add_input_device_pattern(optarg);
+				index++;
+				break;
+			case kOptionDisplayCache:
+				snprintf(display_cache.path, sizeof(display_cache.path), "%s", optarg);
+				display_cache.enabled = true;
+				index++;
+				break;
+			case kOptionCacheDir:
+				snprintf(flutter.cache_dir, sizeof(flutter.cache_dir), "%s", optarg);
+				index++;
+				break;
+			case kOptionTimeline:
+				snprintf(startup_timeline.report_path, sizeof(startup_timeline.report_path), "%s", optarg);
+				startup_timeline.write_report = true;
+				index++;
+				break;
+			case kOptionSdNotify:
+				startup_timeline.notify_systemd = true;
+				break;
+			case kOptionPrefetchList:
+				snprintf(flutter.prefetch_list_path, sizeof(flutter.prefetch_list_path), "%s", optarg);
+				flutter.has_prefetch_list = true;
+				index++;
+				break;
+			case kOptionPrefetchMlock:
+				flutter.prefetch_mlock = true;
+				break;
+			case kOptionPointerResampling:
+				pointer_resampling = true;
+				break;
+			case kOptionLatencyStats:
+				input_latency.enabled = true;
+				break;
+			case kOptionLatencyOverlay:
+				input_latency.enabled = true;
+				input_latency.overlay = true;
+				break;
+			case kOptionRecordInput:
+			case kOptionReplayInput:
+				if (input_recording.record || input_recording.replay) {
+					fprintf(stderr, "error: --record-input and --replay-input can only be given once, and not together.\n");
+					return false;
+				}
+
+				snprintf(input_recording.path, sizeof(input_recording.path), "%s", optarg);
+				input_recording.record = opt == kOptionRecordInput;
+				input_recording.replay = opt == kOptionReplayInput;
+				index++;
+				break;
+			case kOptionReplaySpeed:
+				errno = 0;
+				input_recording.replay_speed = strtod(optarg, &endptr);
+				if ((errno != 0) || (endptr == optarg) || (*endptr != '\0') || !(input_recording.replay_speed >= 0)) {
+					fprintf(stderr, "error: invalid replay speed \"%s\". Expected a number >= 0.\n", optarg);
+					return false;
+				}
+				index++;
+				break;
+			case kOptionTouchPrediction:
+				errno = 0;
+				prediction_frames = strtod(optarg, &endptr);
+				if ((errno != 0) || (endptr == optarg) || (*endptr != '\0') || !(prediction_frames >= 0) || (prediction_frames > 10)) {
+					fprintf(stderr, "error: invalid number of touch prediction frames \"%s\". Expected a number between 0 and 10.\n", optarg);
+					return false;
+				}
+
+				touch_prediction_enabled = true;
+				touch_prediction_frames = prediction_frames;
+				index++;
+				break;
+			case kOptionInputClasses:
+				if (!parse_input_device_classes(optarg, &input_device_classes)) {
+					fprintf(stderr, "error: invalid list of input device classes \"%s\".\n", optarg);
+					return false;
+				}
+				index++;
+				break;
+			case kOptionInputCache:
+				snprintf(input_device_cache.path, sizeof(input_device_cache.path), "%s", optarg);
+				input_device_cache.enabled = true;
+				index++;
+				break;
+			case kOptionCalibrationMatrix:
+				ok = add_calibration_matrix(optarg);
+				if (!ok) {
+					fprintf(stderr, "error: invalid calibration matrix \"%s\". Expected 6 numbers, optionally followed by @<glob pattern>.\n", optarg);
+					return false;
+				}
+				index++;
+				break;
+			case 'v':
+				verbose = true;
+				break;
+			case 'h':
+			default:
+				printf("%s", usage);
+				return false;
+		}
+	}
+	
+	if (!input_specified) {
+		// user specified no input devices. use /dev/input/event*.
+		glob("/dev/input/event*", GLOB_BRACE | GLOB_TILDE, NULL, &input_devices_glob);
+		add_input_device_pattern("/dev/input/event*");
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "error: expected asset bundle path after options.\n");
+		printf("%s", usage);
+		return false;
+	}
+
+	snprintf(flutter.asset_bundle_path, sizeof(flutter.asset_bundle_path), "%s", argv[optind]);
+
+	argv[optind] = argv[0];
+	flutter.engine_argc = argc-optind;
+	flutter.engine_argv = (const char* const*) &(argv[optind]);
+
+	for (int i=0; i<flutter.engine_argc; i++)
+		printf("engine_argv[%i] = %s\n", i, flutter.engine_argv[i]);
+	
+	return true;
+}
+int   main(int argc, char **argv) {
+	int timeline_id;
+
+	timeline_init();
+
+	timeline_id = timeline_begin("parse arguments");
+	if (!parse_cmd_args(argc, argv)) {
+		return EXIT_FAILURE;
+	}
+	timeline_end(timeline_id);
+
+	// check if asset bundle path is valid
+	timeline_id = timeline_begin("setup paths");
+	if (!setup_paths()) {
+		return EXIT_FAILURE;
+	}
+	timeline_end(timeline_id);
+
+	if (!prefetch_init(flutter.asset_bundle_path, flutter.has_prefetch_list ? flutter.prefetch_list_path : NULL, flutter.prefetch_mlock)) {
+		return EXIT_FAILURE;
+	}
+
+	if (input_recording.record && !input_recording_start(input_recording.path)) {
+		return EXIT_FAILURE;
+	}
+
+	if (input_recording.replay && !input_replay_load(input_recording.path, input_recording.replay_speed)) {
+		return EXIT_FAILURE;
+	}
+
+	if (input_device_cache.enabled && !input_cache_load(input_device_cache.path)) {
+		return EXIT_FAILURE;
+	}
+
+	if (!init_message_loop()) {
 		return EXIT_FAILURE;
 	}
 
-	printf("Initializing Input devices...\n");
-	init_io();
+	if (pointer_resampling)
+		pointer_resampler_init(schedule_pointer_flush);
+
+	// needs to be called before any other thread is created, see latency_init.
+	if (input_latency.enabled && !latency_init()) {
+		return EXIT_FAILURE;
+	}
+
+	// Initialize the display, the plugins & the input devices concurrently.
+	// The engine needs the display (EGL) & the plugins, and the pointer kAdd events
+	// need the engine to be running. FlutterEngineRun needs to be called on the platform thread.
+	enum {
+		kStepPrefetch, kStepDisplay, kStepPlugins, kStepInputDevices, kStepEngine, kStepPointerAdd
+	};
+
+	struct startup_step steps[] = {
+		[kStepPrefetch] = {
+			.name = "prefetch snapshot & ICU data",
+			.run = prefetch_engine_files
+		},
+		[kStepDisplay] = {
+			.name = "initialize display",
+			.run = init_display
+		},
+		[kStepPlugins] = {
+			.name = "initialize plugins",
+			.run = init_plugins
+		},
+		[kStepInputDevices] = {
+			.name = "probe input devices",
+			.run = probe_input_devices
+		},
+		[kStepEngine] = {
+			.name = "run flutter engine",
+			.run = init_application,
+			.dependencies = STARTUP_DEPENDENCY(kStepDisplay) | STARTUP_DEPENDENCY(kStepPlugins),
+			.on_calling_thread = true
+		},
+		[kStepPointerAdd] = {
+			.name = "send pointer kAdd events",
+			.run = send_pointer_add_events,
+			.dependencies = STARTUP_DEPENDENCY(kStepEngine) | STARTUP_DEPENDENCY(kStepInputDevices),
+			.on_calling_thread = true
+		}
+	};
+
+	if (!startup_run(steps, sizeof(steps) / sizeof(*steps))) {
+		return EXIT_FAILURE;
+	}
 	
+	// handle pageflips
+	printf("Running DRM event thread...\n");
+	if (!run_drm_thread()) {
+		return EXIT_FAILURE;
+	}
+
 	// read input events
 	printf("Running IO thread...\n");
 	run_io_thread();
@@ -1844,6 +3768,8 @@ int   main(int argc, char **argv) {
 	message_loop();
 
 	// exit
+	stop_drm_thread();
+	console_restore();
 	destroy_application();
 	destroy_display();
 	
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <input_cache.h>
+
+/// The number of keys every entry needs to have. (abs lines are optional)
+#define INPUT_CACHE_N_KEYS 9
+
+struct input_cache_entry {
+	char path[PATH_MAX];
+	dev_t rdev;
+	uint64_t fingerprint;
+	struct input_device_caps caps;
+};
+
+struct {
+	char path[PATH_MAX];
+
+	struct input_cache_entry *entries;
+	size_t n_entries;
+
+	/// true if an entry was added or updated since the cache was read.
+	bool dirty;
+} input_cache = {0};
+
+
+/// Hashes the modalias of the input device with the device number rdev (FNV-1a).
+/// The modalias contains the bus type, vendor, product & version, and all the
+/// event bits of the device, and can be read from sysfs without opening the device.
+static bool get_fingerprint(dev_t rdev, uint64_t *fingerprint_out) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	char path[64];
+	FILE *file;
+	int c;
+
+	snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device/modalias", major(rdev), minor(rdev));
+
+	file = fopen(path, "r");
+	if (file == NULL) return false;
+
+	while ((c = fgetc(file)) != EOF) {
+		hash ^= (uint8_t) c;
+		hash *= 0x100000001b3ull;
+	}
+
+	fclose(file);
+
+	*fingerprint_out = hash;
+	return true;
+}
+
+static struct input_cache_entry *find_entry(const char *path) {
+	for (size_t i = 0; i < input_cache.n_entries; i++) {
+		if (strcmp(input_cache.entries[i].path, path) == 0)
+			return input_cache.entries + i;
+	}
+
+	return NULL;
+}
+
+static struct input_cache_entry *add_entry(void) {
+	struct input_cache_entry *entries;
+
+	entries = realloc(input_cache.entries, (input_cache.n_entries + 1) * sizeof(*entries));
+	if (entries == NULL) return NULL;
+
+	input_cache.entries = entries;
+	memset(entries + input_cache.n_entries, 0, sizeof(*entries));
+
+	return entries + input_cache.n_entries++;
+}
+
+static bool parse_bits(const char *value, uint32_t *bits, size_t n_words) {
+	char *end;
+
+	for (size_t i = 0; i < n_words; i++) {
+		bits[i] = strtoul(value, &end, 16);
+		if (end == value) return false;
+		value = end;
+	}
+
+	return true;
+}
+
+static void write_bits(FILE *file, const char *key, const uint32_t *bits, size_t n_words) {
+	fprintf(file, "%s=", key);
+	for (size_t i = 0; i < n_words; i++)
+		fprintf(file, i == 0 ? "%x" : " %x", bits[i]);
+	fputc('\n', file);
+}
+
+#define N_WORDS(array) (sizeof(array) / sizeof(*(array)))
+
+bool input_cache_load(const char *path) {
+	struct input_cache_entry *entry = NULL;
+	struct input_absinfo absinfo;
+	unsigned int version = 0, n_keys = 0, code;
+	char line[PATH_MAX + 64];
+	char *value;
+	FILE *file;
+	bool valid = true;
+
+	snprintf(input_cache.path, sizeof(input_cache.path), "%s", path);
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			fprintf(stderr, "[input cache] Could not open input cache \"%s\": %s\n", path, strerror(errno));
+		return true;
+	}
+
+	while (valid && (fgets(line, sizeof(line), file) != NULL)) {
+		if ((line[0] == '#') || ((value = strchr(line, '=')) == NULL))
+			continue;
+
+		*value++ = '\0';
+		value[strcspn(value, "\n")] = '\0';
+
+		if (strcmp(line, "version") == 0) {
+			version = strtoul(value, NULL, 10);
+			continue;
+		} else if (strcmp(line, "device") == 0) {
+			// a new entry starts. Drop the last one if it was incomplete.
+			if ((entry != NULL) && (n_keys != INPUT_CACHE_N_KEYS))
+				input_cache.n_entries--;
+
+			entry = add_entry();
+			if (entry == NULL) {
+				fclose(file);
+				return false;
+			}
+
+			snprintf(entry->path, sizeof(entry->path), "%s", value);
+			n_keys = 1;
+			continue;
+		} else if (entry == NULL) {
+			valid = false;
+			continue;
+		}
+
+		n_keys++;
+		if (strcmp(line, "rdev") == 0) {
+			entry->rdev = strtoull(value, NULL, 10);
+		} else if (strcmp(line, "fingerprint") == 0) {
+			entry->fingerprint = strtoull(value, NULL, 16);
+		} else if (strcmp(line, "name") == 0) {
+			snprintf(entry->caps.name, sizeof(entry->caps.name), "%s", value);
+		} else if (strcmp(line, "id") == 0) {
+			if (sscanf(value, "%hx %hx %hx %hx", &entry->caps.input_id.bustype, &entry->caps.input_id.vendor,
+					   &entry->caps.input_id.product, &entry->caps.input_id.version) != 4)
+				n_keys--;
+		} else if (strcmp(line, "absbits") == 0) {
+			if (!parse_bits(value, entry->caps.absbits, N_WORDS(entry->caps.absbits))) n_keys--;
+		} else if (strcmp(line, "relbits") == 0) {
+			if (!parse_bits(value, entry->caps.relbits, N_WORDS(entry->caps.relbits))) n_keys--;
+		} else if (strcmp(line, "keybits") == 0) {
+			if (!parse_bits(value, entry->caps.keybits, N_WORDS(entry->caps.keybits))) n_keys--;
+		} else if (strcmp(line, "props") == 0) {
+			if (!parse_bits(value, entry->caps.props, N_WORDS(entry->caps.props))) n_keys--;
+		} else if (strcmp(line, "abs") == 0) {
+			n_keys--;
+			if ((sscanf(value, "%x %d %d %d %d %d %d", &code, &absinfo.value, &absinfo.minimum, &absinfo.maximum,
+						&absinfo.fuzz, &absinfo.flat, &absinfo.resolution) == 7) && (code < ABS_CNT)) {
+				entry->caps.absinfo[code] = absinfo;
+			} else {
+				valid = false;
+			}
+		} else {
+			n_keys--;
+		}
+	}
+
+	fclose(file);
+
+	if ((entry != NULL) && (n_keys != INPUT_CACHE_N_KEYS))
+		input_cache.n_entries--;
+
+	if (!valid || (version != INPUT_CACHE_VERSION)) {
+		fprintf(stderr, "[input cache] Ignoring invalid or outdated input cache \"%s\".\n", path);
+		input_cache.n_entries = 0;
+		input_cache.dirty = true;
+	}
+
+	return true;
+}
+
+bool input_cache_lookup(const char *path, const struct stat *st, struct input_device_caps *caps_out) {
+	struct input_cache_entry *entry;
+	uint64_t fingerprint;
+
+	entry = find_entry(path);
+	if (entry == NULL) return false;
+
+	if ((entry->rdev != st->st_rdev) || !get_fingerprint(st->st_rdev, &fingerprint) || (entry->fingerprint != fingerprint))
+		return false;
+
+	*caps_out = entry->caps;
+	return true;
+}
+
+void input_cache_store(const char *path, const struct stat *st, const struct input_device_caps *caps) {
+	struct input_cache_entry *entry;
+	uint64_t fingerprint;
+
+	// without a fingerprint, we'd never know if the entry is still valid.
+	if (!get_fingerprint(st->st_rdev, &fingerprint)) return;
+
+	entry = find_entry(path);
+	if (entry == NULL) entry = add_entry();
+	if (entry == NULL) return;
+
+	snprintf(entry->path, sizeof(entry->path), "%s", path);
+	entry->rdev = st->st_rdev;
+	entry->fingerprint = fingerprint;
+	entry->caps = *caps;
+
+	input_cache.dirty = true;
+}
+
+bool input_cache_write(void) {
+	struct input_cache_entry *entry;
+	char tmp_path[PATH_MAX + 8];
+	FILE *file;
+	int ok;
+
+	if (!input_cache.dirty) return true;
+
+	// write to a temporary file first and then rename it, so a power loss
+	// while writing never leaves a half-written cache behind.
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", input_cache.path);
+
+	file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "[input cache] Could not create input cache \"%s\": %s\n", tmp_path, strerror(errno));
+		return false;
+	}
+
+	fprintf(file,
+		"# flutter-pi input device cache. Delete this file to force a full input device probe.\n"
+		"version=%u\n",
+		INPUT_CACHE_VERSION
+	);
+
+	for (size_t i = 0; i < input_cache.n_entries; i++) {
+		entry = input_cache.entries + i;
+
+		fprintf(file,
+			"device=%s\n"
+			"rdev=%llu\n"
+			"fingerprint=%016llx\n"
+			"name=%s\n"
+			"id=%hx %hx %hx %hx\n",
+			entry->path,
+			(unsigned long long) entry->rdev,
+			(unsigned long long) entry->fingerprint,
+			entry->caps.name,
+			entry->caps.input_id.bustype, entry->caps.input_id.vendor,
+			entry->caps.input_id.product, entry->caps.input_id.version
+		);
+
+		write_bits(file, "absbits", entry->caps.absbits, N_WORDS(entry->caps.absbits));
+		write_bits(file, "relbits", entry->caps.relbits, N_WORDS(entry->caps.relbits));
+		write_bits(file, "keybits", entry->caps.keybits, N_WORDS(entry->caps.keybits));
+		write_bits(file, "props", entry->caps.props, N_WORDS(entry->caps.props));
+
+		for (unsigned int code = 0; code < ABS_CNT; code++) {
+			if (!ISSET(entry->caps.absbits, code)) continue;
+
+			fprintf(file, "abs=%x %d %d %d %d %d %d\n", code,
+				entry->caps.absinfo[code].value, entry->caps.absinfo[code].minimum,
+				entry->caps.absinfo[code].maximum, entry->caps.absinfo[code].fuzz,
+				entry->caps.absinfo[code].flat, entry->caps.absinfo[code].resolution);
+		}
+	}
+
+	ok = ferror(file);
+	if (fclose(file) != 0) ok = 1;
+
+	if (ok || (rename(tmp_path, input_cache.path) != 0)) {
+		fprintf(stderr, "[input cache] Could not write input cache \"%s\": %s\n", input_cache.path, strerror(errno));
+		unlink(tmp_path);
+		return false;
+	}
+
+	input_cache.dirty = false;
+	return true;
+}
+
+void input_cache_deinit(void) {
+	free(input_cache.entries);
+	input_cache.entries = NULL;
+	input_cache.n_entries = 0;
+}
@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <linux/input.h>
+
+#include <input_recording.h>
+
+/// The maximum number of events written to a replayed device at once.
+/// If a SYN_REPORT frame has more events, it's split up.
+#define MAX_PENDING_EVENTS 64
+
+struct {
+	pthread_mutex_t lock;
+	FILE *file;
+	int n_devices;
+
+	/// the time of the last recorded event, 0 if there's none yet.
+	uint64_t last_ns;
+} recording = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+struct replay_device {
+	struct input_device_caps caps;
+
+	/// fds[0] is the read end, read by the io thread like an evdev device,
+	/// fds[1] the write end, written by the replay thread.
+	int fds[2];
+
+	/// the events of the current SYN_REPORT frame.
+	struct input_event pending[MAX_PENDING_EVENTS];
+	size_t n_pending;
+};
+
+struct {
+	struct replay_device *devices;
+	size_t n_devices;
+
+	struct input_recording_event *events;
+	size_t n_events;
+	size_t events_capacity;
+
+	double speed;
+
+	pthread_t thread;
+	bool started;
+} replay = {0};
+
+
+bool input_recording_start(const char *path) {
+	recording.file = fopen(path, "wb");
+	if (recording.file == NULL) {
+		fprintf(stderr, "[input recording] Could not open \"%s\" for writing. fopen: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (fwrite(INPUT_RECORDING_MAGIC, strlen(INPUT_RECORDING_MAGIC), 1, recording.file) != 1) {
+		fprintf(stderr, "[input recording] Could not write to \"%s\".\n", path);
+		fclose(recording.file);
+		recording.file = NULL;
+		return false;
+	}
+
+	printf("[input recording] Recording all input events to \"%s\".\n", path);
+
+	return true;
+}
+
+/// Stops the recording after a write failed.
+/// recording.lock must be held.
+static void fail_recording(void) {
+	fprintf(stderr, "[input recording] Could not write to the input recording. Recording stopped.\n");
+	fclose(recording.file);
+	recording.file = NULL;
+}
+
+int  input_recording_add_device(const struct input_device_caps *caps) {
+	uint8_t tag = kInputRecordingDevice;
+	int index = -1;
+
+	pthread_mutex_lock(&recording.lock);
+
+	if ((recording.file != NULL) && (recording.n_devices <= UINT16_MAX)) {
+		if ((fwrite(&tag, sizeof(tag), 1, recording.file) == 1) &&
+			(fwrite(caps, sizeof(*caps), 1, recording.file) == 1) &&
+			(fflush(recording.file) == 0))
+		{
+			index = recording.n_devices++;
+		} else {
+			fail_recording();
+		}
+	}
+
+	pthread_mutex_unlock(&recording.lock);
+
+	return index;
+}
+
+void input_recording_write_events(int device_index, const struct input_event *events, size_t n_events, bool use_event_time, uint64_t read_ns) {
+	struct input_recording_event event;
+	uint8_t tag = kInputRecordingEvent;
+	uint64_t time_ns, delta_us;
+
+	pthread_mutex_lock(&recording.lock);
+
+	if ((recording.file == NULL) || (device_index < 0)) {
+		pthread_mutex_unlock(&recording.lock);
+		return;
+	}
+
+	for (int i = 0; i < n_events; i++) {
+		time_ns = use_event_time ? events[i].time.tv_sec*1000000000ull + events[i].time.tv_usec*1000ull : read_ns;
+
+		// events of different devices can be read slightly out of order.
+		delta_us = 0;
+		if ((recording.last_ns != 0) && (time_ns > recording.last_ns))
+			delta_us = (time_ns - recording.last_ns) / 1000;
+		if (time_ns > recording.last_ns)
+			recording.last_ns = time_ns;
+
+		event = (struct input_recording_event) {
+			.delta_us = delta_us > UINT32_MAX ? UINT32_MAX : (uint32_t) delta_us,
+			.device = (uint16_t) device_index,
+			.type = events[i].type,
+			.code = events[i].code,
+			.value = events[i].value
+		};
+
+		if ((fwrite(&tag, sizeof(tag), 1, recording.file) != 1) || (fwrite(&event, sizeof(event), 1, recording.file) != 1)) {
+			fail_recording();
+			break;
+		}
+	}
+
+	if ((recording.file != NULL) && (fflush(recording.file) != 0))
+		fail_recording();
+
+	pthread_mutex_unlock(&recording.lock);
+}
+
+void input_recording_stop(void) {
+	pthread_mutex_lock(&recording.lock);
+
+	if (recording.file != NULL) {
+		fclose(recording.file);
+		recording.file = NULL;
+	}
+
+	pthread_mutex_unlock(&recording.lock);
+}
+
+static bool add_replay_device(FILE *file) {
+	struct replay_device *devices, *device;
+
+	devices = realloc(replay.devices, (replay.n_devices + 1) * sizeof(*devices));
+	if (devices == NULL) {
+		fprintf(stderr, "[input replay] Could not allocate memory for the replayed devices.\n");
+		return false;
+	}
+
+	replay.devices = devices;
+	device = replay.devices + replay.n_devices;
+
+	if (fread(&device->caps, sizeof(device->caps), 1, file) != 1) {
+		fprintf(stderr, "[input replay] The input recording is truncated.\n");
+		return false;
+	}
+
+	// the io thread reads the replayed events just like the ones of a real device.
+	if (pipe2(device->fds, O_CLOEXEC) != 0) {
+		perror("[input replay] Could not create pipe for replayed device");
+		return false;
+	}
+	fcntl(device->fds[0], F_SETFL, fcntl(device->fds[0], F_GETFL) | O_NONBLOCK);
+
+	device->n_pending = 0;
+	replay.n_devices++;
+
+	return true;
+}
+
+static bool add_replay_event(FILE *file) {
+	struct input_recording_event *events;
+	size_t capacity;
+
+	if (replay.n_events == replay.events_capacity) {
+		capacity = replay.events_capacity ? replay.events_capacity * 2 : 1024;
+
+		events = realloc(replay.events, capacity * sizeof(*events));
+		if (events == NULL) {
+			fprintf(stderr, "[input replay] Could not allocate memory for the replayed events.\n");
+			return false;
+		}
+
+		replay.events = events;
+		replay.events_capacity = capacity;
+	}
+
+	if (fread(replay.events + replay.n_events, sizeof(*replay.events), 1, file) != 1) {
+		fprintf(stderr, "[input replay] The input recording is truncated.\n");
+		return false;
+	}
+
+	if (replay.events[replay.n_events].device >= replay.n_devices) {
+		fprintf(stderr, "[input replay] The input recording contains an event of an unknown device.\n");
+		return false;
+	}
+
+	replay.n_events++;
+
+	return true;
+}
+
+bool input_replay_load(const char *path, double speed) {
+	char magic[sizeof(INPUT_RECORDING_MAGIC) - 1];
+	uint8_t tag;
+	FILE *file;
+	bool ok;
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "[input replay] Could not open input recording \"%s\". fopen: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if ((fread(magic, sizeof(magic), 1, file) != 1) || (memcmp(magic, INPUT_RECORDING_MAGIC, sizeof(magic)) != 0)) {
+		fprintf(stderr, "[input replay] \"%s\" is not an input recording.\n", path);
+		fclose(file);
+		return false;
+	}
+
+	ok = true;
+	while (ok && (fread(&tag, sizeof(tag), 1, file) == 1)) {
+		if (tag == kInputRecordingDevice) {
+			ok = add_replay_device(file);
+		} else if (tag == kInputRecordingEvent) {
+			ok = add_replay_event(file);
+		} else {
+			fprintf(stderr, "[input replay] The input recording contains an invalid record.\n");
+			ok = false;
+		}
+	}
+
+	fclose(file);
+
+	if (!ok) return false;
+
+	replay.speed = speed;
+
+	printf(
+		"[input replay] Loaded %u events of %u devices from \"%s\".\n",
+		(unsigned int) replay.n_events,
+		(unsigned int) replay.n_devices,
+		path
+	);
+
+	return true;
+}
+
+size_t input_replay_get_n_devices(void) {
+	return replay.n_devices;
+}
+
+const struct input_device_caps *input_replay_get_device_caps(size_t index) {
+	return &replay.devices[index].caps;
+}
+
+int  input_replay_get_device_fd(size_t index) {
+	return replay.devices[index].fds[0];
+}
+
+static void write_pending_events(struct replay_device *device) {
+	size_t offset = 0, size = device->n_pending * sizeof(struct input_event);
+	ssize_t ok;
+
+	while (offset < size) {
+		ok = write(device->fds[1], ((uint8_t*) device->pending) + offset, size - offset);
+		if (ok < 0) {
+			if (errno == EINTR) continue;
+
+			// EPIPE: the device was closed by the io thread. The remaining events are dropped.
+			if (errno != EPIPE) perror("[input replay] Could not write replayed events");
+			break;
+		}
+
+		offset += ok;
+	}
+
+	device->n_pending = 0;
+}
+
+static void *replay_thread_entry(void *userdata) {
+	struct input_recording_event *event;
+	struct replay_device *device;
+	struct timespec started_at, target, now;
+	uint64_t time_ns = 0;
+	sigset_t mask;
+
+	pthread_setname_np(pthread_self(), "input-replay");
+
+	// writing to a pipe whose read end was closed should fail with EPIPE, not kill flutter-pi.
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+	for (int i = 0; i < replay.n_events; i++) {
+		event = replay.events + i;
+		device = replay.devices + event->device;
+
+		if ((replay.speed > 0) && (event->delta_us > 0)) {
+			time_ns += (uint64_t) (event->delta_us * 1000.0 / replay.speed);
+
+			target.tv_sec = started_at.tv_sec + (started_at.tv_nsec + time_ns) / 1000000000ull;
+			target.tv_nsec = (started_at.tv_nsec + time_ns) % 1000000000ull;
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, NULL) == EINTR);
+		}
+
+		// timestamp the events like the kernel would (with EVIOCSCLOCKID set to CLOCK_MONOTONIC)
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		device->pending[device->n_pending++] = (struct input_event) {
+			.time = {.tv_sec = now.tv_sec, .tv_usec = now.tv_nsec / 1000},
+			.type = event->type,
+			.code = event->code,
+			.value = event->value
+		};
+
+		if (((event->type == EV_SYN) && (event->code == SYN_REPORT)) || (device->n_pending == MAX_PENDING_EVENTS))
+			write_pending_events(device);
+	}
+
+	// closing the write ends makes the io thread read EOF and remove the devices.
+	for (int i = 0; i < replay.n_devices; i++) {
+		write_pending_events(replay.devices + i);
+		close(replay.devices[i].fds[1]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	printf(
+		"[input replay] Replayed %u events in %.1fms.\n",
+		(unsigned int) replay.n_events,
+		(now.tv_sec - started_at.tv_sec) * 1000.0 + (now.tv_nsec - started_at.tv_nsec) / 1000000.0
+	);
+
+	return NULL;
+}
+
+bool input_replay_start(void) {
+	int ok;
+
+	if (replay.started) return true;
+	replay.started = true;
+
+	ok = pthread_create(&replay.thread, NULL, replay_thread_entry, NULL);
+	if (ok != 0) {
+		fprintf(stderr, "[input replay] Could not create replay thread. pthread_create: %s\n", strerror(ok));
+		return false;
+	}
+
+	pthread_detach(replay.thread);
+
+	printf("[input replay] Replaying %u events.\n", (unsigned int) replay.n_events);
+
+	return true;
+}
@@ -0,0 +1,334 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+
+#include <GLES2/gl2.h>
+
+#include <latency.h>
+
+/// The maximum number of inputs waiting for a present / pageflip.
+/// If there are more, the oldest ones are forgotten.
+#define MAX_PENDING 256
+
+/// The width of the overlay bars per millisecond of latency.
+#define OVERLAY_PIXELS_PER_MS 4
+#define OVERLAY_BAR_HEIGHT 8
+
+struct latency_histogram {
+	uint64_t buckets[LATENCY_N_BUCKETS];
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t min_ns, max_ns;
+};
+
+struct {
+	pthread_mutex_t lock;
+	bool enabled;
+	int signal_fd;
+
+	struct latency_histogram histograms[kLatencyStageCount];
+
+	/// the latency of each stage of the last input that went through it.
+	uint64_t last_ns[kLatencyStageCount];
+
+	/// kernel timestamps of the inputs that were read, but not yet presented.
+	uint64_t awaiting_present[MAX_PENDING];
+	size_t n_awaiting_present;
+
+	/// kernel timestamps of the inputs that were presented, but whose pageflip didn't complete yet.
+	uint64_t awaiting_pageflip[MAX_PENDING];
+	size_t n_awaiting_pageflip;
+
+	/// number of inputs that never made it to the screen (because they didn't cause a frame,
+	/// or there were too many inputs pending)
+	uint64_t n_dropped;
+} latency = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.signal_fd = -1
+};
+
+static const char *stage_names[kLatencyStageCount] = {
+	[kLatencyStageRead] = "read",
+	[kLatencyStageHandoff] = "handoff to engine",
+	[kLatencyStagePresent] = "present",
+	[kLatencyStagePageflip] = "pageflip (on screen)"
+};
+
+
+bool latency_init(void) {
+	sigset_t mask;
+	int ok;
+
+	// SIGUSR1 needs to be blocked in every thread for the signalfd to receive it.
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+
+	ok = pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	if (ok != 0) {
+		fprintf(stderr, "[latency] Could not block SIGUSR1. pthread_sigmask: %s\n", strerror(ok));
+	} else {
+		latency.signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (latency.signal_fd < 0) {
+			perror("[latency] Could not create signalfd for SIGUSR1");
+		}
+	}
+
+	if (latency.signal_fd < 0) {
+		fprintf(stderr, "[latency] The latency histograms will only be printed on exit.\n");
+	}
+
+	for (int i = 0; i < kLatencyStageCount; i++)
+		latency.histograms[i].min_ns = UINT64_MAX;
+
+	latency.enabled = true;
+
+	return true;
+}
+
+/// latency.lock must be held.
+static void record(enum latency_stage stage, uint64_t from_ns, uint64_t to_ns) {
+	struct latency_histogram *histogram = latency.histograms + stage;
+	uint64_t ns, bucket;
+
+	ns = to_ns > from_ns ? to_ns - from_ns : 0;
+
+	bucket = ns / LATENCY_BUCKET_NS;
+	if (bucket >= LATENCY_N_BUCKETS) bucket = LATENCY_N_BUCKETS - 1;
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->sum_ns += ns;
+	if (ns < histogram->min_ns) histogram->min_ns = ns;
+	if (ns > histogram->max_ns) histogram->max_ns = ns;
+
+	latency.last_ns[stage] = ns;
+}
+
+/// Appends time_ns to the pending list, forgetting the oldest entry if it's full.
+/// latency.lock must be held.
+static void push_pending(uint64_t *pending, size_t *n_pending, uint64_t time_ns) {
+	if (*n_pending == MAX_PENDING) {
+		memmove(pending, pending + 1, (MAX_PENDING - 1) * sizeof(*pending));
+		(*n_pending)--;
+		latency.n_dropped++;
+	}
+
+	pending[(*n_pending)++] = time_ns;
+}
+
+void latency_record_input(const uint64_t *kernel_ns, size_t n, uint64_t read_ns, uint64_t handoff_ns) {
+	if (!latency.enabled) return;
+
+	pthread_mutex_lock(&latency.lock);
+
+	for (int i = 0; i < n; i++) {
+		record(kLatencyStageRead, kernel_ns[i], read_ns);
+		record(kLatencyStageHandoff, kernel_ns[i], handoff_ns);
+		push_pending(latency.awaiting_present, &latency.n_awaiting_present, kernel_ns[i]);
+	}
+
+	pthread_mutex_unlock(&latency.lock);
+}
+
+void latency_on_present(uint64_t present_ns) {
+	if (!latency.enabled) return;
+
+	pthread_mutex_lock(&latency.lock);
+
+	for (int i = 0; i < latency.n_awaiting_present; i++) {
+		if (latency.awaiting_present[i] + LATENCY_MAX_PENDING_NS < present_ns) {
+			latency.n_dropped++;
+			continue;
+		}
+
+		record(kLatencyStagePresent, latency.awaiting_present[i], present_ns);
+		push_pending(latency.awaiting_pageflip, &latency.n_awaiting_pageflip, latency.awaiting_present[i]);
+	}
+
+	latency.n_awaiting_present = 0;
+
+	pthread_mutex_unlock(&latency.lock);
+}
+
+void latency_on_pageflip(uint64_t pageflip_ns) {
+	if (!latency.enabled) return;
+
+	pthread_mutex_lock(&latency.lock);
+
+	for (int i = 0; i < latency.n_awaiting_pageflip; i++)
+		record(kLatencyStagePageflip, latency.awaiting_pageflip[i], pageflip_ns);
+
+	latency.n_awaiting_pageflip = 0;
+
+	pthread_mutex_unlock(&latency.lock);
+}
+
+int  latency_get_signal_fd(void) {
+	return latency.signal_fd;
+}
+
+void latency_on_signal_fd_ready(void) {
+	struct signalfd_siginfo info;
+	bool received = false;
+	ssize_t ok;
+
+	while ((ok = read(latency.signal_fd, &info, sizeof(info))) == sizeof(info))
+		received = true;
+
+	if ((ok < 0) && (errno != EAGAIN) && (errno != EINTR))
+		perror("[latency] Could not read from signalfd");
+
+	if (received)
+		latency_print_histograms(stdout);
+}
+
+/// Returns the latency (the upper end of the bucket) below which
+/// fraction of all the recorded latencies of histogram are.
+static double percentile_ms(const struct latency_histogram *histogram, double fraction) {
+	uint64_t target, sum = 0;
+
+	target = (uint64_t) (histogram->count * fraction);
+	if (target == 0) target = 1;
+
+	for (int i = 0; i < LATENCY_N_BUCKETS; i++) {
+		sum += histogram->buckets[i];
+		if (sum >= target)
+			return (i + 1) * LATENCY_BUCKET_NS / 1000000.0;
+	}
+
+	return LATENCY_N_BUCKETS * LATENCY_BUCKET_NS / 1000000.0;
+}
+
+void latency_print_histograms(FILE *stream) {
+	struct latency_histogram histograms[kLatencyStageCount], *histogram;
+	uint64_t n_dropped, max_count;
+	char bar[41];
+	int length;
+
+	if (!latency.enabled) return;
+
+	pthread_mutex_lock(&latency.lock);
+	memcpy(histograms, latency.histograms, sizeof(histograms));
+	n_dropped = latency.n_dropped;
+	pthread_mutex_unlock(&latency.lock);
+
+	fprintf(stream, "Input latency since the kernel timestamp (ms), %llu inputs didn't make it to the screen:\n", (unsigned long long) n_dropped);
+	fprintf(stream, "  %-22s %8s %8s %8s %8s %8s %8s %8s\n", "stage", "count", "min", "mean", "p50", "p90", "p99", "max");
+	for (int i = 0; i < kLatencyStageCount; i++) {
+		histogram = histograms + i;
+
+		if (histogram->count == 0) {
+			fprintf(stream, "  %-22s %8u\n", stage_names[i], 0);
+			continue;
+		}
+
+		fprintf(
+			stream,
+			"  %-22s %8llu %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+			stage_names[i],
+			(unsigned long long) histogram->count,
+			histogram->min_ns / 1000000.0,
+			histogram->sum_ns / (double) histogram->count / 1000000.0,
+			percentile_ms(histogram, 0.5),
+			percentile_ms(histogram, 0.9),
+			percentile_ms(histogram, 0.99),
+			histogram->max_ns / 1000000.0
+		);
+	}
+
+	for (int i = 0; i < kLatencyStageCount; i++) {
+		histogram = histograms + i;
+		if (histogram->count == 0) continue;
+
+		max_count = 0;
+		for (int j = 0; j < LATENCY_N_BUCKETS; j++)
+			if (histogram->buckets[j] > max_count)
+				max_count = histogram->buckets[j];
+
+		fprintf(stream, "Input latency histogram, %s:\n", stage_names[i]);
+		for (int j = 0; j < LATENCY_N_BUCKETS; j++) {
+			if (histogram->buckets[j] == 0) continue;
+
+			length = (int) ((histogram->buckets[j] * (sizeof(bar) - 1) + max_count - 1) / max_count);
+			memset(bar, '#', length);
+			bar[length] = '\0';
+
+			fprintf(
+				stream,
+				"  %s%6.1fms %8llu %s\n",
+				j == LATENCY_N_BUCKETS - 1 ? ">=" : "  ",
+				j * LATENCY_BUCKET_NS / 1000000.0,
+				(unsigned long long) histogram->buckets[j],
+				bar
+			);
+		}
+	}
+
+	fflush(stream);
+}
+
+void latency_draw_overlay(void) {
+	static const GLfloat colors[kLatencyStageCount][3] = {
+		[kLatencyStageRead] = {0.0f, 0.5f, 1.0f},
+		[kLatencyStageHandoff] = {0.0f, 1.0f, 1.0f},
+		[kLatencyStagePresent] = {1.0f, 1.0f, 0.0f},
+		[kLatencyStagePageflip] = {1.0f, 0.0f, 1.0f}
+	};
+	uint64_t last_ns[kLatencyStageCount];
+	GLboolean scissor_test, color_mask[4];
+	GLint scissor_box[4], framebuffer, viewport[4];
+	GLfloat clear_color[4];
+	GLsizei bar_width;
+
+	if (!latency.enabled) return;
+
+	pthread_mutex_lock(&latency.lock);
+	memcpy(last_ns, latency.last_ns, sizeof(last_ns));
+	pthread_mutex_unlock(&latency.lock);
+
+	glGetBooleanv(GL_SCISSOR_TEST, &scissor_test);
+	glGetBooleanv(GL_COLOR_WRITEMASK, color_mask);
+	glGetIntegerv(GL_SCISSOR_BOX, scissor_box);
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glEnable(GL_SCISSOR_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	// the framebuffer origin is the lower left corner, so the bars are drawn
+	// from the top of the viewport downwards.
+	for (int i = 0; i < kLatencyStageCount; i++) {
+		bar_width = (GLsizei) (last_ns[i] * OVERLAY_PIXELS_PER_MS / 1000000ull);
+		if (bar_width < 1) bar_width = 1;
+		if (bar_width > viewport[2]) bar_width = viewport[2];
+
+		glScissor(viewport[0], viewport[1] + viewport[3] - (i + 1) * OVERLAY_BAR_HEIGHT, bar_width, OVERLAY_BAR_HEIGHT);
+		glClearColor(colors[i][0], colors[i][1], colors[i][2], 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+
+	glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+	glColorMask(color_mask[0], color_mask[1], color_mask[2], color_mask[3]);
+	glScissor(scissor_box[0], scissor_box[1], scissor_box[2], scissor_box[3]);
+	if (!scissor_test) glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void latency_deinit(void) {
+	latency.enabled = false;
+
+	if (latency.signal_fd >= 0) {
+		close(latency.signal_fd);
+		latency.signal_fd = -1;
+	}
+}
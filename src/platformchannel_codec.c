@@ -0,0 +1,1936 @@
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platformchannel.h>
+
+/*
+ * The platform channel codecs (encoding & decoding of platform messages, and the std_value / json_value helpers).
+ * Nothing in here calls into the flutter engine, so this can be built & used without it.
+ * Sending messages is done in platformchannel.c.
+ */
+
+/// The minimum size of an arena block.
+#define PLATCH_ARENA_MIN_BLOCK_SIZE 4096
+
+/// Arenas that grew bigger than this (for example, while decoding a big image) are freed on reset,
+/// instead of being kept around as one block. (like PLATCH_BUFFER_MAX_RETAINED_CAPACITY for encoding)
+#define PLATCH_ARENA_MAX_RETAINED_SIZE (1 << 20)
+
+struct platch_arena_block {
+	struct platch_arena_block *next;
+	size_t size, used;
+	max_align_t data[];
+};
+
+static _Thread_local struct platch_arena thread_arena = {0};
+
+void *platch_arena_alloc(struct platch_arena *arena, size_t size) {
+	struct platch_arena_block *block = arena->blocks;
+	size_t block_size;
+	void *memory;
+
+	// keep every allocation aligned for any type.
+	size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+
+	if ((block == NULL) || (block->size - block->used < size)) {
+		// the old blocks stay allocated until the arena is reset, since the memory in them is still used.
+		block_size = arena->total_size > PLATCH_ARENA_MIN_BLOCK_SIZE ? arena->total_size : PLATCH_ARENA_MIN_BLOCK_SIZE;
+		if (block_size < size) block_size = size;
+
+		block = malloc(sizeof(struct platch_arena_block) + block_size);
+		if (block == NULL) return NULL;
+
+		block->next = arena->blocks;
+		block->size = block_size;
+		block->used = 0;
+
+		arena->blocks = block;
+		arena->total_size += block_size;
+	}
+
+	memory = ((uint8_t*) block->data) + block->used;
+	block->used += size;
+
+	memset(memory, 0, size);
+	return memory;
+}
+
+void platch_arena_reset(struct platch_arena *arena) {
+	struct platch_arena_block *block, *next;
+	size_t total_size = arena->total_size;
+
+	if ((total_size <= PLATCH_ARENA_MAX_RETAINED_SIZE) && ((arena->blocks == NULL) || (arena->blocks->next == NULL))) {
+		if (arena->blocks != NULL) arena->blocks->used = 0;
+		return;
+	}
+
+	for (block = arena->blocks; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	arena->blocks = NULL;
+	arena->total_size = 0;
+
+	// one big message shouldn't pin megabytes forever. The next one this big allocates again.
+	if (total_size > PLATCH_ARENA_MAX_RETAINED_SIZE) return;
+
+	// the arena had to grow. Replace all blocks with a single one that's big enough
+	// for everything, so the next decode of a message this big doesn't allocate anything.
+	block = malloc(sizeof(struct platch_arena_block) + total_size);
+	if (block == NULL) return;
+
+	block->next = NULL;
+	block->size = total_size;
+	block->used = 0;
+
+	arena->blocks = block;
+	arena->total_size = total_size;
+}
+
+void platch_arena_deinit(struct platch_arena *arena) {
+	struct platch_arena_block *block, *next;
+
+	for (block = arena->blocks; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+
+	arena->blocks = NULL;
+	arena->total_size = 0;
+}
+
+struct platch_arena *platch_acquire_thread_arena(void) {
+	thread_arena.depth++;
+	return &thread_arena;
+}
+
+void platch_release_thread_arena(void) {
+	if (--thread_arena.depth == 0)
+		platch_arena_reset(&thread_arena);
+}
+
+/// Allocates zero-initialized memory for n elements of the given size,
+/// from arena if it's not NULL, or using calloc otherwise.
+static inline void *decode_alloc(struct platch_arena *arena, size_t n, size_t size) {
+	return arena ? platch_arena_alloc(arena, n * size) : calloc(n, size);
+}
+
+int platch_free_value_std(struct std_value *value) {
+	int ok;
+
+	switch (value->type) {
+		case kStdLargeInt:
+		case kStdString:
+			free(value->string_value);
+			break;
+		case kStdList:
+			for (int i=0; i < value->size; i++) {
+				ok = platch_free_value_std(&(value->list[i]));
+				if (ok != 0) return ok;
+			}
+			free(value->list);
+			break;
+		case kStdMap:
+			for (int i=0; i < value->size; i++) {
+				ok = platch_free_value_std(&(value->keys[i]));
+				if (ok != 0) return ok;
+				ok = platch_free_value_std(&(value->values[i]));
+				if (ok != 0) return ok;
+			}
+			free(value->keys);
+			break;
+		default:
+			break;
+	}
+
+	return 0;
+}
+int platch_free_json_value(struct json_value *value, bool shallow) {
+	int ok;
+	
+	switch (value->type) {
+		case kJsonArray:
+			if (!shallow) {
+				for (int i = 0; i < value->size; i++) {
+					ok = platch_free_json_value(&(value->array[i]), false);
+					if (ok != 0) return ok;
+				}
+			}
+
+			free(value->array);
+			break;
+		case kJsonObject:
+			if (!shallow) {
+				for (int i = 0; i < value->size; i++) {
+					ok = platch_free_json_value(&(value->values[i]), false);
+					if (ok != 0) return ok;
+				}
+			}
+
+			free(value->keys);
+			free(value->values);
+			break;
+		default:
+			break;
+	}
+
+	return 0;
+}
+int platch_free_obj(struct platch_obj *object) {
+	switch (object->codec) {
+		case kStringCodec:
+			free(object->string_value);
+			break;
+		case kBinaryCodec:
+			break;
+		case kJSONMessageCodec:
+			platch_free_json_value(&(object->json_value), false);
+			break;
+		case kStandardMessageCodec:
+			platch_free_value_std(&(object->std_value));
+			break;
+		case kStandardMethodCall:
+			free(object->method);
+			platch_free_value_std(&(object->std_arg));
+			break;
+		case kJSONMethodCall:
+			platch_free_json_value(&(object->json_arg), false);
+			break;
+		default:
+			break;
+	}
+
+	return 0;
+}
+
+/// The initial capacity of an encode buffer.
+#define PLATCH_BUFFER_MIN_CAPACITY 256
+
+/// Encode buffers of the platform task thread that grew bigger than this (for example,
+/// while encoding a big image) are freed after sending, instead of being kept around.
+#define PLATCH_BUFFER_MAX_RETAINED_CAPACITY (1 << 20)
+
+/// A growable buffer that platform messages are encoded into, in a single pass.
+struct platch_buffer {
+	uint8_t *data;
+	size_t size, capacity;
+};
+
+static _Thread_local struct platch_buffer thread_buffer = {0};
+
+/// Makes sure there's room for n more bytes in buffer. Grows the buffer geometrically.
+static inline bool buffer_reserve(struct platch_buffer *buffer, size_t n) {
+	size_t capacity;
+	uint8_t *data;
+
+	if (buffer->capacity - buffer->size >= n) return true;
+
+	capacity = buffer->capacity ? buffer->capacity * 2 : PLATCH_BUFFER_MIN_CAPACITY;
+	while (capacity - buffer->size < n) capacity *= 2;
+
+	data = realloc(buffer->data, capacity);
+	if (data == NULL) return false;
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+	return true;
+}
+
+static inline int buffer_write(struct platch_buffer *buffer, const void *data, size_t n) {
+	if (!buffer_reserve(buffer, n)) return ENOMEM;
+
+	memcpy(buffer->data + buffer->size, data, n);
+	buffer->size += n;
+	return 0;
+}
+
+static inline int buffer_write8(struct platch_buffer *buffer, uint8_t value) {
+	if (!buffer_reserve(buffer, 1)) return ENOMEM;
+
+	buffer->data[buffer->size++] = value;
+	return 0;
+}
+
+/// Pads the buffer with zeroes until its size is a multiple of alignment.
+/// (The standard codec aligns relative to the start of the message.)
+static inline int buffer_align(struct platch_buffer *buffer, size_t alignment) {
+	size_t padding = (alignment - (buffer->size % alignment)) % alignment;
+
+	if (!buffer_reserve(buffer, padding)) return ENOMEM;
+
+	memset(buffer->data + buffer->size, 0, padding);
+	buffer->size += padding;
+	return 0;
+}
+
+static int buffer_write_size(struct platch_buffer *buffer, size_t size) {
+	uint16_t size16;
+	uint32_t size32;
+	int ok;
+
+	if (size < 254) {
+		return buffer_write8(buffer, (uint8_t) size);
+	} else if (size <= 0xFFFF) {
+		ok = buffer_write8(buffer, 0xFE);
+		if (ok != 0) return ok;
+
+		size16 = size;
+		return buffer_write(buffer, &size16, 2);
+	} else {
+		ok = buffer_write8(buffer, 0xFF);
+		if (ok != 0) return ok;
+
+		size32 = size;
+		return buffer_write(buffer, &size32, 4);
+	}
+}
+
+/// Writes the size & the elements of a standard codec typed array / string.
+static int buffer_write_array(struct platch_buffer *buffer, const void *elements, size_t n_elements, size_t element_size) {
+	int ok;
+
+	ok = buffer_write_size(buffer, n_elements);
+	if (ok != 0) return ok;
+
+	if (element_size > 1) {
+		ok = buffer_align(buffer, element_size);
+		if (ok != 0) return ok;
+	}
+
+	return buffer_write(buffer, elements, n_elements * element_size);
+}
+
+static int write_value_std(struct platch_buffer *buffer, struct std_value *value) {
+	int ok;
+
+	// string views are just strings on the wire.
+	ok = buffer_write8(buffer, value->type == kStdStringView ? kStdString : value->type);
+	if (ok != 0) return ok;
+
+	switch (value->type) {
+		case kStdNull:
+		case kStdTrue:
+		case kStdFalse:
+			return 0;
+		case kStdInt32:
+			return buffer_write(buffer, &value->int32_value, 4);
+		case kStdInt64:
+			return buffer_write(buffer, &value->int64_value, 8);
+		case kStdFloat64:
+			ok = buffer_align(buffer, 8);
+			if (ok != 0) return ok;
+
+			return buffer_write(buffer, &value->float64_value, 8);
+		case kStdLargeInt:
+		case kStdString:
+			return buffer_write_array(buffer, value->string_value, strlen(value->string_value), 1);
+		case kStdStringView:
+			return buffer_write_array(buffer, value->string_view, value->size, 1);
+		case kStdUInt8Array:
+			return buffer_write_array(buffer, value->uint8array, value->size, 1);
+		case kStdInt32Array:
+			return buffer_write_array(buffer, value->int32array, value->size, 4);
+		case kStdInt64Array:
+			return buffer_write_array(buffer, value->int64array, value->size, 8);
+		case kStdFloat64Array:
+			return buffer_write_array(buffer, value->float64array, value->size, 8);
+		case kStdList:
+			ok = buffer_write_size(buffer, value->size);
+			if (ok != 0) return ok;
+
+			for (int i=0; i < value->size; i++) {
+				ok = write_value_std(buffer, &value->list[i]);
+				if (ok != 0) return ok;
+			}
+
+			return 0;
+		case kStdMap:
+			ok = buffer_write_size(buffer, value->size);
+			if (ok != 0) return ok;
+
+			for (int i=0; i < value->size; i++) {
+				ok = write_value_std(buffer, &value->keys[i]);
+				if (ok != 0) return ok;
+
+				ok = write_value_std(buffer, &value->values[i]);
+				if (ok != 0) return ok;
+			}
+
+			return 0;
+		default:
+			return EINVAL;
+	}
+}
+
+/// Normalized 64-bit significands & binary exponents of the powers of ten 10^-348, 10^-340, ..., 10^340.
+/// (used by the Grisu2 number formatting below)
+static const uint64_t json_cached_powers_f[] = {
+	0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull, 0xcf42894a5dce35eaull,
+	0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull, 0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full,
+	0xbe5691ef416bd60cull, 0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+	0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull, 0xc21094364dfb5637ull,
+	0x9096ea6f3848984full, 0xd77485cb25823ac7ull, 0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull,
+	0xb23867fb2a35b28eull, 0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+	0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull, 0xb5b5ada8aaff80b8ull,
+	0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull, 0x964e858c91ba2655ull, 0xdff9772470297ebdull,
+	0xa6dfbd9fb8e5b88full, 0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+	0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull, 0xaa242499697392d3ull,
+	0xfd87b5f28300ca0eull, 0xbce5086492111aebull, 0x8cbccc096f5088ccull, 0xd1b71758e219652cull,
+	0x9c40000000000000ull, 0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+	0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull, 0x9f4f2726179a2245ull,
+	0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull, 0x83c7088e1aab65dbull, 0xc45d1df942711d9aull,
+	0x924d692ca61be758ull, 0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+	0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull, 0x952ab45cfa97a0b3ull,
+	0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull, 0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull,
+	0x88fcf317f22241e2ull, 0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+	0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull, 0x8bab8eefb6409c1aull,
+	0xd01fef10a657842cull, 0x9b10a4e5e9913129ull, 0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull,
+	0x80444b5e7aa7cf85ull, 0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+	0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+};
+
+static const int16_t json_cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066
+};
+
+static const uint64_t json_powers_of_ten_u64[] = {
+	1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+	1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+	100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+	1000000000000000000ull, 10000000000000000000ull
+};
+
+/// A floating point number f * 2^e with a 64-bit significand.
+struct diy_fp {
+	uint64_t f;
+	int e;
+};
+
+static inline struct diy_fp diy_fp_multiply(struct diy_fp x, struct diy_fp y) {
+	const uint64_t mask32 = 0xFFFFFFFFull;
+	uint64_t a = x.f >> 32, b = x.f & mask32, c = y.f >> 32, d = y.f & mask32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & mask32) + (bc & mask32) + (1ull << 31);
+
+	return (struct diy_fp) {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+}
+
+static inline struct diy_fp diy_fp_normalize(struct diy_fp x) {
+	int shift = __builtin_clzll(x.f);
+	return (struct diy_fp) {x.f << shift, x.e - shift};
+}
+
+/// Moves the last digit of the generated digits closer to the exact value, as long as it stays
+/// inside the rounding interval.
+static inline void grisu_round(char *digits, int n_digits, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t distance) {
+	while ((rest < distance) && (delta - rest >= ten_kappa) &&
+		   ((rest + ten_kappa < distance) || (distance - rest > rest + ten_kappa - distance))) {
+		digits[n_digits - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+static inline int count_decimal_digits(uint32_t n) {
+	int count = 1;
+	while ((count < 10) && (n >= json_powers_of_ten_u64[count])) count++;
+	return count;
+}
+
+/// Generates the shortest digits of the number between low & high (scaled by a cached power of ten)
+/// that's closest to w. *exponent is adjusted so that the number is digits * 10^exponent.
+static int grisu_generate_digits(struct diy_fp w, struct diy_fp high, uint64_t delta, char *digits, int *exponent) {
+	struct diy_fp one = {1ull << -high.e, high.e};
+	uint64_t distance = high.f - w.f, rest;
+	uint32_t integral = high.f >> -one.e, digit;
+	uint64_t fraction = high.f & (one.f - 1);
+	int kappa = count_decimal_digits(integral), n_digits = 0;
+
+	while (kappa > 0) {
+		digit = integral / json_powers_of_ten_u64[kappa - 1];
+		integral %= json_powers_of_ten_u64[kappa - 1];
+		if (digit || n_digits) digits[n_digits++] = '0' + digit;
+		kappa--;
+
+		rest = ((uint64_t) integral << -one.e) + fraction;
+		if (rest <= delta) {
+			*exponent += kappa;
+			grisu_round(digits, n_digits, delta, rest, json_powers_of_ten_u64[kappa] << -one.e, distance);
+			return n_digits;
+		}
+	}
+
+	while (true) {
+		fraction *= 10;
+		delta *= 10;
+		digit = fraction >> -one.e;
+		if (digit || n_digits) digits[n_digits++] = '0' + digit;
+		fraction &= one.f - 1;
+		kappa--;
+
+		if (fraction < delta) {
+			*exponent += kappa;
+			grisu_round(digits, n_digits, delta, fraction, one.f, -kappa < 20 ? distance * json_powers_of_ten_u64[-kappa] : 0);
+			return n_digits;
+		}
+	}
+}
+
+/// Grisu2: writes the shortest (in almost all cases) digits that round-trip to value,
+/// which must be finite and positive. Returns the number of digits,
+/// the number is digits * 10^*exponent.
+static int grisu2(double value, char *digits, int *exponent) {
+	const uint64_t hidden_bit = 0x0010000000000000ull, significand_mask = 0x000FFFFFFFFFFFFFull;
+	const int exponent_bias = 0x3FF + 52;
+	struct diy_fp v, high, low, cached, w;
+	uint64_t bits;
+	double dk;
+	int biased_exponent, k, index;
+
+	memcpy(&bits, &value, sizeof(bits));
+	biased_exponent = (bits >> 52) & 0x7FF;
+
+	if (biased_exponent != 0) {
+		v = (struct diy_fp) {(bits & significand_mask) + hidden_bit, biased_exponent - exponent_bias};
+	} else {
+		v = (struct diy_fp) {bits & significand_mask, 1 - exponent_bias};
+	}
+
+	// the boundaries of the interval of numbers that round to value.
+	high = (struct diy_fp) {(v.f << 1) + 1, v.e - 1};
+	while (!(high.f & (hidden_bit << 1))) {
+		high.f <<= 1;
+		high.e--;
+	}
+	high.f <<= 64 - 52 - 2;
+	high.e -= 64 - 52 - 2;
+
+	if (v.f == hidden_bit) {
+		low = (struct diy_fp) {(v.f << 2) - 1, v.e - 2};
+	} else {
+		low = (struct diy_fp) {(v.f << 1) - 1, v.e - 1};
+	}
+	low.f <<= low.e - high.e;
+	low.e = high.e;
+
+	// find the cached power of ten that brings the exponent of high into [-60, -32].
+	dk = (-61 - high.e) * 0.30102999566398114 + 347;
+	k = (int) dk;
+	if (dk - k > 0.0) k++;
+
+	index = (k >> 3) + 1;
+	*exponent = -(-348 + (index << 3));
+	cached = (struct diy_fp) {json_cached_powers_f[index], json_cached_powers_e[index]};
+
+	w = diy_fp_multiply(diy_fp_normalize(v), cached);
+	high = diy_fp_multiply(high, cached);
+	low = diy_fp_multiply(low, cached);
+	low.f++;
+	high.f--;
+
+	return grisu_generate_digits(w, high, high.f - low.f, digits, exponent);
+}
+
+static char *write_uint64(char *out, uint64_t value) {
+	char digits[20];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+
+	while (n) *out++ = digits[--n];
+	return out;
+}
+
+/// Writes value as a JSON number into out, which must have room for 32 bytes.
+/// The number is formatted with the fewest digits needed to parse it back exactly.
+/// Returns the number of bytes written.
+static int format_json_number(double value, char *out) {
+	char *start = out, digits[32];
+	int n_digits, exponent, point;
+
+	// JSON has no NaN or infinity.
+	if (!isfinite(value)) {
+		memcpy(out, "null", 4);
+		return 4;
+	}
+
+	if (signbit(value)) {
+		*out++ = '-';
+		value = -value;
+	}
+
+	// fast path for integers, which most numbers in platform messages are.
+	if ((value < 9007199254740992.0) && (value == (double) (uint64_t) value))
+		return write_uint64(out, (uint64_t) value) - start;
+
+	n_digits = grisu2(value, digits, &exponent);
+
+	// the decimal point is after the first point digits. (10^(point-1) <= value < 10^point)
+	point = n_digits + exponent;
+
+	if ((exponent >= 0) && (point <= 21)) {
+		// 1234e7 -> 12340000000
+		memcpy(out, digits, n_digits);
+		memset(out + n_digits, '0', exponent);
+		out += point;
+	} else if ((point > 0) && (point <= 21)) {
+		// 1234e-2 -> 12.34
+		memcpy(out, digits, point);
+		out[point] = '.';
+		memcpy(out + point + 1, digits + point, n_digits - point);
+		out += n_digits + 1;
+	} else if ((point > -6) && (point <= 0)) {
+		// 1234e-6 -> 0.001234
+		*out++ = '0';
+		*out++ = '.';
+		memset(out, '0', -point);
+		memcpy(out - point, digits, n_digits);
+		out += n_digits - point;
+	} else {
+		// 1234e30 -> 1.234e33
+		*out++ = digits[0];
+		if (n_digits > 1) {
+			*out++ = '.';
+			memcpy(out, digits + 1, n_digits - 1);
+			out += n_digits - 1;
+		}
+
+		*out++ = 'e';
+		if (point - 1 < 0) *out++ = '-';
+		out = write_uint64(out, point - 1 < 0 ? 1 - point : point - 1);
+	}
+
+	return out - start;
+}
+
+/// Returns true if any byte of word is a quote, a backslash or a control character.
+/// (Can have false positives in the bytes after such a byte, which is fine since we stop at the first one.)
+static inline bool json_word_has_special_byte(uint64_t word) {
+	const uint64_t ones = 0x0101010101010101ull, highs = 0x8080808080808080ull;
+	uint64_t quotes = word ^ (ones * '\"');
+	uint64_t backslashes = word ^ (ones * '\\');
+
+	return (((quotes - ones) & ~quotes) | ((backslashes - ones) & ~backslashes) | ((word - ones * 0x20) & ~word)) & highs;
+}
+
+static inline bool json_needs_escape(char c) {
+	return (c == '\"') || (c == '\\') || ((uint8_t) c < 0x20);
+}
+
+static int write_string_json(struct platch_buffer *buffer, const char *string) {
+	static const char hex_digits[] = "0123456789abcdef";
+	const char *cursor = string, *end = string + strlen(string);
+	uint8_t *out;
+	uint64_t word;
+	size_t run;
+	char escaped;
+
+	// room for the string & both quotes. Escapes reserve their extra bytes when they're found.
+	if (!buffer_reserve(buffer, (end - string) + 2)) return ENOMEM;
+	buffer->data[buffer->size++] = '\"';
+
+	while (cursor < end) {
+		// find the end of the run of bytes that don't need escaping, 8 bytes at a time,
+		// and copy the whole run at once.
+		run = 0;
+		while ((end - cursor - run >= 8) && (memcpy(&word, cursor + run, 8), !json_word_has_special_byte(word)))
+			run += 8;
+		while ((cursor + run < end) && !json_needs_escape(cursor[run]))
+			run++;
+
+		memcpy(buffer->data + buffer->size, cursor, run);
+		buffer->size += run;
+		cursor += run;
+
+		if (cursor == end) break;
+
+		// an escape is at most 6 bytes instead of 1.
+		if (!buffer_reserve(buffer, (end - cursor) + 1 + 5)) return ENOMEM;
+
+		switch (*cursor) {
+			case '\"': escaped = '\"'; break;
+			case '\\': escaped = '\\'; break;
+			case '\b': escaped = 'b'; break;
+			case '\f': escaped = 'f'; break;
+			case '\n': escaped = 'n'; break;
+			case '\r': escaped = 'r'; break;
+			case '\t': escaped = 't'; break;
+			default:   escaped = 0; break;
+		}
+
+		out = buffer->data + buffer->size;
+		if (escaped) {
+			out[0] = '\\';
+			out[1] = escaped;
+			buffer->size += 2;
+		} else {
+			// other control characters
+			memcpy(out, "\\u00", 4);
+			out[4] = hex_digits[(uint8_t) *cursor >> 4];
+			out[5] = hex_digits[*cursor & 0xF];
+			buffer->size += 6;
+		}
+
+		cursor++;
+	}
+
+	buffer->data[buffer->size++] = '\"';
+	return 0;
+}
+
+static int write_value_json(struct platch_buffer *buffer, struct json_value *value) {
+	int ok;
+
+	switch (value->type) {
+		case kJsonNull:
+			return buffer_write(buffer, "null", 4);
+		case kJsonTrue:
+			return buffer_write(buffer, "true", 4);
+		case kJsonFalse:
+			return buffer_write(buffer, "false", 5);
+		case kJsonNumber:
+			if (!buffer_reserve(buffer, 32)) return ENOMEM;
+
+			buffer->size += format_json_number(value->number_value, (char*) buffer->data + buffer->size);
+			return 0;
+		case kJsonString:
+			return write_string_json(buffer, value->string_value);
+		case kJsonArray:
+			ok = buffer_write8(buffer, '[');
+			if (ok != 0) return ok;
+
+			for (int i=0; i < value->size; i++) {
+				if (i != 0) {
+					ok = buffer_write8(buffer, ',');
+					if (ok != 0) return ok;
+				}
+
+				ok = write_value_json(buffer, &value->array[i]);
+				if (ok != 0) return ok;
+			}
+
+			return buffer_write8(buffer, ']');
+		case kJsonObject:
+			ok = buffer_write8(buffer, '{');
+			if (ok != 0) return ok;
+
+			for (int i=0; i < value->size; i++) {
+				if (i != 0) {
+					ok = buffer_write8(buffer, ',');
+					if (ok != 0) return ok;
+				}
+
+				ok = write_string_json(buffer, value->keys[i]);
+				if (ok != 0) return ok;
+
+				ok = buffer_write8(buffer, ':');
+				if (ok != 0) return ok;
+
+				ok = write_value_json(buffer, &value->values[i]);
+				if (ok != 0) return ok;
+			}
+
+			return buffer_write8(buffer, '}');
+		default:
+			return EINVAL;
+	}
+}
+/// The maximum nesting depth of standard codec lists & maps. Deeper messages are rejected,
+/// so a malicious message can't overflow the stack.
+#define STD_MAX_DEPTH 128
+
+/// Decodes one standard codec value. If decoding fails, everything the value allocated
+/// (outside of an arena) is already freed again.
+static int decode_value_std(uint8_t **pbuffer, size_t *premaining, struct std_value *value_out, struct platch_arena *arena, bool string_views, int depth) {
+	enum std_value_type type = 0;
+	int64_t *longArray = 0;
+	int32_t *intArray = 0;
+	uint8_t *byteArray = 0, type_byte = 0;
+	char *c_string = 0; 
+	uint32_t size = 0;
+	int ok;
+	
+	ok = _read8(pbuffer, &type_byte, premaining);
+	if (ok != 0) return ok;
+
+	type = type_byte;
+	value_out->type = type;
+	switch (type) {
+		case kStdNull:
+		case kStdTrue:
+		case kStdFalse:
+			break;
+		case kStdInt32:
+			ok = _read32(pbuffer, (uint32_t*)&value_out->int32_value, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdInt64:
+			ok = _read64(pbuffer, (uint64_t*)&value_out->int64_value, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdFloat64:
+			ok = _align((uintptr_t*) pbuffer, 8, premaining);
+			if (ok != 0) return ok;
+
+			ok = _read64(pbuffer, (uint64_t*) &value_out->float64_value, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdLargeInt:
+		case kStdString:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+			if (*premaining < size) return EBADMSG;
+
+			if (string_views && (value_out->type == kStdString)) {
+				value_out->type = kStdStringView;
+				value_out->size = size;
+				value_out->string_view = (const char*) *pbuffer;
+
+				_advance((uintptr_t*) pbuffer, size, premaining);
+				break;
+			}
+
+			value_out->string_value = decode_alloc(arena, size+1, sizeof(char));
+			if (!value_out->string_value) return ENOMEM;
+
+			memcpy(value_out->string_value, *pbuffer, size);
+			_advance((uintptr_t*) pbuffer, size, premaining);
+
+			break;
+		case kStdUInt8Array:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+			if (*premaining < size) return EBADMSG;
+
+			value_out->size = size;
+			value_out->uint8array = *pbuffer;
+
+			ok = _advance((uintptr_t*) pbuffer, size, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdInt32Array:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+			
+			ok = _align((uintptr_t*) pbuffer, 4, premaining);
+			if (ok != 0) return ok;
+
+			if (*premaining / 4 < size) return EBADMSG;
+
+			value_out->size = size;
+			value_out->int32array = (int32_t*) *pbuffer;
+
+			ok = _advance((uintptr_t*) pbuffer, size*4, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdInt64Array:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+
+			ok = _align((uintptr_t*) pbuffer, 8, premaining);
+			if (ok != 0) return ok;
+
+			if (*premaining / 8 < size) return EBADMSG;
+
+			value_out->size = size;
+			value_out->int64array = (int64_t*) *pbuffer;
+
+			ok = _advance((uintptr_t*) pbuffer, size*8, premaining);
+			if (ok != 0) return ok;
+
+			break;
+		case kStdFloat64Array:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+
+			ok = _align((uintptr_t*) pbuffer, 8, premaining);
+			if (ok != 0) return ok;
+
+			if (*premaining / 8 < size) return EBADMSG;
+
+			value_out->size = size;
+			value_out->float64array = (double*) *pbuffer;
+
+			ok = _advance((uintptr_t*) pbuffer, size*8, premaining);
+			if (ok != 0) return ok;
+			
+			break;
+		case kStdList:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+
+			// every element is at least one byte, so this can't be a valid message.
+			// (checked before allocating, so a bogus size can't make us allocate gigabytes)
+			if (*premaining < size) return EBADMSG;
+			if (depth >= STD_MAX_DEPTH) return EBADMSG;
+
+			value_out->size = size;
+			value_out->list = decode_alloc(arena, size, sizeof(struct std_value));
+			if ((size > 0) && !value_out->list) return ENOMEM;
+
+			for (int i = 0; i < size; i++) {
+				ok = decode_value_std(pbuffer, premaining, &value_out->list[i], arena, string_views, depth + 1);
+				if (ok != 0) {
+					if (!arena) {
+						value_out->size = i;
+						platch_free_value_std(value_out);
+					}
+					return ok;
+				}
+			}
+
+			break;
+		case kStdMap:
+			ok = _readSize(pbuffer, &size, premaining);
+			if (ok != 0) return ok;
+
+			if (*premaining / 2 < size) return EBADMSG;
+			if (depth >= STD_MAX_DEPTH) return EBADMSG;
+
+			value_out->size = size;
+
+			value_out->keys = decode_alloc(arena, size*2, sizeof(struct std_value));
+			if ((size > 0) && !value_out->keys) return ENOMEM;
+
+			value_out->values = &value_out->keys[size];
+
+			for (int i = 0; i < size; i++) {
+				ok = decode_value_std(pbuffer, premaining, &(value_out->keys[i]), arena, string_views, depth + 1);
+				if (ok == 0) {
+					ok = decode_value_std(pbuffer, premaining, &(value_out->values[i]), arena, string_views, depth + 1);
+					if ((ok != 0) && !arena) platch_free_value_std(&(value_out->keys[i]));
+				}
+
+				if (ok != 0) {
+					if (!arena) {
+						value_out->size = i;
+						platch_free_value_std(value_out);
+					}
+					return ok;
+				}
+			}
+
+			break;
+		default:
+			return EBADMSG;
+	}
+
+	return 0;
+}
+
+int platch_decode_value_std(uint8_t **pbuffer, size_t *premaining, struct std_value *value_out, struct platch_arena *arena, bool string_views) {
+	return decode_value_std(pbuffer, premaining, value_out, arena, string_views, 0);
+}
+
+/// The maximum nesting depth of JSON arrays & objects. Deeper messages are rejected,
+/// so a malicious message can't overflow the stack.
+#define JSON_MAX_DEPTH 128
+
+struct json_parser {
+	char *cursor, *end;
+	struct platch_arena *arena;
+	int depth;
+};
+
+/// The elements of the arrays & objects that are currently being parsed. (For objects, the keys
+/// and values alternate.) Elements are collected here until the closing bracket, so the decoded
+/// arrays can be allocated with their final size. Grows as needed and is reused for every message.
+static _Thread_local struct {
+	struct json_value *values;
+	size_t size, capacity;
+} json_stack = {0};
+
+static const double json_powers_of_ten[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int json_push(const struct json_value *value) {
+	struct json_value *values;
+	size_t capacity;
+
+	if (json_stack.size == json_stack.capacity) {
+		capacity = json_stack.capacity ? json_stack.capacity * 2 : 64;
+
+		values = realloc(json_stack.values, capacity * sizeof(struct json_value));
+		if (values == NULL) return ENOMEM;
+
+		json_stack.values = values;
+		json_stack.capacity = capacity;
+	}
+
+	json_stack.values[json_stack.size++] = *value;
+	return 0;
+}
+
+static inline void json_skip_whitespace(struct json_parser *parser) {
+	while ((parser->cursor < parser->end) &&
+		   ((*parser->cursor == ' ') || (*parser->cursor == '\n') || (*parser->cursor == '\r') || (*parser->cursor == '\t')))
+		parser->cursor++;
+}
+
+static inline bool json_is_digit(char c) {
+	return (c >= '0') && (c <= '9');
+}
+
+static inline int json_hex_digit(char c) {
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	return -1;
+}
+
+/// Parses the 4 hex digits of a \u escape at cursor.
+static int json_parse_hex4(const char *cursor, const char *end, uint32_t *value_out) {
+	uint32_t value = 0;
+	int digit;
+
+	if (end - cursor < 4) return EBADMSG;
+
+	for (int i = 0; i < 4; i++) {
+		digit = json_hex_digit(cursor[i]);
+		if (digit < 0) return EBADMSG;
+		value = (value << 4) | digit;
+	}
+
+	*value_out = value;
+	return 0;
+}
+
+static char *json_write_utf8(char *out, uint32_t codepoint) {
+	if (codepoint < 0x80) {
+		*out++ = codepoint;
+	} else if (codepoint < 0x800) {
+		*out++ = 0xC0 | (codepoint >> 6);
+		*out++ = 0x80 | (codepoint & 0x3F);
+	} else if (codepoint < 0x10000) {
+		*out++ = 0xE0 | (codepoint >> 12);
+		*out++ = 0x80 | ((codepoint >> 6) & 0x3F);
+		*out++ = 0x80 | (codepoint & 0x3F);
+	} else {
+		*out++ = 0xF0 | (codepoint >> 18);
+		*out++ = 0x80 | ((codepoint >> 12) & 0x3F);
+		*out++ = 0x80 | ((codepoint >> 6) & 0x3F);
+		*out++ = 0x80 | (codepoint & 0x3F);
+	}
+
+	return out;
+}
+
+/// Parses the string starting after the opening quote at the cursor.
+/// The string is unescaped & NULL-terminated in place (unescaped strings are never longer,
+/// and the closing quote is overwritten), so it doesn't need to be copied.
+static int json_parse_string(struct json_parser *parser, char **string_out) {
+	uint32_t codepoint, low;
+	uint64_t word;
+	char *cursor = parser->cursor, *end = parser->end, *out, *string = cursor;
+	int ok;
+
+	// fast path: skip 8 bytes at a time until there's a quote, backslash or control character.
+	while ((end - cursor >= 8) && (memcpy(&word, cursor, 8), !json_word_has_special_byte(word)))
+		cursor += 8;
+
+	out = cursor;
+	while (cursor < end) {
+		if (*cursor == '\"') {
+			*out = '\0';
+			parser->cursor = cursor + 1;
+			*string_out = string;
+			return 0;
+		} else if ((uint8_t) *cursor < 0x20) {
+			return EBADMSG;
+		} else if (*cursor != '\\') {
+			*out++ = *cursor++;
+			continue;
+		}
+
+		if (end - cursor < 2) return EBADMSG;
+
+		switch (cursor[1]) {
+			case '\"': *out++ = '\"'; break;
+			case '\\': *out++ = '\\'; break;
+			case '/':  *out++ = '/';  break;
+			case 'b':  *out++ = '\b'; break;
+			case 'f':  *out++ = '\f'; break;
+			case 'n':  *out++ = '\n'; break;
+			case 'r':  *out++ = '\r'; break;
+			case 't':  *out++ = '\t'; break;
+			case 'u':
+				ok = json_parse_hex4(cursor + 2, end, &codepoint);
+				if (ok != 0) return ok;
+
+				cursor += 6;
+
+				if ((codepoint >= 0xD800) && (codepoint < 0xDC00)) {
+					// a high surrogate, which needs to be followed by an escaped low surrogate.
+					if ((end - cursor >= 6) && (cursor[0] == '\\') && (cursor[1] == 'u') &&
+						(json_parse_hex4(cursor + 2, end, &low) == 0) && (low >= 0xDC00) && (low < 0xE000)) {
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+						cursor += 6;
+					} else {
+						codepoint = 0xFFFD;
+					}
+				} else if ((codepoint >= 0xDC00) && (codepoint < 0xE000)) {
+					codepoint = 0xFFFD;
+				}
+
+				out = json_write_utf8(out, codepoint);
+				continue;
+			default:
+				return EBADMSG;
+		}
+
+		cursor += 2;
+	}
+
+	return EBADMSG;
+}
+
+/// Parses a JSON number. Numbers with at most 19 significant digits that are exactly representable
+/// as a double (which is almost all of them) are converted without strtod.
+static int json_parse_number(struct json_parser *parser, double *number_out) {
+	char *cursor = parser->cursor, *end = parser->end, *start = cursor;
+	uint64_t mantissa = 0;
+	bool negative = false, exponent_negative = false, exact = true;
+	int n_digits = 0, exponent = 0, explicit_exponent = 0;
+	char short_copy[64], *copy;
+	double number;
+
+	if ((cursor < end) && (*cursor == '-')) {
+		negative = true;
+		cursor++;
+	}
+
+	if ((cursor >= end) || !json_is_digit(*cursor)) return EBADMSG;
+
+	if (*cursor == '0') {
+		cursor++;
+	} else {
+		for (; (cursor < end) && json_is_digit(*cursor); cursor++) {
+			if (n_digits < 19) {
+				mantissa = mantissa * 10 + (*cursor - '0');
+				n_digits++;
+			} else {
+				// digits that don't fit into the mantissa anymore
+				exponent++;
+				exact = false;
+			}
+		}
+	}
+
+	if ((cursor < end) && (*cursor == '.')) {
+		cursor++;
+		if ((cursor >= end) || !json_is_digit(*cursor)) return EBADMSG;
+
+		for (; (cursor < end) && json_is_digit(*cursor); cursor++) {
+			if ((mantissa == 0) && (*cursor == '0')) {
+				// leading zeroes of the fraction aren't significant
+				exponent--;
+			} else if (n_digits < 19) {
+				mantissa = mantissa * 10 + (*cursor - '0');
+				n_digits++;
+				exponent--;
+			} else {
+				exact = false;
+			}
+		}
+	}
+
+	if ((cursor < end) && ((*cursor == 'e') || (*cursor == 'E'))) {
+		cursor++;
+		if ((cursor < end) && ((*cursor == '+') || (*cursor == '-'))) {
+			exponent_negative = *cursor == '-';
+			cursor++;
+		}
+
+		if ((cursor >= end) || !json_is_digit(*cursor)) return EBADMSG;
+
+		for (; (cursor < end) && json_is_digit(*cursor); cursor++) {
+			if (explicit_exponent < 100000)
+				explicit_exponent = explicit_exponent * 10 + (*cursor - '0');
+		}
+
+		exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+	}
+
+	parser->cursor = cursor;
+
+	if (exact && (mantissa <= (1ull << 53)) && (exponent >= -22) && (exponent <= 22)) {
+		// both the mantissa and the power of ten are exact doubles, so this is correctly rounded.
+		number = (double) mantissa;
+		number = exponent < 0 ? number / json_powers_of_ten[-exponent] : number * json_powers_of_ten[exponent];
+		*number_out = negative ? -number : number;
+		return 0;
+	}
+
+	// the number isn't NULL-terminated, so strtod needs a copy of it.
+	// JSON doesn't limit the number of digits, so long numbers are copied to the heap.
+	if (cursor - start < sizeof(short_copy)) {
+		copy = short_copy;
+	} else {
+		copy = malloc(cursor - start + 1);
+		if (copy == NULL) return ENOMEM;
+	}
+
+	memcpy(copy, start, cursor - start);
+	copy[cursor - start] = '\0';
+
+	*number_out = strtod(copy, NULL);
+
+	if (copy != short_copy) free(copy);
+
+	return 0;
+}
+
+static int json_parse_literal(struct json_parser *parser, const char *literal, size_t length) {
+	if ((parser->end - parser->cursor < length) || (memcmp(parser->cursor, literal, length) != 0))
+		return EBADMSG;
+
+	parser->cursor += length;
+	return 0;
+}
+
+static int json_parse_value(struct json_parser *parser, struct json_value *value_out);
+
+/// Parses the elements of an array or object after the opening bracket, up to the closing one.
+/// The elements (or alternating keys and values) are pushed onto json_stack.
+static int json_parse_elements(struct json_parser *parser, char closing_bracket, bool is_object) {
+	struct json_value element;
+	int ok;
+
+	if (++parser->depth > JSON_MAX_DEPTH) return EBADMSG;
+
+	json_skip_whitespace(parser);
+	if ((parser->cursor < parser->end) && (*parser->cursor == closing_bracket)) {
+		parser->cursor++;
+		parser->depth--;
+		return 0;
+	}
+
+	while (true) {
+		if (is_object) {
+			json_skip_whitespace(parser);
+			if ((parser->cursor >= parser->end) || (*parser->cursor != '\"')) return EBADMSG;
+
+			parser->cursor++;
+			element.type = kJsonString;
+			ok = json_parse_string(parser, &element.string_value);
+			if (ok != 0) return ok;
+
+			ok = json_push(&element);
+			if (ok != 0) return ok;
+
+			json_skip_whitespace(parser);
+			if ((parser->cursor >= parser->end) || (*parser->cursor != ':')) return EBADMSG;
+			parser->cursor++;
+		}
+
+		ok = json_parse_value(parser, &element);
+		if (ok != 0) return ok;
+
+		ok = json_push(&element);
+		if (ok != 0) {
+			if (parser->arena == NULL) platch_free_json_value(&element, false);
+			return ok;
+		}
+
+		json_skip_whitespace(parser);
+		if (parser->cursor >= parser->end) return EBADMSG;
+
+		if (*parser->cursor == ',') {
+			parser->cursor++;
+		} else if (*parser->cursor == closing_bracket) {
+			parser->cursor++;
+			parser->depth--;
+			return 0;
+		} else {
+			return EBADMSG;
+		}
+	}
+}
+
+static int json_parse_value(struct json_parser *parser, struct json_value *value_out) {
+	size_t base, n;
+	int ok;
+
+	json_skip_whitespace(parser);
+	if (parser->cursor >= parser->end) return EBADMSG;
+
+	switch (*parser->cursor) {
+		case '\"':
+			parser->cursor++;
+			value_out->type = kJsonString;
+			return json_parse_string(parser, &value_out->string_value);
+		case 'n':
+			value_out->type = kJsonNull;
+			return json_parse_literal(parser, "null", 4);
+		case 't':
+			value_out->type = kJsonTrue;
+			return json_parse_literal(parser, "true", 4);
+		case 'f':
+			value_out->type = kJsonFalse;
+			return json_parse_literal(parser, "false", 5);
+		case '[':
+			parser->cursor++;
+			base = json_stack.size;
+
+			ok = json_parse_elements(parser, ']', false);
+			if (ok != 0) return ok;
+
+			n = json_stack.size - base;
+
+			value_out->type = kJsonArray;
+			value_out->size = n;
+			value_out->array = decode_alloc(parser->arena, n, sizeof(struct json_value));
+			if ((n > 0) && !value_out->array) return ENOMEM;
+
+			memcpy(value_out->array, json_stack.values + base, n * sizeof(struct json_value));
+			json_stack.size = base;
+
+			return 0;
+		case '{':
+			parser->cursor++;
+			base = json_stack.size;
+
+			ok = json_parse_elements(parser, '}', true);
+			if (ok != 0) return ok;
+
+			n = (json_stack.size - base) / 2;
+
+			value_out->type = kJsonObject;
+			value_out->size = n;
+			value_out->keys = decode_alloc(parser->arena, n, sizeof(char*));
+			value_out->values = decode_alloc(parser->arena, n, sizeof(struct json_value));
+			if ((n > 0) && (!value_out->keys || !value_out->values)) {
+				if (parser->arena == NULL) {
+					free(value_out->keys);
+					free(value_out->values);
+				}
+				return ENOMEM;
+			}
+
+			for (size_t i = 0; i < n; i++) {
+				value_out->keys[i] = json_stack.values[base + 2*i].string_value;
+				value_out->values[i] = json_stack.values[base + 2*i + 1];
+			}
+			json_stack.size = base;
+
+			return 0;
+		default:
+			value_out->type = kJsonNumber;
+			return json_parse_number(parser, &value_out->number_value);
+	}
+}
+
+/// Frees the arrays & objects that were already decoded when decoding failed. They're still on
+/// json_stack, since the elements of an array or object are only popped once it's complete.
+static void json_free_stack(void) {
+	for (size_t i = 0; i < json_stack.size; i++)
+		platch_free_json_value(json_stack.values + i, false);
+
+	json_stack.size = 0;
+}
+
+/// Decodes the JSON message. Strings are decoded in place (the message is modified),
+/// all other memory is allocated in arena (or using calloc, if arena is NULL).
+/// If decoding fails, nothing needs to be freed.
+int platch_decode_value_json(char *message, size_t size, struct json_value *value_out, struct platch_arena *arena) {
+	struct json_parser parser = {
+		.cursor = message,
+		.end = message + size,
+		.arena = arena,
+		.depth = 0
+	};
+	int ok;
+
+	json_stack.size = 0;
+
+	ok = json_parse_value(&parser, value_out);
+	if (ok != 0) {
+		if (arena == NULL) json_free_stack();
+		return ok;
+	}
+
+	// only whitespace (or a NULL-terminator) may follow the value.
+	json_skip_whitespace(&parser);
+	if ((parser.cursor < parser.end) && (*parser.cursor != '\0')) {
+		if (arena == NULL) platch_free_json_value(value_out, false);
+		return EBADMSG;
+	}
+
+	return 0;
+}
+
+int platch_decode_json(char *string, struct json_value *out) {
+	return platch_decode_value_json(string, strlen(string), out, NULL);
+}
+
+static int decode(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena, bool string_views);
+
+int platch_decode(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out) {
+	return decode(buffer, size, codec, object_out, NULL, false);
+}
+
+int platch_decode_arena(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena) {
+	return decode(buffer, size, codec, object_out, arena, false);
+}
+
+int platch_decode_string_views(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena) {
+	if (arena == NULL) return EINVAL;
+
+	return decode(buffer, size, codec, object_out, arena, true);
+}
+
+/// Returns a NULL-terminated copy of the string view value inside arena,
+/// or the string itself if it's not a view.
+static char *materialize_string(struct std_value *value, struct platch_arena *arena) {
+	char *string;
+
+	if (value->type != kStdStringView) return value->string_value;
+
+	string = platch_arena_alloc(arena, value->size + 1);
+	if (string == NULL) return NULL;
+
+	memcpy(string, value->string_view, value->size);
+	string[value->size] = '\0';
+
+	return string;
+}
+
+static int decode(uint8_t *buffer, size_t size, enum platch_codec codec, struct platch_obj *object_out, struct platch_arena *arena, bool string_views) {
+	struct json_value root_jsvalue;
+	bool has_args;
+	uint8_t *buffer_cursor = buffer;
+	size_t   remaining = size;
+	int      ok;
+
+	if ((size == 0) && (buffer == NULL)) {
+		object_out->codec = kNotImplemented;
+		return 0;
+	}
+	
+	object_out->codec = codec;
+	switch (codec) {
+		case kStringCodec: ;
+			/// buffer is a non-null-terminated, UTF8-encoded string.
+			/// it's really sad we have to allocate a new memory block for this, but we have to since string codec buffers are not null-terminated.
+
+			char *string;
+			if (!(string = decode_alloc(arena, size + 1, 1))) return ENOMEM;
+			memcpy(string, buffer, size);
+			string[size] = '\0';
+
+			object_out->string_value = string;
+
+			break;
+		case kBinaryCodec:
+			object_out->binarydata = buffer;
+			object_out->binarydata_size = size;
+
+			break;
+		case kJSONMessageCodec:
+			ok = platch_decode_value_json((char *) buffer, size, &(object_out->json_value), arena);
+			if (ok != 0) return ok;
+
+			break;
+		case kJSONMethodCall: ;
+			ok = platch_decode_value_json((char *) buffer, size, &root_jsvalue, arena);
+			if (ok != 0) return ok;
+
+			if (root_jsvalue.type != kJsonObject) {
+				if (!arena) platch_free_json_value(&root_jsvalue, false);
+				return EBADMSG;
+			}
+			
+			// a method call needs a method name, the args are optional (null if there are none).
+			// Duplicate keys are rejected, the first value would be leaked otherwise.
+			object_out->method = NULL;
+			object_out->json_arg = (struct json_value) {.type = kJsonNull};
+			has_args = false;
+
+			for (int i=0; i < root_jsvalue.size; i++) {
+				if ((strcmp(root_jsvalue.keys[i], "method") == 0) && (root_jsvalue.values[i].type == kJsonString) && (object_out->method == NULL)) {
+					object_out->method = root_jsvalue.values[i].string_value;
+				} else if ((strcmp(root_jsvalue.keys[i], "args") == 0) && !has_args) {
+					object_out->json_arg = root_jsvalue.values[i];
+					has_args = true;
+				} else {
+					if (!arena) platch_free_json_value(&root_jsvalue, false);
+					return EBADMSG;
+				}
+			}
+
+			if (object_out->method == NULL) {
+				if (!arena) platch_free_json_value(&root_jsvalue, false);
+				return EBADMSG;
+			}
+
+			if (!arena) platch_free_json_value(&root_jsvalue, true);
+
+			break;
+		case kJSONMethodCallResponse: ;
+			ok = platch_decode_value_json((char *) buffer, size, &root_jsvalue, arena);
+			if (ok != 0) return ok;
+			if (root_jsvalue.type != kJsonArray) {
+				if (!arena) platch_free_json_value(&root_jsvalue, false);
+				return EBADMSG;
+			}
+			
+			if (root_jsvalue.size == 1) {
+				object_out->success = true;
+				object_out->json_result = root_jsvalue.array[0];
+				return arena ? 0 : platch_free_json_value(&root_jsvalue, true);
+			} else if ((root_jsvalue.size == 3) &&
+					   (root_jsvalue.array[0].type == kJsonString) &&
+					   ((root_jsvalue.array[1].type == kJsonString) || (root_jsvalue.array[1].type == kJsonNull))) {
+				
+				
+				object_out->success = false;
+				object_out->error_code = root_jsvalue.array[0].string_value;
+				object_out->error_msg = root_jsvalue.array[1].string_value;
+				object_out->json_error_details = root_jsvalue.array[2];
+				return arena ? 0 : platch_free_json_value(&root_jsvalue, true);
+			} else {
+				if (!arena) platch_free_json_value(&root_jsvalue, false);
+				return EBADMSG;
+			}
+
+			break;
+		case kStandardMessageCodec:
+			ok = platch_decode_value_std(&buffer_cursor, &remaining, &object_out->std_value, arena, string_views);
+			if (ok != 0) return ok;
+			break;
+		case kStandardMethodCall: ;
+			struct std_value methodname;
+
+			ok = platch_decode_value_std(&buffer_cursor, &remaining, &methodname, arena, string_views);
+			if (ok != 0) return ok;
+			if (!STDVALUE_IS_ANY_STRING(methodname)) {
+				if (!arena) platch_free_value_std(&methodname);
+				return EBADMSG;
+			}
+
+			object_out->method = materialize_string(&methodname, arena);
+			if (object_out->method == NULL) return ENOMEM;
+
+			ok = platch_decode_value_std(&buffer_cursor, &remaining, &object_out->std_arg, arena, string_views);
+			if (ok != 0) {
+				if (!arena) free(object_out->method);
+				return ok;
+			}
+
+			break;
+		case kStandardMethodCallResponse: ;
+			// the envelope byte is 0 for a success, 1 for an error (like encode writes it).
+			uint8_t envelope;
+
+			ok = _read8(&buffer_cursor, &envelope, &remaining);
+			if (ok != 0) return ok;
+			if (envelope > 1) return EBADMSG;
+
+			object_out->success = envelope == 0;
+
+			if (object_out->success) {
+				struct std_value result;
+
+				ok = platch_decode_value_std(&buffer_cursor, &remaining, &(object_out->std_result), arena, string_views);
+				if (ok != 0) return ok;
+			} else {
+				struct std_value error_code, error_msg;
+
+				ok = platch_decode_value_std(&buffer_cursor, &remaining, &error_code, arena, string_views);
+				if (ok != 0) return ok;
+
+				ok = platch_decode_value_std(&buffer_cursor, &remaining, &error_msg, arena, string_views);
+				if (ok != 0) {
+					if (!arena) platch_free_value_std(&error_code);
+					return ok;
+				}
+
+				ok = platch_decode_value_std(&buffer_cursor, &remaining, &(object_out->std_error_details), arena, string_views);
+				if (ok == 0 && !(STDVALUE_IS_ANY_STRING(error_code) && (STDVALUE_IS_ANY_STRING(error_msg) || (error_msg.type == kStdNull)))) {
+					if (!arena) platch_free_value_std(&(object_out->std_error_details));
+					ok = EBADMSG;
+				}
+
+				if (ok != 0) {
+					if (!arena) {
+						platch_free_value_std(&error_code);
+						platch_free_value_std(&error_msg);
+					}
+					return ok;
+				}
+
+				object_out->error_code = materialize_string(&error_code, arena);
+				object_out->error_msg = (error_msg.type != kStdNull) ? materialize_string(&error_msg, arena) : NULL;
+				if ((object_out->error_code == NULL) || ((error_msg.type != kStdNull) && (object_out->error_msg == NULL)))
+					return ENOMEM;
+			}
+			break;
+		default:
+			return EINVAL;
+	}
+
+	return 0;
+}
+/// Encodes object into buffer in a single pass.
+/// (kBinaryCodec & kNotImplemented objects don't need encoding, see platch_encode_to_thread_buffer.)
+static int encode(struct platch_obj *object, struct platch_buffer *buffer) {
+	struct json_value jsroot, jsvalues[3];
+	char *jskeys[2] = {"method", "args"};
+	int ok;
+
+	switch (object->codec) {
+		case kStringCodec:
+			return buffer_write(buffer, object->string_value, strlen(object->string_value));
+		case kJSONMessageCodec:
+			return write_value_json(buffer, &object->json_value);
+		case kStandardMessageCodec:
+			return write_value_std(buffer, &object->std_value);
+		case kStandardMethodCall:
+			ok = write_value_std(buffer, &STDSTRING(object->method));
+			if (ok != 0) return ok;
+
+			return write_value_std(buffer, &object->std_arg);
+		case kStandardMethodCallResponse:
+			if (object->success) {
+				ok = buffer_write8(buffer, 0x00);
+				if (ok != 0) return ok;
+
+				return write_value_std(buffer, &object->std_result);
+			}
+
+			ok = buffer_write8(buffer, 0x01);
+			if (ok != 0) return ok;
+
+			ok = write_value_std(buffer, &STDSTRING(object->error_code));
+			if (ok != 0) return ok;
+
+			ok = write_value_std(buffer, object->error_msg ? &STDSTRING(object->error_msg) : &STDNULL);
+			if (ok != 0) return ok;
+
+			return write_value_std(buffer, &object->std_error_details);
+		case kJSONMethodCall:
+			jsroot.type = kJsonObject;
+			jsroot.size = 2;
+			jsroot.keys = jskeys;
+			jsroot.values = jsvalues;
+			jsvalues[0] = (struct json_value) {.type = kJsonString, .string_value = object->method};
+			jsvalues[1] = object->json_arg;
+
+			return write_value_json(buffer, &jsroot);
+		case kJSONMethodCallResponse:
+			jsroot.type = kJsonArray;
+			jsroot.array = jsvalues;
+			if (object->success) {
+				jsroot.size = 1;
+				jsvalues[0] = object->json_result;
+			} else {
+				jsroot.size = 3;
+				jsvalues[0] = (struct json_value) {.type = kJsonString, .string_value = object->error_code};
+				jsvalues[1] = (struct json_value) {.type = (object->error_msg != NULL) ? kJsonString : kJsonNull, .string_value = object->error_msg};
+				jsvalues[2] = object->json_error_details;
+			}
+
+			return write_value_json(buffer, &jsroot);
+		default:
+			return EINVAL;
+	}
+}
+
+int platch_encode_to_thread_buffer(struct platch_obj *object, const uint8_t **data_out, size_t *size_out) {
+	int ok;
+
+	if (object->codec == kNotImplemented) {
+		*data_out = NULL;
+		*size_out = 0;
+		return 0;
+	} else if (object->codec == kBinaryCodec) {
+		*data_out = object->binarydata;
+		*size_out = object->binarydata_size;
+		return 0;
+	}
+
+	// make sure data is never NULL, even for empty messages.
+	thread_buffer.size = 0;
+	if (!buffer_reserve(&thread_buffer, 1)) return ENOMEM;
+
+	ok = encode(object, &thread_buffer);
+	if (ok != 0) return ok;
+
+	*data_out = thread_buffer.data;
+	*size_out = thread_buffer.size;
+	return 0;
+}
+
+void platch_release_thread_buffer(void) {
+	if (thread_buffer.capacity > PLATCH_BUFFER_MAX_RETAINED_CAPACITY) {
+		free(thread_buffer.data);
+		thread_buffer = (struct platch_buffer) {0};
+	}
+}
+
+int platch_encode(struct platch_obj *object, uint8_t **buffer_out, size_t *size_out) {
+	const uint8_t *data;
+	size_t size;
+	int ok;
+
+	*size_out = 0;
+	*buffer_out = NULL;
+
+	ok = platch_encode_to_thread_buffer(object, &data, &size);
+	if (ok != 0) return ok;
+
+	if ((data != NULL) && (data == thread_buffer.data)) {
+		// hand the encode buffer off to the caller, so the message doesn't need to be copied.
+		// The next message encoded on this thread will allocate a new one.
+		thread_buffer = (struct platch_buffer) {0};
+	}
+
+	*buffer_out = (uint8_t*) data;
+	*size_out = size;
+	return 0;
+}
+
+bool jsvalue_equals(struct json_value *a, struct json_value *b) {
+	if (a == b) return true;
+	if ((a == NULL) ^ (b == NULL)) return false;
+	if (a->type != b->type) return false;
+
+	switch (a->type) {
+		case kJsonNull:
+		case kJsonTrue:
+		case kJsonFalse:
+			return true;
+		case kJsonNumber:
+			return a->number_value == b->number_value;
+		case kJsonString:
+			return strcmp(a->string_value, b->string_value) == 0;
+		case kJsonArray:
+			if (a->size != b->size) return false;
+			if (a->array == b->array) return true;
+			for (int i = 0; i < a->size; i++)
+				if (!jsvalue_equals(&a->array[i], &b->array[i]))
+					return false;
+			return true;
+		case kJsonObject:
+			if (a->size != b->size) return false;
+			if ((a->keys == b->keys) && (a->values == b->values)) return true;
+
+			bool _keyInBAlsoInA[a->size];
+			memset(_keyInBAlsoInA, false, a->size * sizeof(bool));
+
+			for (int i = 0; i < a->size; i++) {
+				// The key we're searching for in b.
+				char *key = a->keys[i];
+				
+				int j = 0;
+				while (j < a->size) {
+					while (_keyInBAlsoInA[j] && (j < a->size))  j++;	// skip all keys with _keyInBAlsoInA set to true.
+					if (strcmp(key, b->keys[j]) != 0)   		j++;	// if b->keys[j] is not equal to "key", continue searching
+					else {
+						_keyInBAlsoInA[j] = true;
+
+						// the values of "key" in a and b must (of course) also be equivalent.
+						if (!jsvalue_equals(&a->values[i], &b->values[j])) return false;
+						break;
+					}
+				}
+
+				// we did not find a->keys[i] in b.
+				if (j + 1 >= a->size) return false;
+			}
+
+			return true;
+	}
+}
+struct json_value *jsobject_get(struct json_value *object, char *key) {
+	int i;
+	for (i=0; i < object->size; i++)
+		if (strcmp(object->keys[i], key) == 0) break;
+
+
+	if (i != object->size) return &(object->values[i]);
+	return NULL;
+}
+/// Returns the bytes & length of the string or string view value.
+static inline const char *get_string(const struct std_value *value, size_t *length_out) {
+	if (value->type == kStdStringView) {
+		*length_out = value->size;
+		return value->string_view;
+	}
+
+	*length_out = strlen(value->string_value);
+	return value->string_value;
+}
+
+bool stdvalue_equals(struct std_value *a, struct std_value *b) {
+	const char *a_string, *b_string;
+	size_t a_length, b_length;
+
+	if (a == b) return true;
+	if ((a == NULL) ^  (b == NULL)) return false;
+
+	// strings & string views are equal if their contents are.
+	if (STDVALUE_IS_ANY_STRING(*a) && STDVALUE_IS_ANY_STRING(*b)) {
+		a_string = get_string(a, &a_length);
+		b_string = get_string(b, &b_length);
+		return (a_length == b_length) && (memcmp(a_string, b_string, a_length) == 0);
+	}
+
+	if (a->type != b->type) return false;
+
+	switch (a->type) {
+		case kStdNull:
+		case kStdTrue:
+		case kStdFalse:
+			return true;
+		case kStdInt32:
+			return a->int32_value == b->int32_value;
+		case kStdInt64:
+			return a->int64_value == b->int64_value;
+		case kStdLargeInt:
+		case kStdString:
+			return strcmp(a->string_value, b->string_value) == 0;
+		case kStdFloat64:
+			return a->float64_value == b->float64_value;
+		case kStdUInt8Array:
+			if (a->size != b->size) return false;
+			if (a->uint8array == b->uint8array) return true;
+			for (int i = 0; i < a->size; i++)
+				if (a->uint8array[i] != b->uint8array[i])
+					return false;
+			return true;
+		case kStdInt32Array:
+			if (a->size != b->size) return false;
+			if (a->int32array == b->int32array) return true;
+			for (int i = 0; i < a->size; i++)
+				if (a->int32array[i] != b->int32array[i])
+					return false;
+			return true;
+		case kStdInt64Array:
+			if (a->size != b->size) return false;
+			if (a->int64array == b->int64array) return true;
+			for (int i = 0; i < a->size; i++)
+				if (a->int64array[i] != b->int64array[i])
+					return false;
+			return true;
+		case kStdFloat64Array:
+			if (a->size != b->size) return false;
+			if (a->float64array == b->float64array) return true;
+			for (int i = 0; i < a->size; i++)
+				if (a->float64array[i] != b->float64array[i])
+					return false;
+			return true;
+		case kStdList:
+			// the order of list elements is important
+			if (a->size != b->size) return false;
+			if (a->list == b->list) return true;
+
+			for (int i = 0; i < a->size; i++)
+				if (!stdvalue_equals(&(a->list[i]), &(b->list[i])))
+					return false;
+			
+			return true;
+		case kStdMap: {
+			// the order is not important here, which makes it a bit difficult to compare
+			if (a->size != b->size) return false;
+			if ((a->keys == b->keys) && (a->values == b->values)) return true;
+
+			// _keyInBAlsoInA[i] == true means that there's a key in a that matches b->keys[i]
+			//   so if we're searching for a key in b, we can safely ignore / don't need to compare
+			//   keys in b that have they're _keyInBAlsoInA set to true.
+			bool _keyInBAlsoInA[a->size];
+			memset(_keyInBAlsoInA, false, a->size * sizeof(bool));
+
+			for (int i = 0; i < a->size; i++) {
+				// The key we're searching for in b.
+				struct std_value *key = &(a->keys[i]);
+				
+				int j = 0;
+				while (j < a->size) {
+					while (_keyInBAlsoInA[j] && (j < a->size))  j++;	// skip all keys with _keyInBAlsoInA set to true.
+					if (!stdvalue_equals(key, &(b->keys[j])))   j++;	// if b->keys[j] is not equal to "key", continue searching
+					else {
+						_keyInBAlsoInA[j] = true;
+
+						// the values of "key" in a and b must (of course) also be equivalent.
+						if (!stdvalue_equals(&(a->values[i]), &(b->values[j]))) return false;
+						break;
+					}
+				}
+
+				// we did not find a->keys[i] in b.
+				if (j + 1 >= a->size) return false;
+			}
+
+			return true;
+		}
+		default: return false;
+	}
+
+	return false;
+}
+struct std_value *stdmap_get(struct std_value *map, struct std_value *key) {
+	for (int i=0; i < map->size; i++)
+		if (stdvalue_equals(&map->keys[i], key))
+			return &map->values[i];
+
+	return NULL;
+}
+struct std_value *stdmap_get_str(struct std_value *map, char *key) {
+	const char *string;
+	size_t key_length = strlen(key), length;
+
+	for (int i=0; i < map->size; i++) {
+		if (!STDVALUE_IS_ANY_STRING(map->keys[i])) continue;
+
+		string = get_string(&map->keys[i], &length);
+		if ((length == key_length) && (memcmp(string, key, length) == 0))
+			return &map->values[i];
+	}
+
+	return NULL;
+}
+bool stdstring_equals(const struct std_value *value, const char *str) {
+	const char *string;
+	size_t length;
+
+	if (!STDVALUE_IS_ANY_STRING(*value)) return false;
+
+	if (value->type == kStdString) return strcmp(value->string_value, str) == 0;
+
+	string = get_string(value, &length);
+	return (strlen(str) == length) && (memcmp(string, str, length) == 0);
+}
+char *stdstring_dup(const struct std_value *value) {
+	const char *string;
+	size_t length;
+
+	if (!STDVALUE_IS_ANY_STRING(*value)) return NULL;
+
+	string = get_string(value, &length);
+	return strndup(string, length);
+}
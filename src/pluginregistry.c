@@ -4,6 +4,7 @@
 
 #include <platformchannel.h>
 #include <pluginregistry.h>
+#include <timeline.h>
 
 #include <plugins/services.h>
 
@@ -29,6 +30,7 @@ struct platch_obj_recv_data {
 	char *channel;
 	enum platch_codec codec;
 	platch_obj_recv_callback callback;
+	bool string_views;
 };
 struct {
 	struct flutterpi_plugin *plugins;
@@ -88,7 +90,15 @@ int plugin_registry_init() {
 	// call all the init methods for all plugins
 	for (int i = 0; i < pluginregistry.plugin_count; i++) {
 		if (pluginregistry.plugins[i].init) {
+			char timeline_name[64];
+			int timeline_id;
+
+			snprintf(timeline_name, sizeof(timeline_name), "plugin init: %s", pluginregistry.plugins[i].name);
+
+			timeline_id = timeline_begin(timeline_name);
 			ok = pluginregistry.plugins[i].init();
+			timeline_end(timeline_id);
+
 			if (ok != 0) return ok;
 		}
 	}
@@ -96,18 +106,27 @@ int plugin_registry_init() {
 	return 0;
 }
 int plugin_registry_on_platform_message(FlutterPlatformMessage *message) {
+	struct platch_arena *arena;
 	struct platch_obj object;
 	int ok;
 
 	for (int i = 0; i < pluginregistry.platch_obj_cbs_size; i++) {
 		if ((pluginregistry.platch_obj_cbs[i].callback) && (strcmp(pluginregistry.platch_obj_cbs[i].channel, message->channel) == 0)) {
-			ok = platch_decode((uint8_t*) message->message, message->message_size, pluginregistry.platch_obj_cbs[i].codec, &object);
-			if (ok != 0) return ok;
-
-			pluginregistry.platch_obj_cbs[i].callback((char*) message->channel, &object, (FlutterPlatformMessageResponseHandle*) message->response_handle);
+			// the decoded object only lives until the callback returns, so decode it into the
+			// arena of this thread. After the first few messages, decoding doesn't allocate anything.
+			arena = platch_acquire_thread_arena();
+
+			if (pluginregistry.platch_obj_cbs[i].string_views) {
+				ok = platch_decode_string_views((uint8_t*) message->message, message->message_size, pluginregistry.platch_obj_cbs[i].codec, &object, arena);
+			} else {
+				ok = platch_decode_arena((uint8_t*) message->message, message->message_size, pluginregistry.platch_obj_cbs[i].codec, &object, arena);
+			}
+			if (ok == 0) {
+				pluginregistry.platch_obj_cbs[i].callback((char*) message->channel, &object, (FlutterPlatformMessageResponseHandle*) message->response_handle);
+			}
 
-			platch_free_obj(&object);
-			return 0;
+			platch_release_thread_arena();
+			return ok;
 		}
 	}
 
@@ -117,7 +136,7 @@ int plugin_registry_on_platform_message(FlutterPlatformMessage *message) {
 
 	return platch_respond_not_implemented((FlutterPlatformMessageResponseHandle *) message->response_handle);
 }
-int plugin_registry_set_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback) {
+static int set_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback, bool string_views) {
 	/// the index in 'callback' of the platch_obj_recv_data that will be added / updated.
 	int index = -1;
 
@@ -155,6 +174,7 @@ int plugin_registry_set_receiver(char *channel, enum platch_codec codec, platch_
 		pluginregistry.platch_obj_cbs[index].channel = channelCopy;
 		pluginregistry.platch_obj_cbs[index].codec = codec;
 		pluginregistry.platch_obj_cbs[index].callback = callback;
+		pluginregistry.platch_obj_cbs[index].string_views = string_views;
 	} else if (pluginregistry.platch_obj_cbs[index].callback) {
 		free(pluginregistry.platch_obj_cbs[index].channel);
 		pluginregistry.platch_obj_cbs[index].channel = NULL;
@@ -164,6 +184,12 @@ int plugin_registry_set_receiver(char *channel, enum platch_codec codec, platch_
 	return 0;
 	
 }
+int plugin_registry_set_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback) {
+	return set_receiver(channel, codec, callback, false);
+}
+int plugin_registry_set_view_receiver(char *channel, enum platch_codec codec, platch_obj_recv_callback callback) {
+	return set_receiver(channel, codec, callback, true);
+}
 int plugin_registry_deinit() {
 	int i, ok;
 	
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <flutter-pi.h>
 #include <pluginregistry.h>
@@ -10,40 +11,156 @@
 
 #include <plugins/raw_keyboard.h>
 
+/// Every key event message is this template, with the number slots and the type patched in.
+/// JSON allows whitespace around values, so the numbers are right-aligned in their
+/// space-padded slots and "keyup" is followed by two spaces.
+/// That way, all messages have the same length and encoding one needs no allocation.
+static const char key_event_template[] =
+    "{\"keymap\":\"linux\",\"toolkit\":\"glfw\","
+    "\"unicodeScalarValues\":           ,"
+    "\"keyCode\":           ,"
+    "\"scanCode\":           ,"
+    "\"modifiers\":           ,"
+    "\"type\":\"keydown\"}";
+
+#define KEY_EVENT_MESSAGE_SIZE (sizeof(key_event_template) - 1)
+
+/// The width of the number slots in the template. (enough for any int32_t or uint32_t)
+#define KEY_EVENT_NUMBER_WIDTH 11
+
+/// The number of key events a batch has room for at first. If more arrive before the platform thread
+/// sends them, the batch grows. (sending the rest right away would overtake the buffered events)
+#define INITIAL_KEY_EVENT_BATCH_CAPACITY 256
+
+typedef uint8_t key_event_message[KEY_EVENT_MESSAGE_SIZE];
+
+struct key_event_batch {
+    key_event_message *messages;
+    size_t n_messages, capacity;
+};
+
 struct {
     // same as mods, just that it differentiates between left and right-sided modifiers.
     uint16_t leftright_mods;
     glfw_keymod_map mods;
     bool initialized;
-} raw_keyboard = {.initialized = false};
+
+    // the offsets of the patch slots inside key_event_template.
+    size_t unicode_offset, key_code_offset, scan_code_offset, modifiers_offset, type_offset;
+
+    // the io thread fills one batch while the platform thread sends the other one.
+    pthread_mutex_t lock;
+    struct key_event_batch batches[2];
+    int i_filling_batch;
+    bool flush_scheduled;
+} raw_keyboard = {
+    .initialized = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/// Returns the offset of the value of the given key inside key_event_template.
+static size_t get_template_offset(const char *key) {
+    return strstr(key_event_template, key) - key_event_template + strlen(key);
+}
+
+/// Writes value right-aligned into the space-padded slot at dest.
+static void patch_number(uint8_t *dest, int64_t value) {
+    uint64_t magnitude = value < 0 ? -value : value;
+    int i = KEY_EVENT_NUMBER_WIDTH;
+
+    do {
+        dest[--i] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude && i);
+
+    if ((value < 0) && i) dest[--i] = '-';
+
+    while (i) dest[--i] = ' ';
+}
+
+static void encode_keyevent(uint8_t *message, uint32_t code_point, glfw_key key_code, uint32_t scan_code, glfw_keymod_map mods, bool is_down) {
+    memcpy(message, key_event_template, KEY_EVENT_MESSAGE_SIZE);
+
+    patch_number(message + raw_keyboard.unicode_offset, code_point);
+    patch_number(message + raw_keyboard.key_code_offset, key_code);
+    patch_number(message + raw_keyboard.scan_code_offset, scan_code);
+    patch_number(message + raw_keyboard.modifiers_offset, mods);
+
+    if (!is_down)
+        memcpy(message + raw_keyboard.type_offset, "\"keyup\"  ", strlen("\"keydown\""));
+}
 
 int rawkb_send_glfw_keyevent(uint32_t code_point, glfw_key key_code, uint32_t scan_code, glfw_keymod_map mods, bool is_down) {
-    return platch_send(
-        KEY_EVENT_CHANNEL,
-        &(struct platch_obj) {
-            .codec = kJSONMessageCodec,
-            .json_value = {
-                .type = kJsonObject,
-                .size = 7,
-                .keys = (char*[7]) {
-                    "keymap", "toolkit", "unicodeScalarValues", "keyCode", "scanCode",
-                    "modifiers", "type"
-                },
-                .values = (struct json_value[7]) {
-                    {.type = kJsonString, .string_value = "linux"},
-                    {.type = kJsonString, .string_value = "glfw"},
-                    {.type = kJsonNumber, .number_value = code_point},
-                    {.type = kJsonNumber, .number_value = key_code},
-                    {.type = kJsonNumber, .number_value = scan_code},
-                    {.type = kJsonNumber, .number_value = mods},
-                    {.type = kJsonString, .string_value = is_down? "keydown" : "keyup"}
-                }
+    struct key_event_batch *batch;
+    key_event_message *messages;
+    size_t capacity;
+
+    pthread_mutex_lock(&raw_keyboard.lock);
+
+    batch = raw_keyboard.batches + raw_keyboard.i_filling_batch;
+    if (batch->n_messages == batch->capacity) {
+        // the platform thread can't keep up. The batch is only sent once
+        // the platform thread swaps it, so it can grow in the meantime.
+        capacity = batch->capacity ? batch->capacity * 2 : INITIAL_KEY_EVENT_BATCH_CAPACITY;
+
+        messages = realloc(batch->messages, capacity * sizeof(key_event_message));
+        if (messages == NULL) {
+            pthread_mutex_unlock(&raw_keyboard.lock);
+            fprintf(stderr, "[raw_keyboard] Could not buffer key event, dropping it.\n");
+            return ENOMEM;
+        }
+
+        batch->messages = messages;
+        batch->capacity = capacity;
+    }
+
+    encode_keyevent(batch->messages[batch->n_messages++], code_point, key_code, scan_code, mods, is_down);
+
+    pthread_mutex_unlock(&raw_keyboard.lock);
+    return 0;
+}
+
+void rawkb_flush_keyevents(void) {
+    bool schedule;
+
+    pthread_mutex_lock(&raw_keyboard.lock);
+    schedule = !raw_keyboard.flush_scheduled && (raw_keyboard.batches[raw_keyboard.i_filling_batch].n_messages > 0);
+    if (schedule) raw_keyboard.flush_scheduled = true;
+    pthread_mutex_unlock(&raw_keyboard.lock);
+
+    if (schedule) {
+        post_platform_task(&(struct flutterpi_task) {
+            .type = kSendKeyEvents,
+            .target_time = 0
+        });
+    }
+}
+
+void rawkb_send_pending_keyevents(void) {
+    struct key_event_batch *batch;
+
+    // swap the batches, so the io thread can go on while we're sending.
+    // The next flush can only run after this one, so nobody fills this batch until we're done.
+    pthread_mutex_lock(&raw_keyboard.lock);
+    batch = raw_keyboard.batches + raw_keyboard.i_filling_batch;
+    raw_keyboard.i_filling_batch ^= 1;
+    raw_keyboard.flush_scheduled = false;
+    pthread_mutex_unlock(&raw_keyboard.lock);
+
+    for (int i = 0; i < batch->n_messages; i++) {
+        FlutterEngineSendPlatformMessage(
+            engine,
+            &(const FlutterPlatformMessage) {
+                .struct_size = sizeof(FlutterPlatformMessage),
+                .channel = KEY_EVENT_CHANNEL,
+                .message = batch->messages[i],
+                .message_size = KEY_EVENT_MESSAGE_SIZE,
+                .response_handle = NULL
             }
-        },
-        kJSONMessageCodec,
-        NULL,
-        NULL
-    );
+        );
+    }
+
+    batch->n_messages = 0;
 }
 
 int rawkb_on_keyevent(glfw_key key, uint32_t scan_code, glfw_key_action action) {
@@ -123,6 +240,12 @@ int rawkb_init(void) {
 
     raw_keyboard.leftright_mods = 0;
     raw_keyboard.mods = 0;
+
+    raw_keyboard.unicode_offset = get_template_offset("\"unicodeScalarValues\":");
+    raw_keyboard.key_code_offset = get_template_offset("\"keyCode\":");
+    raw_keyboard.scan_code_offset = get_template_offset("\"scanCode\":");
+    raw_keyboard.modifiers_offset = get_template_offset("\"modifiers\":");
+    raw_keyboard.type_offset = get_template_offset("\"type\":");
     raw_keyboard.initialized = true;
     
     printf("[raw_keyboard] Done.\n");
@@ -132,6 +255,11 @@ int rawkb_init(void) {
 int rawkb_deinit(void) {
     raw_keyboard.initialized = false;
 
+    for (int i = 0; i < 2; i++) {
+        free(raw_keyboard.batches[i].messages);
+        raw_keyboard.batches[i] = (struct key_event_batch) {0};
+    }
+
     printf("[raw_keyboard] deinit.\n");
     return 0;
 }
\ No newline at end of file
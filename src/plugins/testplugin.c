@@ -78,6 +78,9 @@ int __printStd(struct std_value *value, int indent) {
         case kStdLargeInt:
             printf("\"%s\"", value->string_value);
             break;
+        case kStdStringView:
+            printf("\"%.*s\"", (int) value->size, value->string_view);
+            break;
         case kStdUInt8Array:
             printf("(uint8_t) [");
             for (int i = 0; i < value->size; i++) {
@@ -6,6 +6,7 @@
 
 #include <flutter-pi.h>
 #include <pluginregistry.h>
+#include <text_buffer.h>
 #include <plugins/text_input.h>
 
 struct {
@@ -13,16 +14,40 @@ struct {
     enum text_input_type input_type;
     bool autocorrect;
     enum text_input_action input_action;
-    char text[TEXT_INPUT_MAX_CHARS];
+    struct text_buffer text;
+    // the selection & composing indices are UTF-16 code unit indices, like in flutter.
     int  selection_base, selection_extent;
     bool selection_affinity_is_downstream;
     bool selection_is_directional;
     int  composing_base, composing_extent;
     bool warned_about_autocorrect;
+
+    /// true if the client wants TextInputClient.updateEditingStateWithDeltas
+    /// instead of TextInputClient.updateEditingState.
+    bool enable_delta_model;
+
+    /// true if the editing state changed since it was last sent to flutter.
+    bool needs_sync;
+
+    /// The edits since the last sync, merged into one replacement:
+    /// [delta_old_start, delta_old_end) of delta_old_text was replaced by
+    /// what's now at [delta_new_start, delta_new_end) of text. (All UTF-16 indices.)
+    bool has_text_delta;
+    char *delta_old_text;
+    size_t delta_old_start, delta_old_end;
+    size_t delta_new_start, delta_new_end;
 } text_input = {
     .transaction_id = -1
 };
 
+/// Forgets the changes that weren't sent to flutter yet, because flutter set a new editing state.
+static void textin_discard_pending_changes(void) {
+    free(text_input.delta_old_text);
+    text_input.delta_old_text = NULL;
+    text_input.has_text_delta = false;
+    text_input.needs_sync = false;
+}
+
 int textin_on_receive(char *channel, struct platch_obj *object, FlutterPlatformMessageResponseHandle *responsehandle) {
     struct json_value jsvalue, *temp, *temp2, *state, *config;
     int ok;
@@ -69,7 +94,7 @@ int textin_on_receive(char *channel, struct platch_obj *object, FlutterPlatformM
         }
 
         enum text_input_type input_type;
-        bool autocorrect;
+        bool autocorrect, enable_delta_model;
         enum text_input_action input_action;
 
         // AUTOCORRECT
@@ -78,6 +103,10 @@ int textin_on_receive(char *channel, struct platch_obj *object, FlutterPlatformM
             goto invalid_config;
 
         autocorrect = temp->type == kJsonTrue;
+
+        // DELTA MODEL (optional, older flutter versions don't send it)
+        temp = jsobject_get(config, "enableDeltaModel");
+        enable_delta_model = temp && (temp->type == kJsonTrue);
         
         // INPUT ACTION
         temp = jsobject_get(config, "inputAction");
@@ -154,6 +183,8 @@ int textin_on_receive(char *channel, struct platch_obj *object, FlutterPlatformM
         text_input.autocorrect = autocorrect;
         text_input.input_action = input_action;
         text_input.input_type = input_type;
+        text_input.enable_delta_model = enable_delta_model;
+        textin_discard_pending_changes();
 
         if (autocorrect && (!text_input.warned_about_autocorrect)) {
             printf("[text_input] warning: flutter requested native autocorrect, which"
@@ -258,7 +289,16 @@ int textin_on_receive(char *channel, struct platch_obj *object, FlutterPlatformM
         else                                    goto invalid_editing_value;
 
 
-        snprintf(text_input.text, sizeof(text_input.text), "%s", text);
+        if (!text_buffer_set(&text_input.text, text)) {
+            return platch_respond_error_json(
+                responsehandle,
+                "nomem",
+                "Not enough memory to store the text editing value.",
+                NULL
+            );
+        }
+
+        textin_discard_pending_changes();
         text_input.selection_base = selection_base;
         text_input.selection_extent = selection_extent;
         text_input.selection_affinity_is_downstream = selection_affinity_is_downstream;
@@ -341,7 +381,7 @@ int textin_sync_editing_state() {
                             "selectionIsDirectional", "composingBase", "composingExtent"
                         },
                         .values = (struct json_value[7]) {
-                            {.type = kJsonString, .string_value = text_input.text},
+                            {.type = kJsonString, .string_value = (char*) text_buffer_get_string(&text_input.text)},
                             {.type = kJsonNumber, .number_value = text_input.selection_base},
                             {.type = kJsonNumber, .number_value = text_input.selection_extent},
                             {
@@ -363,6 +403,106 @@ int textin_sync_editing_state() {
     );
 }
 
+int textin_sync_editing_state_delta(void) {
+    const char *text;
+    char *old_text, *delta_text;
+    int delta_start, delta_end;
+    size_t start_byte, end_byte;
+    int ok;
+
+    text = text_buffer_get_string(&text_input.text);
+    if (text == NULL) return ENOMEM;
+
+    if (text_input.has_text_delta) {
+        start_byte = text_buffer_get_byte_offset(&text_input.text, text_input.delta_new_start);
+        end_byte = text_buffer_get_byte_offset(&text_input.text, text_input.delta_new_end);
+
+        delta_text = strndup(text + start_byte, end_byte - start_byte);
+        if (delta_text == NULL) return ENOMEM;
+
+        old_text = text_input.delta_old_text;
+        delta_start = text_input.delta_old_start;
+        delta_end = text_input.delta_old_end;
+    } else {
+        // only the selection changed.
+        delta_text = NULL;
+        old_text = (char*) text;
+        delta_start = -1;
+        delta_end = -1;
+    }
+
+    ok = platch_send(
+        TEXT_INPUT_CHANNEL,
+        &(struct platch_obj) {
+            .codec = kJSONMethodCall,
+            .method = "TextInputClient.updateEditingStateWithDeltas",
+            .json_arg = {
+                .type = kJsonArray,
+                .size = 2,
+                .array = (struct json_value[2]) {
+                    {.type = kJsonNumber, .number_value = text_input.transaction_id},
+                    {.type = kJsonObject, .size = 1,
+                        .keys = (char*[1]) {"deltas"},
+                        .values = (struct json_value[1]) {
+                            {.type = kJsonArray, .size = 1,
+                                .array = (struct json_value[1]) {
+                                    {.type = kJsonObject, .size = 10,
+                                        .keys = (char*[10]) {
+                                            "oldText", "deltaText", "deltaStart", "deltaEnd",
+                                            "selectionBase", "selectionExtent", "selectionAffinity",
+                                            "selectionIsDirectional", "composingBase", "composingExtent"
+                                        },
+                                        .values = (struct json_value[10]) {
+                                            {.type = kJsonString, .string_value = old_text},
+                                            {.type = kJsonString, .string_value = delta_text ? delta_text : ""},
+                                            {.type = kJsonNumber, .number_value = delta_start},
+                                            {.type = kJsonNumber, .number_value = delta_end},
+                                            {.type = kJsonNumber, .number_value = text_input.selection_base},
+                                            {.type = kJsonNumber, .number_value = text_input.selection_extent},
+                                            {
+                                                .type = kJsonString,
+                                                .string_value = text_input.selection_affinity_is_downstream ?
+                                                    "TextAffinity.downstream" : "TextAffinity.upstream"
+                                            },
+                                            {.type = text_input.selection_is_directional? kJsonTrue : kJsonFalse},
+                                            {.type = kJsonNumber, .number_value = text_input.composing_base},
+                                            {.type = kJsonNumber, .number_value = text_input.composing_extent}
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        },
+        kJSONMethodCallResponse,
+        NULL,
+        NULL
+    );
+
+    free(delta_text);
+
+    return ok;
+}
+
+int textin_flush_editing_state(void) {
+    int ok;
+
+    if (!text_input.needs_sync || (text_input.transaction_id == -1))
+        return 0;
+
+    if (text_input.enable_delta_model) {
+        ok = textin_sync_editing_state_delta();
+    } else {
+        ok = textin_sync_editing_state();
+    }
+
+    textin_discard_pending_changes();
+
+    return ok;
+}
+
 int textin_perform_action(enum text_input_action action) {
 
     char *action_str =
@@ -412,64 +552,88 @@ int textin_on_connection_closed(void) {
     );
 }
 
-inline int to_byte_index(unsigned int symbol_index) {
-    char *cursor = text_input.text;
+/// Replaces the text between the UTF-16 indices start and end with n_bytes of utf8,
+/// and merges the change into the pending delta. Returns the index after the inserted
+/// text, or -1 if there's not enough memory.
+static int textin_replace(size_t start, size_t end, const char *utf8, size_t n_bytes) {
+    const char *old_text;
+    size_t index, n_inserted;
 
-    while ((*cursor) && (symbol_index--))
-        cursor += utf8_symbol_length(cursor);
+    if (text_input.enable_delta_model && !text_input.has_text_delta) {
+        old_text = text_buffer_get_string(&text_input.text);
+        if (old_text != NULL) text_input.delta_old_text = strdup(old_text);
 
-    if (*cursor)
-        return cursor - text_input.text;
+        if ((old_text == NULL) || (text_input.delta_old_text == NULL)) {
+            fprintf(stderr, "[text_input] Not enough memory to track text editing deltas. Sending the whole editing state instead.\n");
+            text_input.enable_delta_model = false;
+        }
+    }
 
-    return -1;
-}
+    index = text_buffer_erase(&text_input.text, start, end);
+    if (n_bytes) {
+        index = text_buffer_insert(&text_input.text, index, utf8, n_bytes);
+        if (index == (size_t) -1) return -1;
+    }
+    n_inserted = index - start;
+
+    if (!text_input.enable_delta_model) {
+        return index;
+    } else if (!text_input.has_text_delta) {
+        text_input.delta_old_start = start;
+        text_input.delta_old_end = end;
+        text_input.delta_new_start = start;
+        text_input.delta_new_end = index;
+        text_input.has_text_delta = true;
+    } else {
+        // grow the pending replacement so it covers this change too. The text between
+        // the two changes is unchanged, so it maps 1:1 between the old and the new text.
+        if (start < text_input.delta_new_start) {
+            text_input.delta_old_start -= text_input.delta_new_start - start;
+            text_input.delta_new_start = start;
+        }
+        if (end > text_input.delta_new_end) {
+            text_input.delta_old_end += end - text_input.delta_new_end;
+            text_input.delta_new_end = end;
+        }
+        text_input.delta_new_end = text_input.delta_new_end + n_inserted - (end - start);
+    }
 
-// start and end index are both inclusive.
-int  textin_erase(unsigned int start, unsigned int end) {
-    // 0 <= start <= end < len
+    return index;
+}
 
-    char *start_str     = utf8_symbol_at(text_input.text, start);
-    char *after_end_str = utf8_symbol_at(text_input.text, end+1);
+bool textin_delete_selected(void) {
+    int start, end;
 
-    if (start_str && after_end_str)
-        memmove(start_str, after_end_str, strlen(after_end_str) + 1 /* null byte */);
+    start = text_input.selection_base < text_input.selection_extent ? text_input.selection_base : text_input.selection_extent;
+    end   = text_input.selection_base < text_input.selection_extent ? text_input.selection_extent : text_input.selection_base;
 
-    return start;
-}
-bool textin_delete_selected(void) {
     // erase selected text
-    text_input.selection_base = textin_erase(text_input.selection_base, text_input.selection_extent-1);
+    text_input.selection_base = textin_replace(start, end, NULL, 0);
     text_input.selection_extent = text_input.selection_base;
     return true;
 }
 bool textin_add_utf8_char(char *c) {
     size_t symbol_length;
-    char  *to_move;
-
-    if (text_input.selection_base != text_input.selection_extent)
-        textin_delete_selected();
-
-    // find out where in our string we need to insert the utf8 symbol
 
     symbol_length = utf8_symbol_length(c);
-    to_move       = utf8_symbol_at(text_input.text, text_input.selection_base);
-
-    if (!to_move || !symbol_length)
+    if (!symbol_length)
         return false;
 
-    // move the string behind the insertion position to
-    // make place for the utf8 character
+    return textin_add_utf8_text(c, symbol_length);
+}
+bool textin_add_utf8_text(const char *text, size_t n_bytes) {
+    int index;
 
-    memmove(to_move + symbol_length, to_move, strlen(to_move) + 1 /* null byte */);
+    if (text_input.selection_base != text_input.selection_extent)
+        textin_delete_selected();
 
-    // after the move, to_move points to the memory
-    // where c should be inserted
-    for (int i = 0; i < symbol_length; i++)
-        to_move[i] = c[i];
+    index = textin_replace(text_input.selection_base, text_input.selection_base, text, n_bytes);
+    if (index == -1)
+        return false;
 
-    // move our selection to behind the inserted char
-    text_input.selection_extent++;
-    text_input.selection_base = text_input.selection_extent;
+    // move our selection to behind the inserted text
+    text_input.selection_base = index;
+    text_input.selection_extent = index;
 
     return true;
 }
@@ -478,8 +642,8 @@ bool textin_backspace(void) {
         return textin_delete_selected();
     
     if (text_input.selection_base != 0) {
-        int base = text_input.selection_base - 1;
-        text_input.selection_base = textin_erase(base, base);
+        int base = text_buffer_previous_index(&text_input.text, text_input.selection_base);
+        text_input.selection_base = textin_replace(base, text_input.selection_base, NULL, 0);
         text_input.selection_extent = text_input.selection_base;
         return true;
     }
@@ -490,8 +654,9 @@ bool textin_delete(void) {
     if (text_input.selection_base != text_input.selection_extent)
         return textin_delete_selected();
     
-    if (text_input.selection_base < strlen(text_input.text)) {
-        text_input.selection_base = textin_erase(text_input.selection_base, text_input.selection_base);
+    if (text_input.selection_base < text_buffer_get_length(&text_input.text)) {
+        int end = text_buffer_next_index(&text_input.text, text_input.selection_base);
+        text_input.selection_base = textin_replace(text_input.selection_base, end, NULL, 0);
         text_input.selection_extent = text_input.selection_base;
         return true;
     }
@@ -508,7 +673,7 @@ bool textin_move_cursor_to_beginning(void) {
     return false;
 }
 bool textin_move_cursor_to_end(void) {
-    int end = strlen(text_input.text);
+    int end = text_buffer_get_length(&text_input.text);
 
     if (text_input.selection_base != end) {
         text_input.selection_base = end;
@@ -524,9 +689,9 @@ bool textin_move_cursor_forward(void) {
         return true;
     }
 
-    if (text_input.selection_extent < strlen(text_input.text)) {
-        text_input.selection_extent++;
-        text_input.selection_base++;
+    if (text_input.selection_extent < text_buffer_get_length(&text_input.text)) {
+        text_input.selection_extent = text_buffer_next_index(&text_input.text, text_input.selection_extent);
+        text_input.selection_base = text_input.selection_extent;
         return true;
     }
 
@@ -539,17 +704,17 @@ bool textin_move_cursor_back(void) {
     }
 
     if (text_input.selection_base > 0) {
-        text_input.selection_base--;
-        text_input.selection_extent--;
+        text_input.selection_base = text_buffer_previous_index(&text_input.text, text_input.selection_base);
+        text_input.selection_extent = text_input.selection_base;
         return true;
     }
 
     return false;
 }
 
-
-// these two functions automatically sync the editing state with flutter if
-// a change ocurred, so you don't explicitly need to call textin_sync_editing_state().
+// these functions only remember that the editing state changed. The changes are sent
+// to flutter in one message by textin_flush_editing_state(), which should be called once all
+// the input that was read at once was processed.
 // `c` doesn't need to be NULL-terminated, the length of the char will be calculated
 // using the start byte.
 int textin_on_utf8_char(char *c) {
@@ -557,7 +722,18 @@ int textin_on_utf8_char(char *c) {
         return 0;
 
     if (textin_add_utf8_char(c))
-        return textin_sync_editing_state();
+        text_input.needs_sync = true;
+
+    return 0;
+}
+
+// `text` doesn't need to be NULL-terminated, and is inserted in one piece.
+int textin_on_utf8_text(const char *text, size_t n_bytes) {
+    if (text_input.transaction_id == -1)
+        return 0;
+
+    if (textin_add_utf8_text(text, n_bytes))
+        text_input.needs_sync = true;
 
     return 0;
 }
@@ -599,12 +775,14 @@ int textin_on_key(glfw_key key) {
             break;
     }
 
-    if (needs_sync) {
-        ok = textin_sync_editing_state();
-        if (ok != 0) return ok;
-    }
+    if (needs_sync)
+        text_input.needs_sync = true;
 
     if (perform_action) {
+        // flutter should see the text before the action is performed.
+        ok = textin_flush_editing_state();
+        if (ok != 0) return ok;
+
         ok = textin_perform_action(text_input.input_action);
         if (ok != 0) return ok;
     }
@@ -618,7 +796,9 @@ int textin_init(void) {
 
     printf("[test_input] Initializing...\n");
 
-    text_input.text[0] = '\0';
+    if (!text_buffer_init(&text_input.text))
+        return ENOMEM;
+
     text_input.warned_about_autocorrect = false;
 
     ok = plugin_registry_set_receiver(TEXT_INPUT_CHANNEL, kJSONMethodCall, textin_on_receive);
@@ -632,5 +812,8 @@ int textin_init(void) {
 int textin_deinit(void) {
     printf("[text_input] deinit.\n");
 
+    textin_discard_pending_changes();
+    text_buffer_deinit(&text_input.text);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <flutter-pi.h>
+#include <pointer_resampler.h>
+
+/// The number of samples remembered per pointer.
+#define N_POINTER_SAMPLES 4
+
+struct pointer_sample {
+	uint64_t time_ns;
+	FlutterPointerEvent event;
+};
+
+struct pointer_history {
+	int32_t device;
+	bool in_use;
+
+	/// true if samples arrived since the last flush.
+	bool has_new_samples;
+
+	/// true if the last event sent for this pointer wasn't the newest sample
+	/// (it was interpolated or extrapolated), so the next flush should send the newest sample
+	/// even if no new samples arrived.
+	bool needs_settle;
+
+	/// the timestamp of the last event sent for this pointer.
+	/// Resampled events never go back in time, even if the pointer settles
+	/// at the newest sample after it was extrapolated past it.
+	size_t last_timestamp;
+
+	/// the last samples, oldest first.
+	struct pointer_sample samples[N_POINTER_SAMPLES];
+	int n_samples;
+};
+
+struct {
+	pthread_mutex_t lock;
+	void (*schedule_flush)(void);
+	bool flush_scheduled;
+
+	struct pointer_history *histories;
+	size_t n_histories;
+
+	struct pointer_event_buffer buffer;
+} resampler = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+void pointer_resampler_init(void (*schedule_flush)(void)) {
+	resampler.schedule_flush = schedule_flush;
+}
+
+static struct pointer_history *find_history(int32_t device) {
+	for (int i = 0; i < resampler.n_histories; i++)
+		if (resampler.histories[i].in_use && (resampler.histories[i].device == device))
+			return resampler.histories + i;
+
+	return NULL;
+}
+
+static struct pointer_history *get_or_create_history(int32_t device) {
+	struct pointer_history *history, *histories;
+
+	history = find_history(device);
+	if (history != NULL) return history;
+
+	for (int i = 0; i < resampler.n_histories; i++) {
+		if (!resampler.histories[i].in_use) {
+			history = resampler.histories + i;
+			break;
+		}
+	}
+
+	if (history == NULL) {
+		histories = realloc(resampler.histories, (resampler.n_histories + 1) * sizeof(*histories));
+		if (histories == NULL) return NULL;
+
+		resampler.histories = histories;
+		history = resampler.histories + resampler.n_histories++;
+	}
+
+	memset(history, 0, sizeof(*history));
+	history->device = device;
+	history->in_use = true;
+
+	return history;
+}
+
+/// Sends the events in resampler.buffer to the engine and clears it.
+static bool send_buffer(void) {
+	bool ok = true;
+
+	if (resampler.buffer.n_events > 0)
+		ok = FlutterEngineSendPointerEvent(engine, resampler.buffer.events, resampler.buffer.n_events) == kSuccess;
+
+	resampler.buffer.n_events = 0;
+	return ok;
+}
+
+bool pointer_resampler_send(const FlutterPointerEvent *events, size_t n_events) {
+	struct pointer_history *history;
+	bool ok, has_buffered = false;
+
+	pthread_mutex_lock(&resampler.lock);
+
+	for (int i = 0; i < n_events; i++) {
+		if ((events[i].phase == kMove) || (events[i].phase == kHover)) {
+			history = get_or_create_history(events[i].device);
+			if (history != NULL) {
+				if (history->n_samples == N_POINTER_SAMPLES) {
+					memmove(history->samples, history->samples + 1, (N_POINTER_SAMPLES - 1) * sizeof(struct pointer_sample));
+					history->n_samples--;
+				}
+
+				history->samples[history->n_samples++] = (struct pointer_sample) {
+					.time_ns = events[i].timestamp * 1000ull,
+					.event = events[i]
+				};
+				history->has_new_samples = true;
+				has_buffered = true;
+				continue;
+			}
+		} else {
+			// a transition. The event carries the newest position, so the buffered
+			// samples can be dropped. The next gesture starts with a fresh history.
+			history = find_history(events[i].device);
+			if (history != NULL) history->in_use = false;
+		}
+
+		pointer_event_buffer_push(&resampler.buffer, events + i);
+	}
+
+	ok = send_buffer();
+
+	if (has_buffered && !resampler.flush_scheduled && resampler.schedule_flush) {
+		resampler.flush_scheduled = true;
+		resampler.schedule_flush();
+	}
+
+	pthread_mutex_unlock(&resampler.lock);
+
+	return ok;
+}
+
+/// Calculates the pointer event for history at sample_time_ns.
+/// Returns true if the result is exactly the newest sample.
+static bool resample(struct pointer_history *history, uint64_t sample_time_ns, FlutterPointerEvent *event_out) {
+	struct pointer_sample *a, *b, *newest = history->samples + history->n_samples - 1;
+	double f;
+
+	*event_out = newest->event;
+
+	// nothing to interpolate with, or no new samples since the last flush:
+	// settle at the newest position instead of extrapolating again.
+	if ((history->n_samples == 1) || !history->has_new_samples)
+		return true;
+
+	if (sample_time_ns >= newest->time_ns) {
+		// extrapolate, but not too far, and not further than half the time between the last two samples.
+		uint64_t dt, max_dt;
+
+		a = newest - 1;
+		b = newest;
+
+		if (b->time_ns <= a->time_ns) return true;
+
+		dt = sample_time_ns - b->time_ns;
+		max_dt = (b->time_ns - a->time_ns) / 2;
+		if (max_dt > POINTER_MAX_EXTRAPOLATION_NS) max_dt = POINTER_MAX_EXTRAPOLATION_NS;
+		if (dt > max_dt) dt = max_dt;
+
+		if (dt == 0) return true;
+
+		f = 1.0 + (double) dt / (double) (b->time_ns - a->time_ns);
+	} else {
+		// interpolate between the two samples around sample_time_ns.
+		int i;
+
+		for (i = history->n_samples - 1; (i > 0) && (history->samples[i - 1].time_ns > sample_time_ns); i--);
+
+		if (i == 0) {
+			// all samples are newer than sample_time_ns
+			*event_out = history->samples[0].event;
+			return history->n_samples == 1;
+		}
+
+		a = history->samples + i - 1;
+		b = history->samples + i;
+
+		if (b->time_ns <= a->time_ns) {
+			*event_out = b->event;
+			return b == newest;
+		}
+
+		f = (double) (sample_time_ns - a->time_ns) / (double) (b->time_ns - a->time_ns);
+	}
+
+	event_out->x = a->event.x + (b->event.x - a->event.x) * f;
+	event_out->y = a->event.y + (b->event.y - a->event.y) * f;
+	event_out->timestamp = a->event.timestamp + (size_t) (((double) b->event.timestamp - (double) a->event.timestamp) * f);
+
+	return false;
+}
+
+void pointer_resampler_flush(uint64_t frame_time_ns) {
+	struct pointer_history *history;
+	FlutterPointerEvent event;
+	uint64_t sample_time_ns;
+	bool needs_settle = false;
+
+	pthread_mutex_lock(&resampler.lock);
+
+	resampler.flush_scheduled = false;
+
+	sample_time_ns = frame_time_ns > POINTER_RESAMPLE_LATENCY_NS ? frame_time_ns - POINTER_RESAMPLE_LATENCY_NS : 0;
+
+	for (int i = 0; i < resampler.n_histories; i++) {
+		history = resampler.histories + i;
+		if (!history->in_use || (!history->has_new_samples && !history->needs_settle))
+			continue;
+
+		history->needs_settle = !resample(history, sample_time_ns, &event);
+		history->has_new_samples = false;
+
+		if (event.timestamp < history->last_timestamp)
+			event.timestamp = history->last_timestamp;
+		history->last_timestamp = event.timestamp;
+
+		needs_settle = needs_settle || history->needs_settle;
+
+		pointer_event_buffer_push(&resampler.buffer, &event);
+	}
+
+	if (!send_buffer())
+		fprintf(stderr, "could not send resampled pointer events to flutter engine\n");
+
+	if (needs_settle && resampler.schedule_flush) {
+		resampler.flush_scheduled = true;
+		resampler.schedule_flush();
+	}
+
+	pthread_mutex_unlock(&resampler.lock);
+}
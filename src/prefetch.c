@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+#include <prefetch.h>
+
+struct prefetch_watch {
+	int wd;
+	/// the watched directory, relative to the asset bundle. ("" for the asset bundle itself)
+	char *dir;
+};
+
+/// A growable list of paths.
+struct path_list {
+	char **paths;
+	size_t n_paths;
+	size_t capacity;
+};
+
+struct prefetch_mapping {
+	void *address;
+	size_t size;
+};
+
+struct {
+	char asset_bundle_path[PATH_MAX];
+	char list_path[PATH_MAX];
+	bool has_list;
+	bool lock_in_memory;
+
+	/// the assets listed in the list file, relative to the asset bundle.
+	struct path_list listed;
+
+	int inotify_fd;
+	struct prefetch_watch *watches;
+	size_t n_watches;
+
+	/// the files that were prefetched already (absolute paths), so the
+	/// snapshot isn't prefetched again if it's listed too.
+	struct path_list prefetched;
+
+	struct prefetch_mapping *mappings;
+	size_t n_mappings;
+} prefetch = {
+	.inotify_fd = -1
+};
+
+
+/// Returns the index of path in list, or -1 if it's not in the list.
+static int path_list_find(const struct path_list *list, const char *path) {
+	for (int i = 0; i < list->n_paths; i++)
+		if (strcmp(list->paths[i], path) == 0)
+			return i;
+
+	return -1;
+}
+
+/// Appends path to the list. Returns the index of the new entry, or -1 if
+/// there's not enough memory.
+static int path_list_add(struct path_list *list, const char *path) {
+	char **paths;
+
+	if (list->n_paths == list->capacity) {
+		size_t capacity = list->capacity ? list->capacity * 2 : 16;
+
+		paths = realloc(list->paths, capacity * sizeof(*paths));
+		if (paths == NULL)
+			return -1;
+		list->paths = paths;
+		list->capacity = capacity;
+	}
+
+	list->paths[list->n_paths] = strdup(path);
+	if (list->paths[list->n_paths] == NULL)
+		return -1;
+
+	return list->n_paths++;
+}
+
+static void path_list_free(struct path_list *list) {
+	for (int i = 0; i < list->n_paths; i++)
+		free(list->paths[i]);
+
+	free(list->paths);
+	memset(list, 0, sizeof(*list));
+}
+
+/// Returns the part of path relative to the asset bundle,
+/// or NULL if path isn't inside the asset bundle.
+static const char *get_relative_path(const char *path) {
+	size_t length = strlen(prefetch.asset_bundle_path);
+
+	if ((strncmp(path, prefetch.asset_bundle_path, length) != 0) || ((path[length] != '/') && (path[length] != '\0')))
+		return NULL;
+
+	for (path += length; *path == '/'; path++);
+
+	return path;
+}
+
+static bool read_list(void) {
+	char line[PATH_MAX];
+	FILE *file;
+	size_t length;
+
+	file = fopen(prefetch.list_path, "r");
+	if (file == NULL) {
+		if (errno != ENOENT) {
+			fprintf(stderr, "[prefetch] Could not open prefetch list \"%s\": %s\n", prefetch.list_path, strerror(errno));
+		}
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		length = strcspn(line, "\r\n");
+		line[length] = '\0';
+
+		if ((length == 0) || (line[0] == '#') || (path_list_find(&prefetch.listed, line) != -1))
+			continue;
+
+		if (path_list_add(&prefetch.listed, line) == -1)
+			break;
+	}
+
+	fclose(file);
+
+	return true;
+}
+
+static bool write_list(const struct path_list *list) {
+	char tmp_path[PATH_MAX + 4];
+	FILE *file;
+	bool ok;
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", prefetch.list_path);
+
+	file = fopen(tmp_path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "[prefetch] Could not write prefetch list \"%s\": %s\n", prefetch.list_path, strerror(errno));
+		return false;
+	}
+
+	fprintf(file, "# asset files opened by the flutter engine during startup, in the order they were opened.\n");
+	for (int i = 0; i < list->n_paths; i++)
+		fprintf(file, "%s\n", list->paths[i]);
+
+	ok = !ferror(file);
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok || (rename(tmp_path, prefetch.list_path) != 0)) {
+		fprintf(stderr, "[prefetch] Could not write prefetch list \"%s\": %s\n", prefetch.list_path, strerror(errno));
+		unlink(tmp_path);
+		return false;
+	}
+
+	return true;
+}
+
+static int on_asset_bundle_entry(const char *path, const struct stat *statbuf, int type, struct FTW *ftwbuf) {
+	struct prefetch_watch *watches;
+	int wd;
+
+	if (type != FTW_D)
+		return 0;
+
+	wd = inotify_add_watch(prefetch.inotify_fd, path, IN_OPEN | IN_ONLYDIR);
+	if (wd < 0) {
+		fprintf(stderr, "[prefetch] Could not watch \"%s\": %s\n", path, strerror(errno));
+		return 0;
+	}
+
+	watches = realloc(prefetch.watches, (prefetch.n_watches + 1) * sizeof(*watches));
+	if (watches == NULL)
+		return FTW_STOP;
+
+	prefetch.watches = watches;
+	prefetch.watches[prefetch.n_watches].wd = wd;
+	prefetch.watches[prefetch.n_watches].dir = strdup(get_relative_path(path));
+	if (prefetch.watches[prefetch.n_watches].dir == NULL)
+		return FTW_STOP;
+
+	prefetch.n_watches++;
+
+	return 0;
+}
+
+bool prefetch_init(const char *asset_bundle_path, const char *list_path, bool lock_in_memory) {
+	size_t length;
+
+	snprintf(prefetch.asset_bundle_path, sizeof(prefetch.asset_bundle_path), "%s", asset_bundle_path);
+	for (length = strlen(prefetch.asset_bundle_path); (length > 1) && (prefetch.asset_bundle_path[length - 1] == '/'); length--)
+		prefetch.asset_bundle_path[length - 1] = '\0';
+
+	prefetch.lock_in_memory = lock_in_memory;
+	prefetch.has_list = list_path != NULL;
+
+	if (!prefetch.has_list)
+		return true;
+
+	snprintf(prefetch.list_path, sizeof(prefetch.list_path), "%s", list_path);
+
+	if (read_list()) {
+		printf("[prefetch] %u asset files listed in \"%s\".\n", (unsigned int) prefetch.listed.n_paths, prefetch.list_path);
+	} else {
+		printf("[prefetch] No prefetch list at \"%s\" yet, recording one.\n", prefetch.list_path);
+	}
+
+	// watch the asset bundle so we can record which files the engine opens.
+	prefetch.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (prefetch.inotify_fd < 0) {
+		fprintf(stderr, "[prefetch] Could not create inotify instance, asset opens won't be recorded. inotify_init1: %s\n", strerror(errno));
+		return true;
+	}
+
+	nftw(prefetch.asset_bundle_path, on_asset_bundle_entry, 16, FTW_PHYS);
+
+	return true;
+}
+
+static void prefetch_file(const char *path) {
+	struct prefetch_mapping *mappings;
+	struct stat statbuf;
+	void *address;
+	int fd;
+
+	if ((path_list_find(&prefetch.prefetched, path) != -1) || (path_list_add(&prefetch.prefetched, path) == -1))
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "[prefetch] Could not open \"%s\": %s\n", path, strerror(errno));
+		return;
+	}
+
+	if (fstat(fd, &statbuf) != 0) {
+		fprintf(stderr, "[prefetch] Could not stat \"%s\": %s\n", path, strerror(errno));
+		goto close_fd;
+	}
+
+	if (statbuf.st_size == 0)
+		goto close_fd;
+
+	if (prefetch.lock_in_memory) {
+		// the mapping keeps the file locked in the page cache after the fd is closed.
+		address = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (address == MAP_FAILED) {
+			fprintf(stderr, "[prefetch] Could not map \"%s\": %s\n", path, strerror(errno));
+		} else if (mlock(address, statbuf.st_size) != 0) {
+			fprintf(stderr, "[prefetch] Could not lock \"%s\" into memory: %s\n", path, strerror(errno));
+			munmap(address, statbuf.st_size);
+		} else {
+			mappings = realloc(prefetch.mappings, (prefetch.n_mappings + 1) * sizeof(*mappings));
+			if (mappings == NULL) {
+				munmap(address, statbuf.st_size);
+			} else {
+				prefetch.mappings = mappings;
+				prefetch.mappings[prefetch.n_mappings++] = (struct prefetch_mapping) {
+					.address = address,
+					.size = statbuf.st_size
+				};
+				goto close_fd;
+			}
+		}
+	}
+
+	if (readahead(fd, 0, statbuf.st_size) != 0) {
+		fprintf(stderr, "[prefetch] Could not prefetch \"%s\": %s\n", path, strerror(errno));
+	}
+
+	close_fd:
+	close(fd);
+}
+
+bool prefetch_files(const char *const *paths, int n_paths) {
+	char path[PATH_MAX + 256];
+
+	for (int i = 0; i < n_paths; i++)
+		prefetch_file(paths[i]);
+
+	for (int i = 0; i < prefetch.listed.n_paths; i++) {
+		snprintf(path, sizeof(path), "%s/%s", prefetch.asset_bundle_path, prefetch.listed.paths[i]);
+		prefetch_file(path);
+	}
+
+	return true;
+}
+
+static const char *get_watch_dir(int wd) {
+	for (int i = 0; i < prefetch.n_watches; i++)
+		if (prefetch.watches[i].wd == wd)
+			return prefetch.watches[i].dir;
+
+	return NULL;
+}
+
+void prefetch_finish_recording(void) {
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX + 256];
+	struct path_list recorded = {0};
+	size_t n_kept;
+	bool overflowed = false;
+	const char *dir;
+	ssize_t n_read;
+
+	if (prefetch.inotify_fd < 0)
+		return;
+
+	// inotify can't tell our own opens (while prefetching) from the ones of the engine,
+	// and it merges identical events queued right after each other. So we can't find out
+	// whether the engine opened a listed file too; keep all the listed files that still exist
+	// and only add the new ones.
+	for (int i = 0; i < prefetch.listed.n_paths; i++) {
+		snprintf(path, sizeof(path), "%s/%s", prefetch.asset_bundle_path, prefetch.listed.paths[i]);
+		if (access(path, F_OK) == 0)
+			path_list_add(&recorded, prefetch.listed.paths[i]);
+	}
+	n_kept = recorded.n_paths;
+
+	// All the opens until now are still queued in the inotify instance.
+	while ((n_read = read(prefetch.inotify_fd, buffer, sizeof(buffer))) > 0) {
+		for (char *cursor = buffer; cursor < buffer + n_read;) {
+			struct inotify_event *event = (struct inotify_event *) cursor;
+
+			cursor += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+				overflowed = true;
+
+			if ((event->mask & IN_ISDIR) || !(event->mask & IN_OPEN) || (event->len == 0))
+				continue;
+
+			dir = get_watch_dir(event->wd);
+			if (dir == NULL)
+				continue;
+
+			snprintf(path, sizeof(path), "%s%s%s", dir, dir[0] ? "/" : "", event->name);
+
+			if (path_list_find(&recorded, path) == -1)
+				path_list_add(&recorded, path);
+		}
+	}
+
+	close(prefetch.inotify_fd);
+	prefetch.inotify_fd = -1;
+
+	if (overflowed) {
+		fprintf(stderr, "[prefetch] Too many files were opened to record all of them. Not updating the prefetch list.\n");
+		path_list_free(&recorded);
+		return;
+	}
+
+	// recorded starts with the listed files that still exist, so it only differs
+	// from the list if files were added or removed.
+	if (((n_kept != prefetch.listed.n_paths) || (recorded.n_paths != n_kept)) && write_list(&recorded)) {
+		printf("[prefetch] Recorded %u asset files opened during startup to \"%s\".\n", (unsigned int) recorded.n_paths, prefetch.list_path);
+	}
+
+	path_list_free(&recorded);
+}
+
+void prefetch_deinit(void) {
+	if (prefetch.inotify_fd >= 0) {
+		close(prefetch.inotify_fd);
+		prefetch.inotify_fd = -1;
+	}
+
+	for (int i = 0; i < prefetch.n_watches; i++)
+		free(prefetch.watches[i].dir);
+	free(prefetch.watches);
+	prefetch.watches = NULL;
+	prefetch.n_watches = 0;
+
+	for (int i = 0; i < prefetch.n_mappings; i++)
+		munmap(prefetch.mappings[i].address, prefetch.mappings[i].size);
+	free(prefetch.mappings);
+	prefetch.mappings = NULL;
+	prefetch.n_mappings = 0;
+
+	path_list_free(&prefetch.listed);
+	path_list_free(&prefetch.prefetched);
+}
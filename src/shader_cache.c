@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <platformchannel.h>
+#include <shader_cache.h>
+
+#define TEMP_FILE_SUFFIX ".temp"
+
+struct shader_cache_watch {
+	int wd;
+	char *path;
+};
+
+struct {
+	char path[PATH_MAX];
+	int inotify_fd;
+
+	struct shader_cache_watch *watches;
+	size_t n_watches;
+	size_t watches_capacity;
+
+	/// number of shaders that were already in the cache when flutter-pi started.
+	/// (these are the shaders the engine doesn't have to compile, i.e. the possible cache hits)
+	unsigned int n_cached;
+
+	/// number of shaders inside the SkSL warm-up bundle of the asset bundle.
+	unsigned int n_bundled;
+
+	/// number of shaders of the warm-up bundle that were written to the cache while
+	/// the engine precompiled the bundle. (these were compiled ahead of time, they're not misses)
+	_Atomic unsigned int n_warmup_writes;
+
+	/// number of shaders that were written to the cache since flutter-pi started,
+	/// i.e. the shaders that weren't cached or bundled and had to be compiled at runtime.
+	_Atomic unsigned int n_misses;
+
+	/// false once the first frame is on screen. The engine precompiles the warm-up bundle
+	/// when the rendering surface is created, so that's done by then.
+	_Atomic bool warming_up;
+
+	/// when the warm-up ended. (CLOCK_REALTIME, to compare with the modification time of cache entries)
+	struct timespec warmup_end;
+
+	/// set while nftw is walking a directory that was created after startup,
+	/// all files found inside it are misses too.
+	bool walking_new_directory;
+} shader_cache = {
+	.inotify_fd = -1,
+	.warming_up = true
+};
+
+
+static bool is_cache_entry(const char *name) {
+	size_t length = strlen(name);
+
+	if ((name[0] == '.') || (length == 0))
+		return false;
+
+	// The engine writes cache entries atomically, by writing to "<entry>.temp"
+	// and then renaming that to "<entry>". Only count the rename.
+	if ((length >= strlen(TEMP_FILE_SUFFIX)) && (strcmp(name + length - strlen(TEMP_FILE_SUFFIX), TEMP_FILE_SUFFIX) == 0))
+		return false;
+
+	return true;
+}
+
+static int mkdir_recursive(const char *path) {
+	char buffer[PATH_MAX];
+	char *cursor;
+
+	snprintf(buffer, sizeof(buffer), "%s", path);
+
+	for (cursor = buffer + 1; *cursor; cursor++) {
+		if (*cursor == '/') {
+			*cursor = '\0';
+			if ((mkdir(buffer, 0755) != 0) && (errno != EEXIST))
+				return errno;
+			*cursor = '/';
+		}
+	}
+
+	if ((mkdir(buffer, 0755) != 0) && (errno != EEXIST))
+		return errno;
+
+	return 0;
+}
+
+static int add_watch(const char *path) {
+	struct shader_cache_watch *watches;
+	int wd;
+
+	wd = inotify_add_watch(shader_cache.inotify_fd, path, IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0)
+		return errno;
+
+	for (int i = 0; i < shader_cache.n_watches; i++) {
+		// inotify returns the same watch descriptor if the directory is already watched.
+		if (shader_cache.watches[i].wd == wd)
+			return 0;
+	}
+
+	if (shader_cache.n_watches == shader_cache.watches_capacity) {
+		size_t capacity = shader_cache.watches_capacity ? shader_cache.watches_capacity * 2 : 8;
+
+		watches = realloc(shader_cache.watches, capacity * sizeof(*watches));
+		if (watches == NULL)
+			return ENOMEM;
+
+		shader_cache.watches = watches;
+		shader_cache.watches_capacity = capacity;
+	}
+
+	shader_cache.watches[shader_cache.n_watches].wd = wd;
+	shader_cache.watches[shader_cache.n_watches].path = strdup(path);
+	if (shader_cache.watches[shader_cache.n_watches].path == NULL) {
+		inotify_rm_watch(shader_cache.inotify_fd, wd);
+		return ENOMEM;
+	}
+	shader_cache.n_watches++;
+
+	return 0;
+}
+
+static const char *get_watch_path(int wd) {
+	for (int i = 0; i < shader_cache.n_watches; i++)
+		if (shader_cache.watches[i].wd == wd)
+			return shader_cache.watches[i].path;
+
+	return NULL;
+}
+
+/// Whether the cache entry at path was written by the precompile of the warm-up bundle.
+/// The inotify events are only read some time after the file was written, so if the warm-up
+/// ended in the meantime, the modification time of the entry decides.
+static bool is_warmup_write(const char *path) {
+	struct stat statbuf;
+
+	// more writes than there are shaders in the bundle are runtime compiles.
+	if (shader_cache.n_warmup_writes >= shader_cache.n_bundled)
+		return false;
+
+	if (shader_cache.warming_up)
+		return true;
+
+	if (stat(path, &statbuf) != 0)
+		return false;
+
+	return (statbuf.st_mtim.tv_sec < shader_cache.warmup_end.tv_sec) ||
+		   ((statbuf.st_mtim.tv_sec == shader_cache.warmup_end.tv_sec) && (statbuf.st_mtim.tv_nsec <= shader_cache.warmup_end.tv_nsec));
+}
+
+static void on_write(const char *path) {
+	unsigned int n_misses;
+
+	if (is_warmup_write(path)) {
+		shader_cache.n_warmup_writes++;
+		return;
+	}
+
+	n_misses = ++shader_cache.n_misses;
+
+	printf("[shader cache] miss #%u: \"%s\"\n", n_misses, path);
+}
+
+static int on_cache_dir_entry(const char *path, const struct stat *statbuf, int type, struct FTW *ftwbuf) {
+	int ok;
+
+	if (type == FTW_D) {
+		if (shader_cache.inotify_fd >= 0) {
+			ok = add_watch(path);
+			if (ok != 0) {
+				fprintf(stderr, "[shader cache] Could not watch \"%s\": %s\n", path, strerror(ok));
+			}
+		}
+	} else if ((type == FTW_F) && is_cache_entry(path + ftwbuf->base)) {
+		if (shader_cache.walking_new_directory) {
+			on_write(path);
+		} else {
+			shader_cache.n_cached++;
+		}
+	}
+
+	return 0;
+}
+
+/// Counts the shaders inside the "data" object of the SkSL warm-up bundle.
+static int count_bundled_shaders(const char *bundle_path, unsigned int *n_shaders_out) {
+	struct json_value bundle;
+	struct stat statbuf;
+	FILE *file;
+	char *json;
+	int ok;
+
+	file = fopen(bundle_path, "r");
+	if (file == NULL)
+		return errno;
+
+	if (fstat(fileno(file), &statbuf) != 0) {
+		ok = errno;
+		fclose(file);
+		return ok;
+	}
+
+	json = malloc(statbuf.st_size + 1);
+	if (json == NULL) {
+		fclose(file);
+		return ENOMEM;
+	}
+
+	if (fread(json, 1, statbuf.st_size, file) != statbuf.st_size) {
+		ok = ferror(file) ? errno : EIO;
+		free(json);
+		fclose(file);
+		return ok;
+	}
+	json[statbuf.st_size] = '\0';
+	fclose(file);
+
+	// the JSON strings are decoded in place, so json has to stay alive as long as bundle is used.
+	ok = platch_decode_json(json, &bundle);
+	if (ok != 0) {
+		free(json);
+		return ok;
+	}
+
+	ok = EBADMSG;
+	if (bundle.type == kJsonObject) {
+		for (int i = 0; i < bundle.size; i++) {
+			if ((strcmp(bundle.keys[i], "data") == 0) && (bundle.values[i].type == kJsonObject)) {
+				*n_shaders_out = bundle.values[i].size;
+				ok = 0;
+				break;
+			}
+		}
+	}
+
+	platch_free_json_value(&bundle, false);
+	free(json);
+
+	return ok;
+}
+
+bool shader_cache_init(const char *cache_dir, const char *asset_bundle_path) {
+	char bundle_path[PATH_MAX];
+	int ok;
+
+	snprintf(shader_cache.path, sizeof(shader_cache.path), "%s", cache_dir);
+
+	ok = mkdir_recursive(shader_cache.path);
+	if (ok != 0) {
+		fprintf(stderr, "Could not create shader cache directory \"%s\": %s\n", shader_cache.path, strerror(ok));
+		return false;
+	}
+
+	shader_cache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (shader_cache.inotify_fd < 0) {
+		fprintf(stderr, "[shader cache] Could not create inotify instance, cache misses won't be reported. inotify_init1: %s\n", strerror(errno));
+	}
+
+	// count the cached shaders & watch all (sub-)directories of the cache
+	shader_cache.walking_new_directory = false;
+	nftw(shader_cache.path, on_cache_dir_entry, 16, FTW_PHYS);
+
+	snprintf(bundle_path, sizeof(bundle_path), "%s/%s", asset_bundle_path, SKSL_WARMUP_BUNDLE_NAME);
+	if (access(bundle_path, R_OK) == 0) {
+		ok = count_bundled_shaders(bundle_path, &shader_cache.n_bundled);
+		if (ok != 0) {
+			fprintf(stderr, "[shader cache] SkSL warm-up bundle \"%s\" is invalid.\n", bundle_path);
+		}
+	}
+
+	printf(
+		"[shader cache] %u shaders cached in \"%s\", %u shaders in the SkSL warm-up bundle.\n",
+		shader_cache.n_cached,
+		shader_cache.path,
+		shader_cache.n_bundled
+	);
+
+	return true;
+}
+
+int shader_cache_get_fd(void) {
+	return shader_cache.inotify_fd;
+}
+
+void shader_cache_on_fd_ready(void) {
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	ssize_t n_read;
+
+	while ((n_read = read(shader_cache.inotify_fd, buffer, sizeof(buffer))) > 0) {
+		for (char *cursor = buffer; cursor < buffer + n_read;) {
+			struct inotify_event *event = (struct inotify_event *) cursor;
+			const char *dir = get_watch_path(event->wd);
+
+			cursor += sizeof(struct inotify_event) + event->len;
+
+			if ((dir == NULL) || (event->len == 0))
+				continue;
+
+			snprintf(path, sizeof(path), "%s/%s", dir, event->name);
+
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & IN_CREATE) {
+					// The engine creates its cache directories lazily. Watch the new directory
+					// and count the files that were written before the watch was added.
+					shader_cache.walking_new_directory = true;
+					nftw(path, on_cache_dir_entry, 16, FTW_PHYS);
+					shader_cache.walking_new_directory = false;
+				}
+			} else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && is_cache_entry(event->name)) {
+				on_write(path);
+			}
+		}
+	}
+
+	if ((n_read < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+		perror("[shader cache] Could not read inotify events. read");
+	}
+}
+
+void shader_cache_finish_warmup(void) {
+	if (!shader_cache.warming_up)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &shader_cache.warmup_end);
+	shader_cache.warming_up = false;
+}
+
+void shader_cache_print_stats(void) {
+	printf(
+		"[shader cache] %u shaders cached at startup, %u in the SkSL warm-up bundle (%u written by the warm-up), %u misses.\n",
+		shader_cache.n_cached,
+		shader_cache.n_bundled,
+		shader_cache.n_warmup_writes,
+		shader_cache.n_misses
+	);
+}
+
+void shader_cache_deinit(void) {
+	if (shader_cache.inotify_fd >= 0) {
+		close(shader_cache.inotify_fd);
+		shader_cache.inotify_fd = -1;
+	}
+
+	for (int i = 0; i < shader_cache.n_watches; i++)
+		free(shader_cache.watches[i].path);
+
+	free(shader_cache.watches);
+	shader_cache.watches = NULL;
+	shader_cache.n_watches = 0;
+	shader_cache.watches_capacity = 0;
+}
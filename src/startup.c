@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <startup.h>
+#include <timeline.h>
+
+struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  step_finished;
+	struct startup_step *steps;
+	size_t n_steps;
+} startup = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.step_finished = PTHREAD_COND_INITIALIZER
+};
+
+static double timespec_diff_ms(const struct timespec *from, const struct timespec *to) {
+	return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/// Returns true when all dependencies of step have finished (successfully or not).
+/// startup.lock must be held.
+static bool dependencies_finished(const struct startup_step *step) {
+	for (int i = 0; i < startup.n_steps; i++)
+		if ((step->dependencies & STARTUP_DEPENDENCY(i)) && !startup.steps[i].finished)
+			return false;
+
+	return true;
+}
+
+/// Returns true when any dependency of step failed or was skipped.
+/// startup.lock must be held.
+static bool dependencies_failed(const struct startup_step *step) {
+	for (int i = 0; i < startup.n_steps; i++)
+		if ((step->dependencies & STARTUP_DEPENDENCY(i)) && (startup.steps[i].failed || startup.steps[i].skipped))
+			return true;
+
+	return false;
+}
+
+static void run_step(struct startup_step *step) {
+	bool skip, ok = true;
+	int timeline_id;
+
+	pthread_mutex_lock(&startup.lock);
+	while (!dependencies_finished(step))
+		pthread_cond_wait(&startup.step_finished, &startup.lock);
+	skip = dependencies_failed(step);
+	pthread_mutex_unlock(&startup.lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &step->started_at);
+	if (!skip) {
+		timeline_id = timeline_begin(step->name);
+		ok = step->run();
+		timeline_end(timeline_id);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &step->finished_at);
+
+	pthread_mutex_lock(&startup.lock);
+	step->skipped = skip;
+	step->failed = !ok;
+	step->finished = true;
+	pthread_cond_broadcast(&startup.step_finished);
+	pthread_mutex_unlock(&startup.lock);
+}
+
+static void *step_thread_entry(void *userdata) {
+	pthread_setname_np(pthread_self(), "startup");
+	run_step(userdata);
+	return NULL;
+}
+
+static void print_report(const struct timespec *started_at) {
+	struct startup_step *step, *dependency;
+	int critical_path[STARTUP_MAX_STEPS];
+	int n_critical, i_last = -1;
+
+	printf("Startup steps:\n");
+	for (int i = 0; i < startup.n_steps; i++) {
+		step = startup.steps + i;
+
+		printf(
+			"  %-32s %8.1fms - %8.1fms  (%.1fms)%s\n",
+			step->name,
+			timespec_diff_ms(started_at, &step->started_at),
+			timespec_diff_ms(started_at, &step->finished_at),
+			timespec_diff_ms(&step->started_at, &step->finished_at),
+			step->skipped ? "  skipped" : step->failed ? "  FAILED" : ""
+		);
+
+		if ((i_last == -1) || (timespec_diff_ms(&startup.steps[i_last].finished_at, &step->finished_at) > 0))
+			i_last = i;
+	}
+
+	// The critical path ends at the step that finished last. From there, walk back
+	// by always choosing the dependency that finished last, since that's the one the step waited for.
+	n_critical = 0;
+	for (int i = i_last; i != -1;) {
+		step = startup.steps + i;
+		critical_path[n_critical++] = i;
+
+		i = -1;
+		for (int j = 0; j < startup.n_steps; j++) {
+			dependency = startup.steps + j;
+			if (!(step->dependencies & STARTUP_DEPENDENCY(j)))
+				continue;
+
+			if ((i == -1) || (timespec_diff_ms(&startup.steps[i].finished_at, &dependency->finished_at) > 0))
+				i = j;
+		}
+	}
+
+	printf("Startup critical path (%.1fms): ", timespec_diff_ms(started_at, &startup.steps[i_last].finished_at));
+	for (int i = n_critical - 1; i >= 0; i--) {
+		step = startup.steps + critical_path[i];
+		printf(
+			"%s (%.1fms)%s",
+			step->name,
+			timespec_diff_ms(&step->started_at, &step->finished_at),
+			i > 0 ? " -> " : "\n"
+		);
+	}
+}
+
+bool startup_run(struct startup_step *steps, size_t n_steps) {
+	struct timespec started_at;
+	bool ok;
+	int result;
+
+	if ((n_steps == 0) || (n_steps > STARTUP_MAX_STEPS)) {
+		fprintf(stderr, "[startup] Invalid number of startup steps: %u\n", (unsigned int) n_steps);
+		return false;
+	}
+
+	// only allowing dependencies on earlier steps makes dependency cycles impossible,
+	// and guarantees the steps on the calling thread can run in array order.
+	for (int i = 0; i < n_steps; i++) {
+		if (steps[i].dependencies & ~(STARTUP_DEPENDENCY(i) - 1)) {
+			fprintf(stderr, "[startup] Step \"%s\" can only depend on steps listed before it.\n", steps[i].name);
+			return false;
+		}
+
+		steps[i].finished = false;
+		steps[i].failed = false;
+		steps[i].skipped = false;
+	}
+
+	startup.steps = steps;
+	startup.n_steps = n_steps;
+
+	clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+	for (int i = 0; i < n_steps; i++) {
+		if (steps[i].on_calling_thread)
+			continue;
+
+		result = pthread_create(&steps[i].thread, NULL, step_thread_entry, steps + i);
+		if (result != 0) {
+			fprintf(stderr, "[startup] Could not create thread for step \"%s\", running it on the main thread instead. pthread_create: %s\n", steps[i].name, strerror(result));
+			steps[i].on_calling_thread = true;
+		}
+	}
+
+	for (int i = 0; i < n_steps; i++) {
+		if (steps[i].on_calling_thread)
+			run_step(steps + i);
+	}
+
+	ok = true;
+	for (int i = 0; i < n_steps; i++) {
+		if (!steps[i].on_calling_thread)
+			pthread_join(steps[i].thread, NULL);
+
+		if (steps[i].failed)
+			ok = false;
+	}
+
+	print_report(&started_at);
+
+	startup.steps = NULL;
+	startup.n_steps = 0;
+
+	return ok;
+}
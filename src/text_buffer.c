@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <text_buffer.h>
+
+/// The minimum size of the gap after the buffer grows.
+#define MIN_GAP_SIZE 64
+
+/// Returns the number of bytes of the UTF-8 sequence starting with lead.
+/// Invalid lead bytes are treated as one-byte sequences, so walking the text always makes progress.
+static inline size_t sequence_length(uint8_t lead) {
+	if (lead < 0xC0) return 1;
+	if (lead < 0xE0) return 2;
+	if (lead < 0xF0) return 3;
+	if (lead < 0xF8) return 4;
+	return 1;
+}
+
+static inline bool is_continuation_byte(uint8_t byte) {
+	return (byte & 0xC0) == 0x80;
+}
+
+/// Code points outside the BMP (4-byte UTF-8 sequences) are surrogate pairs in UTF-16.
+static inline size_t utf16_length_of_sequence(size_t n_bytes) {
+	return n_bytes == 4 ? 2 : 1;
+}
+
+static inline size_t gap_size(const struct text_buffer *buffer) {
+	return buffer->gap_end - buffer->gap_start;
+}
+
+static inline size_t length_in_bytes(const struct text_buffer *buffer) {
+	return buffer->capacity - gap_size(buffer);
+}
+
+/// Returns the byte at offset in the text (skipping the gap).
+static inline uint8_t byte_at(const struct text_buffer *buffer, size_t offset) {
+	return (uint8_t) buffer->data[offset < buffer->gap_start ? offset : offset + gap_size(buffer)];
+}
+
+static size_t utf16_length(const char *utf8, size_t n_bytes) {
+	size_t length = 0, n;
+
+	for (size_t i = 0; i < n_bytes; i += n) {
+		n = sequence_length(utf8[i]);
+		if (n > n_bytes - i) n = n_bytes - i;
+
+		length += utf16_length_of_sequence(n);
+	}
+
+	return length;
+}
+
+bool   text_buffer_init(struct text_buffer *buffer) {
+	memset(buffer, 0, sizeof(*buffer));
+
+	buffer->data = malloc(MIN_GAP_SIZE);
+	if (buffer->data == NULL) return false;
+
+	buffer->capacity = MIN_GAP_SIZE;
+	buffer->gap_end = MIN_GAP_SIZE;
+
+	return true;
+}
+
+void   text_buffer_deinit(struct text_buffer *buffer) {
+	free(buffer->data);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+/// Makes sure the gap has room for at least n bytes.
+static bool reserve(struct text_buffer *buffer, size_t n) {
+	size_t capacity, tail;
+	char *data;
+
+	if (gap_size(buffer) >= n) return true;
+
+	capacity = buffer->capacity * 2;
+	if (capacity < length_in_bytes(buffer) + n + MIN_GAP_SIZE)
+		capacity = length_in_bytes(buffer) + n + MIN_GAP_SIZE;
+
+	data = realloc(buffer->data, capacity);
+	if (data == NULL) return false;
+
+	// move the text after the gap to the end of the new buffer.
+	tail = buffer->capacity - buffer->gap_end;
+	memmove(data + capacity - tail, data + buffer->gap_end, tail);
+
+	buffer->data = data;
+	buffer->gap_end = capacity - tail;
+	buffer->capacity = capacity;
+
+	return true;
+}
+
+/// Converts the UTF-16 index to a byte offset in the text. If index points to the second half
+/// of a surrogate pair, it's rounded down to the start of the pair. Indices past the end are clamped.
+/// *index_out is set to the actual (rounded / clamped) index.
+/// The walk starts at the closest known position: the start, the gap, the end or the last lookup.
+static size_t to_byte_offset(struct text_buffer *buffer, size_t index, size_t *index_out) {
+	size_t anchors_utf16[4], anchors_byte[4], utf16, byte, n, distance, best_distance;
+	int best = 0;
+
+	if (index > buffer->length_utf16)
+		index = buffer->length_utf16;
+
+	anchors_utf16[0] = 0;                    anchors_byte[0] = 0;
+	anchors_utf16[1] = buffer->gap_utf16;    anchors_byte[1] = buffer->gap_start;
+	anchors_utf16[2] = buffer->length_utf16; anchors_byte[2] = length_in_bytes(buffer);
+	anchors_utf16[3] = buffer->cached_utf16; anchors_byte[3] = buffer->cached_byte;
+
+	best_distance = SIZE_MAX;
+	for (int i = 0; i < 4; i++) {
+		distance = anchors_utf16[i] > index ? anchors_utf16[i] - index : index - anchors_utf16[i];
+		if (distance < best_distance) {
+			best_distance = distance;
+			best = i;
+		}
+	}
+
+	utf16 = anchors_utf16[best];
+	byte = anchors_byte[best];
+
+	while (utf16 < index) {
+		n = sequence_length(byte_at(buffer, byte));
+		if (n > length_in_bytes(buffer) - byte) n = length_in_bytes(buffer) - byte;
+
+		// index is inside this surrogate pair
+		if (utf16 + utf16_length_of_sequence(n) > index) break;
+
+		utf16 += utf16_length_of_sequence(n);
+		byte += n;
+	}
+
+	while (utf16 > index) {
+		// step back to the lead byte of the previous code point
+		n = 1;
+		while ((n < 4) && (n < byte) && is_continuation_byte(byte_at(buffer, byte - n)))
+			n++;
+
+		if (sequence_length(byte_at(buffer, byte - n)) != n)
+			n = 1;
+
+		utf16 -= utf16_length_of_sequence(n);
+		byte -= n;
+	}
+
+	buffer->cached_utf16 = utf16;
+	buffer->cached_byte = byte;
+
+	if (index_out) *index_out = utf16;
+	return byte;
+}
+
+/// Moves the gap to the given byte offset (which has the given UTF-16 index).
+static void move_gap(struct text_buffer *buffer, size_t byte, size_t utf16) {
+	size_t n;
+
+	if (byte < buffer->gap_start) {
+		n = buffer->gap_start - byte;
+		memmove(buffer->data + buffer->gap_end - n, buffer->data + byte, n);
+		buffer->gap_start -= n;
+		buffer->gap_end -= n;
+	} else if (byte > buffer->gap_start) {
+		n = byte - buffer->gap_start;
+		memmove(buffer->data + buffer->gap_start, buffer->data + buffer->gap_end, n);
+		buffer->gap_start += n;
+		buffer->gap_end += n;
+	}
+
+	buffer->gap_utf16 = utf16;
+}
+
+bool   text_buffer_set(struct text_buffer *buffer, const char *text) {
+	size_t length = strlen(text);
+
+	// drop the old text and put the new one in front of the gap.
+	buffer->gap_start = 0;
+	buffer->gap_end = buffer->capacity;
+
+	if (!reserve(buffer, length + MIN_GAP_SIZE))
+		return false;
+
+	memcpy(buffer->data, text, length);
+	buffer->gap_start = length;
+	buffer->gap_utf16 = buffer->length_utf16 = utf16_length(text, length);
+	buffer->cached_utf16 = buffer->cached_byte = 0;
+
+	return true;
+}
+
+size_t text_buffer_get_length(const struct text_buffer *buffer) {
+	return buffer->length_utf16;
+}
+
+size_t text_buffer_get_byte_offset(struct text_buffer *buffer, size_t index) {
+	return to_byte_offset(buffer, index, NULL);
+}
+
+size_t text_buffer_next_index(struct text_buffer *buffer, size_t index) {
+	size_t byte, n;
+
+	byte = to_byte_offset(buffer, index, &index);
+	if (byte >= length_in_bytes(buffer)) return index;
+
+	n = sequence_length(byte_at(buffer, byte));
+	if (n > length_in_bytes(buffer) - byte) n = length_in_bytes(buffer) - byte;
+
+	return index + utf16_length_of_sequence(n);
+}
+
+size_t text_buffer_previous_index(struct text_buffer *buffer, size_t index) {
+	size_t rounded;
+
+	to_byte_offset(buffer, index, &rounded);
+
+	// index was inside a surrogate pair, so the previous code point is the pair.
+	if (rounded < index) return rounded;
+	if (rounded == 0) return 0;
+
+	to_byte_offset(buffer, rounded - 1, &rounded);
+	return rounded;
+}
+
+size_t text_buffer_insert(struct text_buffer *buffer, size_t index, const char *utf8, size_t n_bytes) {
+	size_t byte, inserted_utf16;
+
+	if (!reserve(buffer, n_bytes)) return (size_t) -1;
+
+	byte = to_byte_offset(buffer, index, &index);
+	move_gap(buffer, byte, index);
+
+	memcpy(buffer->data + buffer->gap_start, utf8, n_bytes);
+	inserted_utf16 = utf16_length(utf8, n_bytes);
+
+	buffer->gap_start += n_bytes;
+	buffer->gap_utf16 += inserted_utf16;
+	buffer->length_utf16 += inserted_utf16;
+
+	// the cached position may be behind the insertion point, where the offsets changed.
+	buffer->cached_utf16 = buffer->cached_byte = 0;
+
+	return buffer->gap_utf16;
+}
+
+size_t text_buffer_erase(struct text_buffer *buffer, size_t start, size_t end) {
+	size_t start_byte, end_byte;
+
+	if (end <= start) return start;
+
+	start_byte = to_byte_offset(buffer, start, &start);
+	move_gap(buffer, start_byte, start);
+
+	// the gap is at start now, so looking up end walks only the erased text.
+	end_byte = to_byte_offset(buffer, end, &end);
+
+	buffer->gap_end += end_byte - start_byte;
+	buffer->length_utf16 -= end - start;
+	buffer->cached_utf16 = buffer->cached_byte = 0;
+
+	return start;
+}
+
+const char *text_buffer_get_string(struct text_buffer *buffer) {
+	if (!reserve(buffer, 1)) return NULL;
+
+	move_gap(buffer, length_in_bytes(buffer), buffer->length_utf16);
+	buffer->data[buffer->gap_start] = '\0';
+
+	return buffer->data;
+}
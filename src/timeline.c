@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <timeline.h>
+
+struct timeline_entry {
+	char name[64];
+	char thread[16];
+	bool is_mark;
+	bool has_ended;
+	struct timespec start, end;
+};
+
+struct {
+	pthread_mutex_t lock;
+	struct timespec started_at;
+	struct timeline_entry entries[TIMELINE_MAX_ENTRIES];
+	int n_entries;
+	bool finished;
+} timeline = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static double timespec_to_ms(const struct timespec *time) {
+	return time->tv_sec * 1000.0 + time->tv_nsec / 1000000.0;
+}
+
+static double ms_since_start(const struct timespec *time) {
+	return timespec_to_ms(time) - timespec_to_ms(&timeline.started_at);
+}
+
+/// Adds a new entry and returns its index, or -1 if the timeline is full or finished.
+/// timeline.lock must be held.
+static int add_entry(const char *name, bool is_mark) {
+	struct timeline_entry *entry;
+
+	if (timeline.finished || (timeline.n_entries == TIMELINE_MAX_ENTRIES))
+		return -1;
+
+	entry = timeline.entries + timeline.n_entries;
+	memset(entry, 0, sizeof(*entry));
+	snprintf(entry->name, sizeof(entry->name), "%s", name);
+	pthread_getname_np(pthread_self(), entry->thread, sizeof(entry->thread));
+	entry->is_mark = is_mark;
+
+	return timeline.n_entries++;
+}
+
+void timeline_init(void) {
+	clock_gettime(CLOCK_MONOTONIC, &timeline.started_at);
+}
+
+int timeline_begin(const char *name) {
+	int id;
+
+	pthread_mutex_lock(&timeline.lock);
+	id = add_entry(name, false);
+	if (id != -1)
+		clock_gettime(CLOCK_MONOTONIC, &timeline.entries[id].start);
+	pthread_mutex_unlock(&timeline.lock);
+
+	return id;
+}
+
+void timeline_end(int id) {
+	if (id < 0)
+		return;
+
+	pthread_mutex_lock(&timeline.lock);
+	// the report may already be written without holding the lock.
+	if (!timeline.finished) {
+		clock_gettime(CLOCK_MONOTONIC, &timeline.entries[id].end);
+		timeline.entries[id].has_ended = true;
+	}
+	pthread_mutex_unlock(&timeline.lock);
+}
+
+void timeline_mark(const char *name, const struct timespec *time) {
+	int id;
+
+	pthread_mutex_lock(&timeline.lock);
+	id = add_entry(name, true);
+	if (id != -1) {
+		if (time != NULL) timeline.entries[id].start = *time;
+		else              clock_gettime(CLOCK_MONOTONIC, &timeline.entries[id].start);
+	}
+	pthread_mutex_unlock(&timeline.lock);
+}
+
+static void write_json_string(FILE *file, const char *string) {
+	fputc('"', file);
+	for (; *string; string++) {
+		if ((*string == '"') || (*string == '\\')) {
+			fputc('\\', file);
+			fputc(*string, file);
+		} else if ((unsigned char) *string < 0x20) {
+			fprintf(file, "\\u%04x", *string);
+		} else {
+			fputc(*string, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static int write_report(const char *path, const struct timespec *first_frame) {
+	struct timeline_entry *entry;
+	FILE *file;
+	int ok;
+
+	if (strcmp(path, "-") == 0) {
+		file = stdout;
+	} else {
+		file = fopen(path, "w");
+		if (file == NULL)
+			return errno;
+	}
+
+	// CLOCK_MONOTONIC starts at boot, so the absolute timestamps are the time since boot.
+	fprintf(file, "{\n");
+	fprintf(file, "  \"started_since_boot_ms\": %.3f,\n", timespec_to_ms(&timeline.started_at));
+	fprintf(file, "  \"first_frame_since_boot_ms\": %.3f,\n", timespec_to_ms(first_frame));
+	fprintf(file, "  \"time_to_first_frame_ms\": %.3f,\n", ms_since_start(first_frame));
+	fprintf(file, "  \"phases\": [");
+
+	for (int i = 0; i < timeline.n_entries; i++) {
+		entry = timeline.entries + i;
+
+		fprintf(file, "%s\n    {\"name\": ", i == 0 ? "" : ",");
+		write_json_string(file, entry->name);
+		fprintf(file, ", \"thread\": ");
+		write_json_string(file, entry->thread);
+
+		if (entry->is_mark) {
+			fprintf(file, ", \"time_ms\": %.3f}", ms_since_start(&entry->start));
+		} else if (entry->has_ended) {
+			fprintf(
+				file,
+				", \"start_ms\": %.3f, \"end_ms\": %.3f, \"duration_ms\": %.3f}",
+				ms_since_start(&entry->start),
+				ms_since_start(&entry->end),
+				ms_since_start(&entry->end) - ms_since_start(&entry->start)
+			);
+		} else {
+			fprintf(file, ", \"start_ms\": %.3f, \"end_ms\": null, \"duration_ms\": null}", ms_since_start(&entry->start));
+		}
+	}
+
+	fprintf(file, "\n  ]\n}\n");
+
+	if (file == stdout) {
+		fflush(file);
+		return 0;
+	}
+
+	ok = ferror(file) ? EIO : 0;
+	if (fclose(file) != 0 && ok == 0)
+		ok = errno;
+
+	return ok;
+}
+
+/// Sends a state string to the systemd service manager, like sd_notify(3) does,
+/// without depending on libsystemd.
+static int notify_systemd(const char *state) {
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	const char *socket_path;
+	socklen_t address_length;
+	ssize_t ok;
+	int fd, _errno;
+
+	socket_path = getenv("NOTIFY_SOCKET");
+	if ((socket_path == NULL) || (socket_path[0] == '\0'))
+		return ENOENT;
+
+	if ((socket_path[0] != '/') && (socket_path[0] != '@'))
+		return EAFNOSUPPORT;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path))
+		return ENAMETOOLONG;
+
+	memcpy(address.sun_path, socket_path, strlen(socket_path));
+	address_length = offsetof(struct sockaddr_un, sun_path) + strlen(socket_path);
+
+	// a leading '@' means the socket is in the abstract namespace.
+	if (address.sun_path[0] == '@')
+		address.sun_path[0] = '\0';
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return errno;
+
+	ok = sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *) &address, address_length);
+	_errno = errno;
+
+	close(fd);
+
+	return ok < 0 ? _errno : 0;
+}
+
+void timeline_finish(const struct timespec *time, const char *report_path, bool notify) {
+	struct timespec first_frame;
+	char state[128];
+	int id, ok;
+
+	pthread_mutex_lock(&timeline.lock);
+
+	if (timeline.finished) {
+		pthread_mutex_unlock(&timeline.lock);
+		return;
+	}
+
+	if (time != NULL) first_frame = *time;
+	else              clock_gettime(CLOCK_MONOTONIC, &first_frame);
+
+	id = add_entry("first frame on screen", true);
+	if (id != -1)
+		timeline.entries[id].start = first_frame;
+
+	timeline.finished = true;
+
+	// nobody can add entries anymore, so the lock isn't needed for writing the report.
+	pthread_mutex_unlock(&timeline.lock);
+
+	printf("First frame on screen %.1fms after startup.\n", ms_since_start(&first_frame));
+
+	if (report_path != NULL) {
+		ok = write_report(report_path, &first_frame);
+		if (ok != 0) {
+			fprintf(stderr, "Could not write startup timeline to \"%s\": %s\n", report_path, strerror(ok));
+		}
+	}
+
+	if (notify) {
+		snprintf(state, sizeof(state), "READY=1\nSTATUS=First frame on screen after %.1fms\n", ms_since_start(&first_frame));
+
+		ok = notify_systemd(state);
+		if (ok != 0) {
+			fprintf(stderr, "Could not notify systemd: %s\n", strerror(ok));
+		}
+	}
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <touch_prediction.h>
+
+/// The maximum number of predictions per pointer waiting to be compared to the actual position.
+#define MAX_PENDING_PREDICTIONS 16
+
+struct touch_sample {
+	uint64_t time_ns;
+	double x, y;
+};
+
+struct pending_prediction {
+	uint64_t target_ns;
+
+	/// the predicted position
+	double x, y;
+
+	/// the position that would've been sent without prediction
+	double raw_x, raw_y;
+};
+
+struct touch_track {
+	int32_t device;
+	bool in_use;
+
+	/// the recent samples, oldest first.
+	struct touch_sample samples[TOUCH_PREDICTION_N_SAMPLES];
+	int n_samples;
+
+	struct pending_prediction pending[MAX_PENDING_PREDICTIONS];
+	int n_pending;
+};
+
+struct prediction_error {
+	uint64_t count;
+	double sum, sum_of_squares, max;
+};
+
+struct {
+	pthread_mutex_t lock;
+
+	/// the number of predictions & how far ahead they were in total, for the stats.
+	uint64_t n_predictions;
+	uint64_t horizon_sum_ns;
+
+	struct touch_track *tracks;
+	size_t n_tracks;
+
+	struct prediction_error predicted_error;
+	struct prediction_error raw_error;
+} touch_prediction = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+
+static struct touch_track *get_track(int32_t device, bool create) {
+	struct touch_track *track = NULL, *tracks;
+
+	for (int i = 0; i < touch_prediction.n_tracks; i++) {
+		if (touch_prediction.tracks[i].in_use && (touch_prediction.tracks[i].device == device))
+			return touch_prediction.tracks + i;
+
+		if (!touch_prediction.tracks[i].in_use && (track == NULL))
+			track = touch_prediction.tracks + i;
+	}
+
+	if (!create) return NULL;
+
+	if (track == NULL) {
+		tracks = realloc(touch_prediction.tracks, (touch_prediction.n_tracks + 1) * sizeof(*tracks));
+		if (tracks == NULL) return NULL;
+
+		touch_prediction.tracks = tracks;
+		track = touch_prediction.tracks + touch_prediction.n_tracks++;
+	}
+
+	memset(track, 0, sizeof(*track));
+	track->device = device;
+	track->in_use = true;
+
+	return track;
+}
+
+static void add_error(struct prediction_error *error, double dx, double dy) {
+	double distance = sqrt(dx*dx + dy*dy);
+
+	error->count++;
+	error->sum += distance;
+	error->sum_of_squares += distance*distance;
+	if (distance > error->max) error->max = distance;
+}
+
+/// Compares the pending predictions whose target time is now known (i.e. lies between
+/// the last sample and the new one) to the actual, linearly interpolated position.
+static void evaluate_predictions(struct touch_track *track, const struct touch_sample *sample) {
+	struct touch_sample *last;
+	struct pending_prediction *prediction;
+	double f, actual_x, actual_y;
+	int n_remaining = 0;
+
+	if (track->n_samples == 0) {
+		track->n_pending = 0;
+		return;
+	}
+
+	last = track->samples + track->n_samples - 1;
+
+	for (int i = 0; i < track->n_pending; i++) {
+		prediction = track->pending + i;
+
+		if (prediction->target_ns > sample->time_ns) {
+			track->pending[n_remaining++] = *prediction;
+			continue;
+		}
+
+		// samples arrived out of order, can't tell where the pointer was.
+		if ((prediction->target_ns < last->time_ns) || (sample->time_ns <= last->time_ns))
+			continue;
+
+		f = (double) (prediction->target_ns - last->time_ns) / (double) (sample->time_ns - last->time_ns);
+		actual_x = last->x + (sample->x - last->x) * f;
+		actual_y = last->y + (sample->y - last->y) * f;
+
+		add_error(&touch_prediction.predicted_error, prediction->x - actual_x, prediction->y - actual_y);
+		add_error(&touch_prediction.raw_error, prediction->raw_x - actual_x, prediction->raw_y - actual_y);
+	}
+
+	track->n_pending = n_remaining;
+}
+
+static void add_sample(struct touch_track *track, const struct touch_sample *sample) {
+	int n_remaining = 0;
+
+	// forget the samples that are too old to say anything about the current velocity.
+	for (int i = 0; i < track->n_samples; i++) {
+		if (track->samples[i].time_ns + TOUCH_PREDICTION_WINDOW_NS >= sample->time_ns)
+			track->samples[n_remaining++] = track->samples[i];
+	}
+	track->n_samples = n_remaining;
+
+	if (track->n_samples == TOUCH_PREDICTION_N_SAMPLES) {
+		memmove(track->samples, track->samples + 1, (TOUCH_PREDICTION_N_SAMPLES - 1) * sizeof(struct touch_sample));
+		track->n_samples--;
+	}
+
+	track->samples[track->n_samples++] = *sample;
+}
+
+/// Fits x(t) = a + v_x * t (and the same for y) to the samples of track using least squares.
+/// Returns false if there are too few samples, or they all have the same timestamp.
+static bool fit_velocity(const struct touch_track *track, double *vx_out, double *vy_out) {
+	double mean_t = 0, mean_x = 0, mean_y = 0, stt = 0, stx = 0, sty = 0, t;
+	uint64_t t0;
+
+	if (track->n_samples < TOUCH_PREDICTION_MIN_SAMPLES)
+		return false;
+
+	// use times relative to the first sample, so the doubles don't lose precision.
+	t0 = track->samples[0].time_ns;
+
+	for (int i = 0; i < track->n_samples; i++) {
+		mean_t += (track->samples[i].time_ns - t0) / 1e9;
+		mean_x += track->samples[i].x;
+		mean_y += track->samples[i].y;
+	}
+	mean_t /= track->n_samples;
+	mean_x /= track->n_samples;
+	mean_y /= track->n_samples;
+
+	for (int i = 0; i < track->n_samples; i++) {
+		t = (track->samples[i].time_ns - t0) / 1e9 - mean_t;
+		stt += t * t;
+		stx += t * (track->samples[i].x - mean_x);
+		sty += t * (track->samples[i].y - mean_y);
+	}
+
+	if (stt <= 0) return false;
+
+	*vx_out = stx / stt;
+	*vy_out = sty / stt;
+
+	return true;
+}
+
+void touch_prediction_process(FlutterPointerEvent *event, uint64_t display_ns) {
+	struct touch_track *track;
+	struct touch_sample sample;
+	uint64_t horizon_ns;
+	double vx, vy, horizon_s;
+
+	sample = (struct touch_sample) {
+		.time_ns = event->timestamp * 1000ull,
+		.x = event->x,
+		.y = event->y
+	};
+
+	pthread_mutex_lock(&touch_prediction.lock);
+
+	if ((event->phase != kMove) && (event->phase != kDown)) {
+		// the pointer was lifted, removed or is just hovering. Start over with the next touch.
+		track = get_track(event->device, false);
+		if (track != NULL) track->in_use = false;
+
+		pthread_mutex_unlock(&touch_prediction.lock);
+		return;
+	}
+
+	track = get_track(event->device, true);
+	if (track == NULL) {
+		pthread_mutex_unlock(&touch_prediction.lock);
+		return;
+	}
+
+	if (event->phase == kDown) {
+		track->n_samples = 0;
+		track->n_pending = 0;
+	}
+
+	evaluate_predictions(track, &sample);
+	add_sample(track, &sample);
+
+	horizon_ns = display_ns > sample.time_ns ? display_ns - sample.time_ns : 0;
+	if (horizon_ns > TOUCH_PREDICTION_MAX_HORIZON_NS)
+		horizon_ns = TOUCH_PREDICTION_MAX_HORIZON_NS;
+
+	if ((event->phase == kMove) && (horizon_ns > 0) && fit_velocity(track, &vx, &vy)) {
+		horizon_s = horizon_ns / 1e9;
+
+		event->x = sample.x + vx * horizon_s;
+		event->y = sample.y + vy * horizon_s;
+
+		touch_prediction.n_predictions++;
+		touch_prediction.horizon_sum_ns += horizon_ns;
+
+		if (track->n_pending < MAX_PENDING_PREDICTIONS) {
+			track->pending[track->n_pending++] = (struct pending_prediction) {
+				.target_ns = sample.time_ns + horizon_ns,
+				.x = event->x, .y = event->y,
+				.raw_x = sample.x, .raw_y = sample.y
+			};
+		}
+	}
+
+	pthread_mutex_unlock(&touch_prediction.lock);
+}
+
+static void print_error(const char *name, const struct prediction_error *error) {
+	if (error->count == 0) return;
+
+	printf(
+		"  %-20s mean %6.1fpx, RMS %6.1fpx, max %6.1fpx\n",
+		name,
+		error->sum / error->count,
+		sqrt(error->sum_of_squares / error->count),
+		error->max
+	);
+}
+
+void touch_prediction_print_stats(void) {
+	struct prediction_error predicted, raw;
+	uint64_t n_predictions, horizon_sum_ns;
+
+	pthread_mutex_lock(&touch_prediction.lock);
+	predicted = touch_prediction.predicted_error;
+	raw = touch_prediction.raw_error;
+	n_predictions = touch_prediction.n_predictions;
+	horizon_sum_ns = touch_prediction.horizon_sum_ns;
+	pthread_mutex_unlock(&touch_prediction.lock);
+
+	printf(
+		"[touch prediction] %llu predictions, on average %.1fms ahead. %llu were checked against the actual position:\n",
+		(unsigned long long) n_predictions,
+		n_predictions ? horizon_sum_ns / (n_predictions * 1000000.0) : 0.0,
+		(unsigned long long) predicted.count
+	);
+	print_error("with prediction:", &predicted);
+	print_error("without prediction:", &raw);
+}
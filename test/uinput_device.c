@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#include "uinput_device.h"
+
+static int set_abs(int fd, uint16_t code, int minimum, int maximum) {
+	struct uinput_abs_setup setup = {
+		.code = code,
+		.absinfo = {.minimum = minimum, .maximum = maximum}
+	};
+
+	return ioctl(fd, UI_ABS_SETUP, &setup);
+}
+
+/// Finds the event device node of the uinput device. udev may need a moment to create it.
+static bool find_event_node(int fd, char *event_path_out, size_t size) {
+	char sysname[64], sys_path[PATH_MAX];
+	struct dirent *entry;
+	DIR *dir;
+
+	if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+		perror("[uinput] Could not get the sysfs name of the virtual device. ioctl");
+		return false;
+	}
+
+	snprintf(sys_path, sizeof(sys_path), "/sys/devices/virtual/input/%s", sysname);
+
+	for (int i = 0; i < 100; i++) {
+		dir = opendir(sys_path);
+		if (dir != NULL) {
+			while ((entry = readdir(dir)) != NULL) {
+				if (strncmp(entry->d_name, "event", 5) == 0) {
+					snprintf(event_path_out, size, "/dev/input/%s", entry->d_name);
+					closedir(dir);
+
+					if (access(event_path_out, F_OK) == 0)
+						return true;
+					break;
+				}
+			}
+			if (entry == NULL) closedir(dir);
+		}
+
+		usleep(10000);
+	}
+
+	fprintf(stderr, "[uinput] The event device node of \"%s\" didn't show up.\n", sys_path);
+	return false;
+}
+
+int  uinput_create_touchscreen(const char *name, int n_slots, int width, int height, char *event_path_out, size_t size) {
+	struct uinput_setup setup = {
+		.id = {.bustype = BUS_VIRTUAL, .vendor = 0x1234, .product = 0x5678, .version = 1}
+	};
+	int fd, ok = 0;
+
+	fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		perror("[uinput] Could not open /dev/uinput");
+		return -1;
+	}
+
+	snprintf(setup.name, sizeof(setup.name), "%s", name);
+
+	ok |= ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	ok |= ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH);
+	ok |= ioctl(fd, UI_SET_EVBIT, EV_ABS);
+	ok |= ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT);
+	ok |= set_abs(fd, ABS_X, 0, width - 1);
+	ok |= set_abs(fd, ABS_Y, 0, height - 1);
+	ok |= set_abs(fd, ABS_MT_SLOT, 0, n_slots - 1);
+	ok |= set_abs(fd, ABS_MT_TRACKING_ID, 0, 65535);
+	ok |= set_abs(fd, ABS_MT_POSITION_X, 0, width - 1);
+	ok |= set_abs(fd, ABS_MT_POSITION_Y, 0, height - 1);
+	ok |= ioctl(fd, UI_DEV_SETUP, &setup);
+	ok |= ioctl(fd, UI_DEV_CREATE);
+	if (ok != 0) {
+		perror("[uinput] Could not create the virtual touchscreen. ioctl");
+		close(fd);
+		return -1;
+	}
+
+	if (!find_event_node(fd, event_path_out, size)) {
+		uinput_destroy(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int  uinput_write_events(int fd, const struct input_event *events, size_t n_events) {
+	size_t n_written = 0;
+	ssize_t ok;
+
+	while (n_written < n_events * sizeof(*events)) {
+		ok = write(fd, (const char *) events + n_written, n_events * sizeof(*events) - n_written);
+		if (ok < 0) {
+			if (errno == EINTR) continue;
+			return errno;
+		}
+
+		n_written += ok;
+	}
+
+	return 0;
+}
+
+void uinput_destroy(int fd) {
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+}
+
+bool uinput_is_open_in_process(int pid, const char *path) {
+	char fd_dir[64], link_path[PATH_MAX], target[PATH_MAX];
+	struct dirent *entry;
+	ssize_t length;
+	bool found = false;
+	DIR *dir;
+
+	snprintf(fd_dir, sizeof(fd_dir), "/proc/%d/fd", pid);
+
+	dir = opendir(fd_dir);
+	if (dir == NULL) return false;
+
+	while (!found && ((entry = readdir(dir)) != NULL)) {
+		if (entry->d_name[0] == '.') continue;
+
+		snprintf(link_path, sizeof(link_path), "%s/%s", fd_dir, entry->d_name);
+
+		length = readlink(link_path, target, sizeof(target) - 1);
+		if (length < 0) continue;
+		target[length] = '\0';
+
+		found = strcmp(target, path) == 0;
+	}
+
+	closedir(dir);
+	return found;
+}
+
+uint64_t uinput_get_time_ns(void) {
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
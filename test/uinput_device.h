@@ -0,0 +1,30 @@
+#ifndef _UINPUT_DEVICE_H
+#define _UINPUT_DEVICE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+/// Virtual input devices for the input tests, created using /dev/uinput.
+/// (needs write access to /dev/uinput, so usually root)
+
+/// Creates a virtual multitouch touchscreen with n_slots slots and a width x height
+/// coordinate range. Returns the uinput fd (or -1) and writes the path of the event device
+/// node of the touchscreen into event_path_out.
+int  uinput_create_touchscreen(const char *name, int n_slots, int width, int height, char *event_path_out, size_t size);
+
+/// Writes n_events input events at once. Returns 0 on success, or an errno value.
+int  uinput_write_events(int fd, const struct input_event *events, size_t n_events);
+
+/// Removes the virtual device again.
+void uinput_destroy(int fd);
+
+/// Returns true if the process pid has the file at path open.
+/// (used to check whether flutter-pi opened or closed an input device)
+bool uinput_is_open_in_process(int pid, const char *path);
+
+/// Returns CLOCK_MONOTONIC in nanoseconds.
+uint64_t uinput_get_time_ns(void);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "uinput_device.h"
+
+/*
+ * Input device hotplug test.
+ * Plugs a virtual touchscreen in & out of a running flutter-pi a number of times and checks
+ * that flutter-pi opens the device when it shows up (on_input_hotplug) and closes it again
+ * when it's removed (close_input_device), by looking at the open files of the flutter-pi process.
+ * Every second cycle, the touchscreen is removed while a finger is still down, so the
+ * kCancel / kRemove path is taken with an active touch.
+ *
+ * usage: uinput_hotplug <pid of flutter-pi> [number of cycles]
+ * flutter-pi needs to use the default input device pattern (or one that matches /dev/input/event*).
+ */
+
+/// How long flutter-pi may take to open or close the device.
+#define TIMEOUT_MS 2000
+
+static bool wait_until_open(int pid, const char *path, bool open, uint64_t *elapsed_ns_out) {
+	uint64_t start_ns = uinput_get_time_ns();
+
+	while (uinput_is_open_in_process(pid, path) != open) {
+		if (uinput_get_time_ns() - start_ns > TIMEOUT_MS * 1000000ull)
+			return false;
+
+		usleep(1000);
+	}
+
+	*elapsed_ns_out = uinput_get_time_ns() - start_ns;
+	return true;
+}
+
+static int touch(int fd, bool down) {
+	struct input_event events[] = {
+		{.type = EV_ABS, .code = ABS_MT_SLOT, .value = 0},
+		{.type = EV_ABS, .code = ABS_MT_TRACKING_ID, .value = down ? 1 : -1},
+		{.type = EV_ABS, .code = ABS_MT_POSITION_X, .value = 100},
+		{.type = EV_ABS, .code = ABS_MT_POSITION_Y, .value = 100},
+		{.type = EV_KEY, .code = BTN_TOUCH, .value = down},
+		{.type = EV_SYN, .code = SYN_REPORT, .value = 0}
+	};
+
+	return uinput_write_events(fd, events, sizeof(events) / sizeof(*events));
+}
+
+int main(int argc, char **argv) {
+	char path[PATH_MAX];
+	uint64_t open_ns, close_ns;
+	int pid, n_cycles, n_failed = 0, fd;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <pid of flutter-pi> [number of cycles]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	pid = atoi(argv[1]);
+	n_cycles = argc > 2 ? atoi(argv[2]) : 10;
+
+	for (int i = 0; i < n_cycles; i++) {
+		fd = uinput_create_touchscreen("flutter-pi hotplug test", 10, 1920, 1080, path, sizeof(path));
+		if (fd < 0) return EXIT_FAILURE;
+
+		if (!wait_until_open(pid, path, true, &open_ns)) {
+			printf("cycle %d: FAIL, flutter-pi didn't open \"%s\"\n", i, path);
+			uinput_destroy(fd);
+			n_failed++;
+			continue;
+		}
+
+		touch(fd, true);
+		if (i % 2 == 0) touch(fd, false);
+
+		// give flutter-pi the chance to read the touch before the device is gone.
+		usleep(50000);
+
+		uinput_destroy(fd);
+
+		if (!wait_until_open(pid, path, false, &close_ns)) {
+			printf("cycle %d: FAIL, flutter-pi didn't close \"%s\"\n", i, path);
+			n_failed++;
+			continue;
+		}
+
+		printf(
+			"cycle %d: ok, \"%s\" opened after %.1f ms, closed after %.1f ms%s\n",
+			i, path, open_ns / 1e6, close_ns / 1e6,
+			i % 2 == 0 ? "" : " (removed while touched)"
+		);
+	}
+
+	printf("%d of %d hotplug cycles failed.\n", n_failed, n_cycles);
+
+	return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "uinput_device.h"
+
+/*
+ * Input stress test.
+ * Creates a number of virtual touchscreens and moves a finger on each of them at a high
+ * report rate (10 kHz by default) for some seconds. The first touchscreen floods at the full
+ * rate, the others report at 100 Hz, like a normal touchscreen next to the flooding one.
+ *
+ * When the devices are removed at the end, flutter-pi prints for each of them how often the
+ * kernel dropped events (SYN_DROPPED) because flutter-pi didn't read them fast enough.
+ * With the round-robin draining of the io thread, that should be 0 for all devices,
+ * including the slow ones next to the flooding one.
+ *
+ * usage: uinput_stress <pid of flutter-pi> [number of devices] [reports per second] [seconds]
+ */
+
+#define MAX_DEVICES 16
+
+/// The report rate of the touchscreens that don't flood.
+#define SLOW_RATE_HZ 100
+
+/// How long flutter-pi may take to open the devices.
+#define TIMEOUT_MS 2000
+
+struct stress_device {
+	int fd;
+	char path[PATH_MAX];
+	unsigned int rate_hz;
+	uint64_t n_reports;
+};
+
+static int move(struct stress_device *device, bool down) {
+	int pos = (int) (device->n_reports % 1000) + 100;
+
+	// the tracking id & BTN_TOUCH only change in the first & last report, the kernel
+	// filters out the unchanged values of the other reports.
+	struct input_event events[] = {
+		{.type = EV_ABS, .code = ABS_MT_SLOT, .value = 0},
+		{.type = EV_ABS, .code = ABS_MT_TRACKING_ID, .value = down ? 1 : -1},
+		{.type = EV_ABS, .code = ABS_MT_POSITION_X, .value = pos},
+		{.type = EV_ABS, .code = ABS_MT_POSITION_Y, .value = pos},
+		{.type = EV_KEY, .code = BTN_TOUCH, .value = down},
+		{.type = EV_SYN, .code = SYN_REPORT, .value = 0}
+	};
+
+	device->n_reports++;
+
+	return uinput_write_events(device->fd, events, sizeof(events) / sizeof(*events));
+}
+
+int main(int argc, char **argv) {
+	struct stress_device devices[MAX_DEVICES] = {0};
+	uint64_t start_ns, now_ns, due;
+	unsigned int rate_hz;
+	double seconds;
+	int pid, n_devices, n_failed = 0, ok;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <pid of flutter-pi> [number of devices] [reports per second] [seconds]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	pid = atoi(argv[1]);
+	n_devices = argc > 2 ? atoi(argv[2]) : 3;
+	rate_hz = argc > 3 ? (unsigned int) atoi(argv[3]) : 10000;
+	seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+	if ((n_devices < 1) || (n_devices > MAX_DEVICES) || (rate_hz == 0) || (seconds <= 0)) {
+		fprintf(stderr, "invalid arguments. There can be 1 to %d devices.\n", MAX_DEVICES);
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < n_devices; i++) {
+		devices[i].fd = uinput_create_touchscreen("flutter-pi stress test", 10, 1920, 1080, devices[i].path, sizeof(devices[i].path));
+		if (devices[i].fd < 0) return EXIT_FAILURE;
+
+		devices[i].rate_hz = i == 0 ? rate_hz : SLOW_RATE_HZ;
+	}
+
+	// wait until flutter-pi opened all the devices.
+	start_ns = uinput_get_time_ns();
+	for (int i = 0; i < n_devices; i++) {
+		while (!uinput_is_open_in_process(pid, devices[i].path)) {
+			if (uinput_get_time_ns() - start_ns > TIMEOUT_MS * 1000000ull) {
+				fprintf(stderr, "flutter-pi didn't open \"%s\".\n", devices[i].path);
+				for (int j = 0; j < n_devices; j++) uinput_destroy(devices[j].fd);
+				return EXIT_FAILURE;
+			}
+
+			usleep(1000);
+		}
+	}
+
+	// write the reports that are due every 100us. If we fall behind, the missing reports are written in one go,
+	// so the rate is kept on average.
+	start_ns = uinput_get_time_ns();
+	do {
+		now_ns = uinput_get_time_ns();
+
+		for (int i = 0; i < n_devices; i++) {
+			due = (now_ns - start_ns) * devices[i].rate_hz / 1000000000ull + 1;
+
+			while (devices[i].n_reports < due) {
+				ok = move(devices + i, true);
+				if (ok != 0) {
+					fprintf(stderr, "couldn't write input events to \"%s\". uinput_write_events: %s\n", devices[i].path, strerror(ok));
+					n_failed++;
+					break;
+				}
+			}
+		}
+
+		usleep(100);
+	} while ((now_ns - start_ns < (uint64_t) (seconds * 1e9)) && (n_failed == 0));
+
+	for (int i = 0; i < n_devices; i++) {
+		move(devices + i, false);
+
+		printf(
+			"device %d (\"%s\"): %llu reports in %.2f s, %.0f reports per second.\n",
+			i, devices[i].path, (unsigned long long) devices[i].n_reports,
+			(now_ns - start_ns) / 1e9, devices[i].n_reports / ((now_ns - start_ns) / 1e9)
+		);
+	}
+
+	// let flutter-pi read the last reports, then remove the devices. flutter-pi now prints how many
+	// times the kernel dropped events of each device.
+	usleep(50000);
+	for (int i = 0; i < n_devices; i++)
+		uinput_destroy(devices[i].fd);
+
+	printf("done. Check the flutter-pi output for \"the kernel dropped events of this device\".\n");
+
+	return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}